@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+/* Compares loading a large config into C structs with the parser generated
+ * from bench/codegen_schema.json, with lax_json_bind, and with hand written
+ * callbacks that compare each key, all filling the same structs. Parsing
+ * with callbacks that do nothing is the floor for all three. */
+
+#include "service_parser.h"
+#include <laxjson_bind.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RUNS 5
+
+static const struct LaxJsonBindField ROUTE_FIELDS[] = {
+    LAX_JSON_BIND_STRING("path", struct route, path, NULL),
+    LAX_JSON_BIND_STRING("backend", struct route, backend, "default"),
+    LAX_JSON_BIND_NUMBER("timeout", LaxJsonBindDouble, struct route, timeout, 30),
+    LAX_JSON_BIND_NUMBER("retries", LaxJsonBindInt, struct route, retries, 0),
+    LAX_JSON_BIND_NUMBER("enabled", LaxJsonBindBool, struct route, enabled, 0),
+};
+
+static const struct LaxJsonBindStruct ROUTE = {
+    sizeof(struct route), 5, ROUTE_FIELDS
+};
+
+static const struct LaxJsonBindField SERVICE_FIELDS[] = {
+    LAX_JSON_BIND_STRING("name", struct service, name, NULL),
+    LAX_JSON_BIND_NUMBER("port", LaxJsonBindInt, struct service, port, 80),
+    LAX_JSON_BIND_ARRAY("routes", LaxJsonBindStruct, &ROUTE, struct service, routes, routes_count, 0),
+};
+
+static const struct LaxJsonBindStruct SERVICE = {
+    sizeof(struct service), 3, SERVICE_FIELDS
+};
+
+enum Key {
+    KeyNone,
+    KeyName,
+    KeyPort,
+    KeyRoutes,
+    KeyPath,
+    KeyBackend,
+    KeyTimeout,
+    KeyRetries,
+    KeyEnabled
+};
+
+/* A loader written by hand against the callback interface */
+struct Loader {
+    struct service *service;
+    int routes_size;
+    int depth;
+    enum Key key;
+};
+
+static char *dup_string(const char *value, int length) {
+    char *copy = malloc(length + 1);
+    if (copy)
+        memcpy(copy, value, length + 1);
+    return copy;
+}
+
+static struct route *current_route(struct Loader *loader) {
+    return &loader->service->routes[loader->service->routes_count - 1];
+}
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    struct Loader *loader = context->userdata;
+    char **target = NULL;
+
+    if (type == LaxJsonTypeProperty) {
+        loader->key = KeyNone;
+        if (loader->depth == 1) {
+            if (strcmp(value, "name") == 0)
+                loader->key = KeyName;
+            else if (strcmp(value, "port") == 0)
+                loader->key = KeyPort;
+            else if (strcmp(value, "routes") == 0)
+                loader->key = KeyRoutes;
+        } else if (loader->depth == 3) {
+            if (strcmp(value, "path") == 0)
+                loader->key = KeyPath;
+            else if (strcmp(value, "backend") == 0)
+                loader->key = KeyBackend;
+            else if (strcmp(value, "timeout") == 0)
+                loader->key = KeyTimeout;
+            else if (strcmp(value, "retries") == 0)
+                loader->key = KeyRetries;
+            else if (strcmp(value, "enabled") == 0)
+                loader->key = KeyEnabled;
+        }
+        return 0;
+    }
+    if (loader->depth == 1 && loader->key == KeyName)
+        target = &loader->service->name;
+    else if (loader->depth == 3 && loader->key == KeyPath)
+        target = &current_route(loader)->path;
+    else if (loader->depth == 3 && loader->key == KeyBackend)
+        target = &current_route(loader)->backend;
+    if (!target)
+        return 0;
+    free(*target);
+    *target = dup_string(value, length);
+    return *target == NULL;
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    struct Loader *loader = context->userdata;
+
+    if (loader->depth == 1 && loader->key == KeyPort)
+        loader->service->port = x;
+    else if (loader->depth == 3 && loader->key == KeyTimeout)
+        current_route(loader)->timeout = x;
+    else if (loader->depth == 3 && loader->key == KeyRetries)
+        current_route(loader)->retries = x;
+    return 0;
+}
+
+static int on_primitive(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct Loader *loader = context->userdata;
+
+    if (loader->depth == 3 && loader->key == KeyEnabled)
+        current_route(loader)->enabled = type == LaxJsonTypeTrue;
+    return 0;
+}
+
+static int on_begin(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct Loader *loader = context->userdata;
+    struct service *service = loader->service;
+    struct route *new_ptr;
+    struct route *route;
+
+    loader->depth += 1;
+    if (loader->depth != 3 || loader->key != KeyRoutes)
+        return 0;
+    if (service->routes_count >= loader->routes_size) {
+        loader->routes_size = loader->routes_size ? loader->routes_size * 2 : 16;
+        new_ptr = realloc(service->routes, loader->routes_size * sizeof(struct route));
+        if (!new_ptr)
+            return 1;
+        service->routes = new_ptr;
+    }
+    route = &service->routes[service->routes_count];
+    service->routes_count += 1;
+    memset(route, 0, sizeof(struct route));
+    route->backend = dup_string("default", 7);
+    route->timeout = 30;
+    return route->backend == NULL;
+}
+
+static int on_end(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct Loader *loader = context->userdata;
+
+    loader->depth -= 1;
+    /* the key of the routes array stays current for its elements */
+    if (loader->depth == 2)
+        loader->key = KeyRoutes;
+    return 0;
+}
+
+static int on_string_nothing(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    return 0;
+}
+
+static int on_number_nothing(struct LaxJsonContext *context, double x) {
+    return 0;
+}
+
+static int on_type_nothing(struct LaxJsonContext *context, enum LaxJsonType type) {
+    return 0;
+}
+
+static enum LaxJsonError parse_only(int size, const char *data) {
+    struct LaxJsonContext *context = lax_json_create();
+    enum LaxJsonError err;
+
+    if (!context)
+        return LaxJsonErrorNoMem;
+    context->string = on_string_nothing;
+    context->number = on_number_nothing;
+    context->primitive = on_type_nothing;
+    context->begin = on_type_nothing;
+    context->end = on_type_nothing;
+    err = lax_json_feed(context, size, data);
+    if (!err)
+        err = lax_json_eof(context);
+    lax_json_destroy(context);
+    return err;
+}
+
+static enum LaxJsonError load_by_hand(struct service *service, int size, const char *data) {
+    struct LaxJsonContext *context = lax_json_create();
+    struct Loader loader;
+    enum LaxJsonError err;
+
+    if (!context)
+        return LaxJsonErrorNoMem;
+    memset(service, 0, sizeof(struct service));
+    service->port = 80;
+    memset(&loader, 0, sizeof(loader));
+    loader.service = service;
+    context->userdata = &loader;
+    context->string = on_string;
+    context->number = on_number;
+    context->primitive = on_primitive;
+    context->begin = on_begin;
+    context->end = on_end;
+    err = lax_json_feed(context, size, data);
+    if (!err)
+        err = lax_json_eof(context);
+    lax_json_destroy(context);
+    return err;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *generate(long target_size, long *size_out, int *count_out) {
+    char *data = malloc(target_size + 1024);
+    long size = 0;
+    int i = 0;
+
+    if (!data) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    size += sprintf(data, "// generated service config\n{\n  name: 'api',\n  port: 8080,\n  routes: [\n");
+    while (size < target_size) {
+        size += sprintf(data + size, "    { path: '/api/v1/item/%d', backend: \"pool-%d\", timeout: %d.5, "
+                "retries: %d, enabled: %s, },\n", i, i % 7, i % 30, i % 4, (i % 3) ? "true" : "false");
+        i += 1;
+    }
+    size += sprintf(data + size, "  ],\n}\n");
+    *size_out = size;
+    *count_out = i;
+    return data;
+}
+
+static void check(const struct service *service, int count) {
+    const struct route *last = &service->routes[count - 1];
+
+    if (service->routes_count != count || service->port != 8080 || strcmp(service->name, "api") != 0 ||
+        last->retries != (count - 1) % 4 || last->timeout != (count - 1) % 30 + 0.5 ||
+        last->enabled != ((count - 1) % 3 != 0))
+    {
+        fprintf(stderr, "wrong result\n");
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    long target_size = (argc > 1) ? atol(argv[1]) : 32L * 1024 * 1024;
+    const char *names[] = {"generated parser", "lax_json_bind", "hand written callbacks",
+        "callbacks doing nothing"};
+    struct LaxJsonBindSchema *schema = lax_json_bind_schema_create(&SERVICE);
+    struct LaxJsonBinder *binder;
+    struct service service;
+    enum LaxJsonError err;
+    double best[4];
+    double start;
+    char *data;
+    long size;
+    int count;
+    int method;
+    int i;
+
+    if (!schema) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    data = generate(target_size, &size, &count);
+    for (method = 0; method < 4; method += 1) {
+        best[method] = 1e9;
+        for (i = 0; i < RUNS; i += 1) {
+            binder = NULL;
+            start = now();
+            if (method == 0) {
+                err = service_parse(&service, size, data);
+            } else if (method == 1) {
+                binder = lax_json_bind_create(schema, &service);
+                if (!binder) {
+                    fprintf(stderr, "out of memory\n");
+                    return 1;
+                }
+                err = lax_json_bind_feed(binder, size, data);
+                if (!err)
+                    err = lax_json_bind_eof(binder);
+            } else if (method == 2) {
+                err = load_by_hand(&service, size, data);
+            } else {
+                err = parse_only(size, data);
+            }
+            start = now() - start;
+            if (err) {
+                fprintf(stderr, "parse error: %s\n", lax_json_str_err(err));
+                return 1;
+            }
+            if (method < 3)
+                check(&service, count);
+            if (binder)
+                lax_json_bind_destroy(binder);
+            else if (method < 3)
+                service_free(&service);
+            if (start < best[method])
+                best[method] = start;
+        }
+    }
+
+    printf("%d routes, %.1f MB\n", count, size / 1e6);
+    for (method = 0; method < 4; method += 1) {
+        printf("  %-24s %8.1f ms %8.1f MB/s %5.2fx\n", names[method], best[method] * 1e3,
+                size / 1e6 / best[method], best[method] / best[0]);
+    }
+    free(data);
+    lax_json_bind_schema_destroy(schema);
+    return 0;
+}
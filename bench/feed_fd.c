@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+/* Compares a read and feed loop with lax_json_feed_fd, which overlaps reading
+ * and parsing. Each run starts by asking the kernel to drop the file from the
+ * page cache, so on real storage the numbers reflect cold reads. */
+
+#define _GNU_SOURCE
+#include <laxjson.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    return 0;
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    return 0;
+}
+
+static int on_type(struct LaxJsonContext *context, enum LaxJsonType type) {
+    return 0;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct LaxJsonContext *create(void) {
+    struct LaxJsonContext *context = lax_json_create();
+    context->string = on_string;
+    context->number = on_number;
+    context->primitive = on_type;
+    context->begin = on_type;
+    context->end = on_type;
+    return context;
+}
+
+static int open_cold(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        exit(1);
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    return fd;
+}
+
+static void check(enum LaxJsonError err) {
+    if (err) {
+        fprintf(stderr, "parse error: %s\n", lax_json_str_err(err));
+        exit(1);
+    }
+}
+
+static double run_serial(const char *path, int block_size) {
+    struct LaxJsonContext *context = create();
+    char *block = malloc(block_size);
+    int fd = open_cold(path);
+    double start = now();
+    ssize_t amt;
+
+    while ((amt = read(fd, block, block_size)) > 0)
+        check(lax_json_feed(context, amt, block));
+    check(lax_json_eof(context));
+    start = now() - start;
+
+    close(fd);
+    free(block);
+    lax_json_destroy(context);
+    return start;
+}
+
+static double run_pipelined(const char *path, int block_size, int queue_depth) {
+    struct LaxJsonContext *context = create();
+    int fd = open_cold(path);
+    double start = now();
+
+    check(lax_json_feed_fd(context, fd, block_size, queue_depth));
+    check(lax_json_eof(context));
+    start = now() - start;
+
+    close(fd);
+    lax_json_destroy(context);
+    return start;
+}
+
+static void generate(const char *path, long target_size) {
+    FILE *f = fopen(path, "wb");
+    long size = 0;
+    long i = 0;
+
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    size += fprintf(f, "[\n");
+    while (size < target_size) {
+        size += fprintf(f, "  { id: %ld, name: 'record %ld', score: %ld.25, tags: ['a', \"b\"] },\n",
+                i, i, i % 1000);
+        i += 1;
+    }
+    fprintf(f, "]\n");
+    fflush(f);
+    fsync(fileno(f));
+    fclose(f);
+}
+
+int main(int argc, char *argv[]) {
+    char generated[] = "/tmp/laxjson_feed_fd_XXXXXX";
+    const char *path = (argc > 1) ? argv[1] : NULL;
+    int block_size = (argc > 2) ? atoi(argv[2]) : 1048576;
+    int queue_depth = (argc > 3) ? atoi(argv[3]) : 4;
+    double serial, pipelined;
+    struct stat st;
+    int fd;
+
+    if (!path) {
+        fd = mkstemp(generated);
+        if (fd < 0) {
+            perror("mkstemp");
+            return 1;
+        }
+        close(fd);
+        path = generated;
+        generate(path, 128L * 1024 * 1024);
+    }
+    if (stat(path, &st)) {
+        perror(path);
+        return 1;
+    }
+
+    serial = run_serial(path, block_size);
+    pipelined = run_pipelined(path, block_size, queue_depth);
+
+    printf("%.1f MB, %d byte blocks, queue depth %d\n", st.st_size / 1e6, block_size, queue_depth);
+    printf("read + feed:     %8.1f ms %8.1f MB/s\n", serial * 1e3, st.st_size / 1e6 / serial);
+    printf("lax_json_feed_fd: %7.1f ms %8.1f MB/s\n", pipelined * 1e3, st.st_size / 1e6 / pipelined);
+
+    if (path == generated)
+        unlink(generated);
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+/* Compares decompressing a gzip file into memory and then feeding it with
+ * lax_json_parse_file, which decompresses on another thread into the blocks
+ * the parser reads. Parsing the uncompressed file is shown for reference. */
+
+#include <laxjson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    return 0;
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    return 0;
+}
+
+static int on_type(struct LaxJsonContext *context, enum LaxJsonType type) {
+    return 0;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct LaxJsonContext *create(void) {
+    struct LaxJsonContext *context = lax_json_create();
+    context->string = on_string;
+    context->number = on_number;
+    context->primitive = on_type;
+    context->begin = on_type;
+    context->end = on_type;
+    return context;
+}
+
+static void check(enum LaxJsonError err) {
+    if (err) {
+        fprintf(stderr, "parse error: %s\n", lax_json_str_err(err));
+        exit(1);
+    }
+}
+
+static double run_buffered(const char *gz_path, long size) {
+    struct LaxJsonContext *context = create();
+    char *data = malloc(size);
+    double start = now();
+    gzFile f = gzopen(gz_path, "rb");
+
+    if (!f || !data || gzread(f, data, size) != size) {
+        fprintf(stderr, "unable to decompress %s\n", gz_path);
+        exit(1);
+    }
+    gzclose(f);
+    check(lax_json_feed(context, size, data));
+    check(lax_json_eof(context));
+    start = now() - start;
+
+    free(data);
+    lax_json_destroy(context);
+    return start;
+}
+
+static double run_parse_file(const char *path) {
+    struct LaxJsonContext *context = create();
+    double start = now();
+
+    check(lax_json_parse_file(context, path));
+    start = now() - start;
+
+    lax_json_destroy(context);
+    return start;
+}
+
+/* Writes a document of about target_size bytes to path and its gzip
+ * compressed copy to gz_path. Returns the uncompressed size. */
+static long generate(const char *path, const char *gz_path, long target_size) {
+    FILE *f = fopen(path, "wb");
+    gzFile gz = gzopen(gz_path, "wb6");
+    char line[256];
+    long size = 0;
+    long i = 0;
+    int len;
+
+    if (!f || !gz) {
+        fprintf(stderr, "unable to create %s\n", path);
+        exit(1);
+    }
+    len = sprintf(line, "[\n");
+    while (size < target_size) {
+        fwrite(line, 1, len, f);
+        gzwrite(gz, line, len);
+        size += len;
+        len = sprintf(line, "  { id: %ld, name: 'record %ld', score: %ld.25, tags: ['a', \"b\"] },\n",
+                i, i, i % 1000);
+        i += 1;
+    }
+    len = sprintf(line, "]\n");
+    fwrite(line, 1, len, f);
+    gzwrite(gz, line, len);
+    size += len;
+    fclose(f);
+    gzclose(gz);
+    return size;
+}
+
+int main(int argc, char *argv[]) {
+    char dir[] = "/tmp/laxjson_parse_gz_XXXXXX";
+    char path[64];
+    char gz_path[64];
+    long target_size = (argc > 1) ? atol(argv[1]) : 128L * 1024 * 1024;
+    double buffered, piped, plain;
+    long size;
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/data.json", dir);
+    snprintf(gz_path, sizeof(gz_path), "%s/data.json.gz", dir);
+    size = generate(path, gz_path, target_size);
+
+    buffered = run_buffered(gz_path, size);
+    piped = run_parse_file(gz_path);
+    plain = run_parse_file(path);
+
+    printf("%.1f MB uncompressed\n", size / 1e6);
+    printf("gunzip to memory + feed: %8.1f ms %8.1f MB/s\n", buffered * 1e3, size / 1e6 / buffered);
+    printf("lax_json_parse_file .gz: %8.1f ms %8.1f MB/s\n", piped * 1e3, size / 1e6 / piped);
+    printf("lax_json_parse_file:     %8.1f ms %8.1f MB/s\n", plain * 1e3, size / 1e6 / plain);
+
+    unlink(path);
+    unlink(gz_path);
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+/* Measures loading a directory of config files the way a service does at
+ * startup: cold, parsing the text and writing snapshots, warm, mapping the
+ * snapshots written by the cold run, and parsing all of the text on a
+ * thread pool. */
+
+#include <laxjson_document.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_config(const char *path, int index, int records) {
+    FILE *f = fopen(path, "wb");
+    int i;
+
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(f, "// generated config %d\n{\n  name: 'service-%d',\n  routes: [\n", index, index);
+    for (i = 0; i < records; i += 1) {
+        fprintf(f, "    { path: '/api/v1/item/%d', backend: \"pool-%d\", timeout: %d.5, "
+                "retries: %d, enabled: %s, },\n", i, i % 7, i % 30, i % 4, (i % 3) ? "true" : "false");
+    }
+    fprintf(f, "  ],\n}\n");
+    fclose(f);
+}
+
+static double load_all(char **paths, char **cache_paths, int count) {
+    struct LaxJsonDocument *doc;
+    enum LaxJsonError err;
+    double start = now();
+    int i;
+
+    for (i = 0; i < count; i += 1) {
+        if ((err = lax_json_snapshot_load(paths[i], cache_paths[i], &doc))) {
+            fprintf(stderr, "%s: %s\n", paths[i], lax_json_str_err(err));
+            exit(1);
+        }
+        lax_json_document_destroy(doc);
+    }
+    return now() - start;
+}
+
+static double load_parallel(char **paths, int count, int threads) {
+    struct LaxJsonLoadResult *results = calloc(count, sizeof(struct LaxJsonLoadResult));
+    double start = now();
+    int i;
+
+    if (!results || lax_json_load_many((const char *const *)paths, count, threads, NULL, NULL, results)) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < count; i += 1) {
+        if (results[i].error) {
+            fprintf(stderr, "%s: %s\n", paths[i], lax_json_str_err(results[i].error));
+            exit(1);
+        }
+        lax_json_document_destroy(results[i].document);
+    }
+    free(results);
+    return now() - start;
+}
+
+int main(int argc, char *argv[]) {
+    char dir[] = "/tmp/laxjson_bench_XXXXXX";
+    int count = (argc > 1) ? atoi(argv[1]) : 64;
+    int records = (argc > 2) ? atoi(argv[2]) : 2000;
+    int threads = (argc > 3) ? atoi(argv[3]) : 0;
+    char **paths;
+    char **cache_paths;
+    double cold, warm, serial, parallel;
+    struct stat st;
+    double total_size = 0;
+    int i;
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    paths = calloc(count, sizeof(char *));
+    cache_paths = calloc(count, sizeof(char *));
+    for (i = 0; i < count; i += 1) {
+        paths[i] = malloc(strlen(dir) + 32);
+        cache_paths[i] = malloc(strlen(dir) + 32);
+        sprintf(paths[i], "%s/config%d.json", dir, i);
+        sprintf(cache_paths[i], "%s/config%d.snap", dir, i);
+        write_config(paths[i], i, records);
+        if (stat(paths[i], &st) == 0)
+            total_size += st.st_size;
+    }
+
+    serial = load_parallel(paths, count, 1);
+    parallel = load_parallel(paths, count, threads);
+    cold = load_all(paths, cache_paths, count);
+    warm = load_all(paths, cache_paths, count);
+
+    printf("%d files, %.1f MB of lax JSON\n", count, total_size / 1e6);
+    printf("cold (parse + write snapshot): %8.2f ms\n", cold * 1e3);
+    printf("warm (map snapshot):           %8.2f ms\n", warm * 1e3);
+    printf("parse, 1 thread:               %8.2f ms\n", serial * 1e3);
+    printf("parse, thread pool:            %8.2f ms\n", parallel * 1e3);
+
+    for (i = 0; i < count; i += 1) {
+        unlink(paths[i]);
+        unlink(cache_paths[i]);
+        free(paths[i]);
+        free(cache_paths[i]);
+    }
+    free(paths);
+    free(cache_paths);
+    rmdir(dir);
+    return 0;
+}
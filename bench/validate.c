@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+/* Compares checking documents with lax_json_validate against parsing them
+ * with callbacks that do nothing, for a compact document of numbers and
+ * bare properties and a pretty printed one of strings. */
+
+#include <laxjson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RUNS 5
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    return 0;
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    return 0;
+}
+
+static int on_type(struct LaxJsonContext *context, enum LaxJsonType type) {
+    return 0;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *generate(long target_size, int pretty, long *size_out) {
+    char *data = malloc(target_size + 1024);
+    long size = 0;
+    long i = 0;
+
+    if (!data) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    size += sprintf(data, "[\n");
+    while (size < target_size) {
+        if (pretty) {
+            size += sprintf(data + size, "    {\n        \"name\": \"user %ld\",\n"
+                    "        \"email\": \"user%ld@example.com\",\n"
+                    "        \"tags\": [\n            \"alpha\",\n            \"beta\"\n        ]\n"
+                    "    },\n", i, i);
+        } else {
+            size += sprintf(data + size, "{id:%ld,price:%ld.%02ld,ratio:0.%06ld,at:[%ld,%ld]},",
+                    i, i % 1000, i % 100, i * 7919 % 1000000, i * 3, i * 5);
+        }
+        i += 1;
+    }
+    size += sprintf(data + size, "]\n");
+    *size_out = size;
+    return data;
+}
+
+static double run(const char *data, long size, int validate) {
+    struct LaxJsonContext *context;
+    double best = 1e9;
+    double start;
+    enum LaxJsonError err;
+    int i;
+
+    for (i = 0; i < RUNS; i += 1) {
+        context = lax_json_create();
+        context->string = on_string;
+        context->number = on_number;
+        context->primitive = on_type;
+        context->begin = on_type;
+        context->end = on_type;
+        start = now();
+        if (validate) {
+            err = lax_json_validate(context, size, data);
+        } else {
+            err = lax_json_feed(context, size, data);
+            if (!err)
+                err = lax_json_eof(context);
+        }
+        start = now() - start;
+        if (err) {
+            fprintf(stderr, "parse error: %s\n", lax_json_str_err(err));
+            exit(1);
+        }
+        if (start < best)
+            best = start;
+        lax_json_destroy(context);
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    long target_size = (argc > 1) ? atol(argv[1]) : 32L * 1024 * 1024;
+    const char *names[] = {"compact numbers", "pretty strings"};
+    double callbacks, validate;
+    char *data;
+    long size;
+    int pretty;
+
+    for (pretty = 0; pretty < 2; pretty += 1) {
+        data = generate(target_size, pretty, &size);
+        callbacks = run(data, size, 0);
+        validate = run(data, size, 1);
+        printf("%s, %.1f MB\n", names[pretty], size / 1e6);
+        printf("  callbacks:         %8.1f ms %8.1f MB/s\n", callbacks * 1e3, size / 1e6 / callbacks);
+        printf("  lax_json_validate: %8.1f ms %8.1f MB/s\n", validate * 1e3, size / 1e6 / validate);
+        free(data);
+    }
+    return 0;
+}
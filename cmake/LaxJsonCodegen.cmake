@@ -0,0 +1,23 @@
+# laxjson_generate_parser(<schema> <output_base>)
+#
+# Runs laxjson_codegen on a lax JSON schema to produce <output_base>.c and
+# <output_base>.h. Add <output_base>.c to a target's sources, put the
+# directory of <output_base> on its include path and link it against laxjson.
+# See tools/laxjson_codegen.c for the schema format.
+function(laxjson_generate_parser SCHEMA OUTPUT_BASE)
+  if(TARGET laxjson_codegen)
+    set(CODEGEN laxjson_codegen)
+  else()
+    find_program(LAXJSON_CODEGEN_EXECUTABLE laxjson_codegen)
+    if(NOT LAXJSON_CODEGEN_EXECUTABLE)
+      message(FATAL_ERROR "laxjson_codegen not found")
+    endif()
+    set(CODEGEN ${LAXJSON_CODEGEN_EXECUTABLE})
+  endif()
+  get_filename_component(SCHEMA_PATH ${SCHEMA} ABSOLUTE)
+  add_custom_command(
+    OUTPUT ${OUTPUT_BASE}.c ${OUTPUT_BASE}.h
+    COMMAND ${CODEGEN} ${SCHEMA_PATH} ${OUTPUT_BASE}
+    DEPENDS ${SCHEMA_PATH} ${CODEGEN}
+    COMMENT "Generating lax JSON parser from ${SCHEMA}")
+endfunction()
@@ -0,0 +1,369 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+/* Converts lax JSON to strict JSON, either minified or pretty printed.
+ * Input is streamed through the parser, so memory use does not depend on
+ * the size of the document. */
+
+#include <laxjson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define OUT_BUF_SIZE 65536
+#define READ_BUF_SIZE 65536
+#define MAP_FEED_SIZE (1 << 30)
+
+struct Converter {
+    FILE *out;
+    char out_buf[OUT_BUF_SIZE];
+    int out_buf_index;
+    int write_failed;
+
+    int pretty;
+    /* one bit per nesting level, set until the first child is written */
+    unsigned char *first;
+    int depth;
+    int after_key;
+};
+
+static void flush_out(struct Converter *c) {
+    if (c->out_buf_index && fwrite(c->out_buf, 1, c->out_buf_index, c->out) != (size_t)c->out_buf_index)
+        c->write_failed = 1;
+    c->out_buf_index = 0;
+}
+
+static void put_bytes(struct Converter *c, const char *data, int size) {
+    if (c->out_buf_index + size > OUT_BUF_SIZE) {
+        flush_out(c);
+        if (size > OUT_BUF_SIZE) {
+            if (fwrite(data, 1, size, c->out) != (size_t)size)
+                c->write_failed = 1;
+            return;
+        }
+    }
+    memcpy(&c->out_buf[c->out_buf_index], data, size);
+    c->out_buf_index += size;
+}
+
+static void put_char(struct Converter *c, char ch) {
+    if (c->out_buf_index >= OUT_BUF_SIZE)
+        flush_out(c);
+    c->out_buf[c->out_buf_index] = ch;
+    c->out_buf_index += 1;
+}
+
+static void put_indent(struct Converter *c) {
+    int i;
+    put_char(c, '\n');
+    for (i = 0; i < c->depth; i += 1)
+        put_bytes(c, "    ", 4);
+}
+
+/* writes whatever has to come between the previous token and a new value */
+static void begin_value(struct Converter *c) {
+    if (c->after_key) {
+        c->after_key = 0;
+        return;
+    }
+    if (c->depth == 0)
+        return;
+    if (c->first[(c->depth - 1) / 8] & (1 << (c->depth - 1) % 8))
+        c->first[(c->depth - 1) / 8] &= ~(1 << (c->depth - 1) % 8);
+    else
+        put_char(c, ',');
+    if (c->pretty)
+        put_indent(c);
+}
+
+static void put_string(struct Converter *c, const char *value, int length) {
+    static const char HEX[] = "0123456789abcdef";
+    const char *end = value + length;
+    const char *run = value;
+    unsigned char ch;
+    char escape[6];
+
+    put_char(c, '"');
+    for (; value < end; value += 1) {
+        ch = (unsigned char)*value;
+        if (ch >= 0x20 && ch != '"' && ch != '\\')
+            continue;
+        put_bytes(c, run, value - run);
+        run = value + 1;
+        switch (ch) {
+            case '"': put_bytes(c, "\\\"", 2); break;
+            case '\\': put_bytes(c, "\\\\", 2); break;
+            case '\b': put_bytes(c, "\\b", 2); break;
+            case '\f': put_bytes(c, "\\f", 2); break;
+            case '\n': put_bytes(c, "\\n", 2); break;
+            case '\r': put_bytes(c, "\\r", 2); break;
+            case '\t': put_bytes(c, "\\t", 2); break;
+            default:
+                escape[0] = '\\';
+                escape[1] = 'u';
+                escape[2] = '0';
+                escape[3] = '0';
+                escape[4] = HEX[ch >> 4];
+                escape[5] = HEX[ch & 0xf];
+                put_bytes(c, escape, 6);
+                break;
+        }
+    }
+    put_bytes(c, run, end - run);
+    put_char(c, '"');
+}
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    struct Converter *c = context->userdata;
+    if (type == LaxJsonTypeProperty) {
+        c->after_key = 0;
+        begin_value(c);
+        put_string(c, value, length);
+        if (c->pretty)
+            put_bytes(c, ": ", 2);
+        else
+            put_char(c, ':');
+        c->after_key = 1;
+    } else {
+        begin_value(c);
+        put_string(c, value, length);
+    }
+    return 0;
+}
+
+static void put_double(struct Converter *c, double x)
+{
+    char buf[32];
+    int len;
+
+    /* use the shortest representation that reads back as the same double */
+    len = snprintf(buf, sizeof(buf), "%.15g", x);
+    if (strtod(buf, NULL) != x)
+        len = snprintf(buf, sizeof(buf), "%.17g", x);
+    if (strchr(buf, 'n') || strchr(buf, 'N')) {
+        /* inf cannot be spelled in JSON; an overflowing literal decodes back to it */
+        put_bytes(c, x < 0 ? "-1e999" : "1e999", x < 0 ? 6 : 5);
+        return;
+    }
+    put_bytes(c, buf, len);
+}
+
+/* Whether value is already a number in strict JSON syntax */
+static int is_strict_number(const char *value, int length)
+{
+    const char *p = value;
+    const char *end = value + length;
+    const char *digits;
+
+    if (p < end && *p == '-')
+        p += 1;
+    if (p < end && *p == '0') {
+        p += 1;
+    } else if (p < end && *p >= '1' && *p <= '9') {
+        while (p < end && *p >= '0' && *p <= '9')
+            p += 1;
+    } else {
+        return 0;
+    }
+    if (p < end && *p == '.') {
+        digits = p += 1;
+        while (p < end && *p >= '0' && *p <= '9')
+            p += 1;
+        if (p == digits)
+            return 0;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p += 1;
+        if (p < end && (*p == '+' || *p == '-'))
+            p += 1;
+        digits = p;
+        while (p < end && *p >= '0' && *p <= '9')
+            p += 1;
+        if (p == digits)
+            return 0;
+    }
+    return p == end;
+}
+
+/* Numbers are copied as written when they are valid JSON, keeping every
+ * digit, and are only converted to be respelled otherwise. */
+static int on_number(struct LaxJsonContext *context, const char *value, int length, int flags)
+{
+    struct Converter *c = context->userdata;
+    double x;
+
+    begin_value(c);
+    if (is_strict_number(value, length)) {
+        put_bytes(c, value, length);
+        return 0;
+    }
+    if (lax_json_number_to_double(value, length, &x))
+        return 1;
+    put_double(c, x);
+    return 0;
+}
+
+static int on_primitive(struct LaxJsonContext *context, enum LaxJsonType type)
+{
+    struct Converter *c = context->userdata;
+    begin_value(c);
+    if (type == LaxJsonTypeTrue)
+        put_bytes(c, "true", 4);
+    else if (type == LaxJsonTypeFalse)
+        put_bytes(c, "false", 5);
+    else
+        put_bytes(c, "null", 4);
+    return 0;
+}
+
+static int on_begin(struct LaxJsonContext *context, enum LaxJsonType type)
+{
+    struct Converter *c = context->userdata;
+    begin_value(c);
+    put_char(c, (type == LaxJsonTypeArray) ? '[' : '{');
+    c->first[c->depth / 8] |= 1 << c->depth % 8;
+    c->depth += 1;
+    return 0;
+}
+
+static int on_end(struct LaxJsonContext *context, enum LaxJsonType type)
+{
+    struct Converter *c = context->userdata;
+    c->depth -= 1;
+    if (c->pretty && !(c->first[c->depth / 8] & (1 << c->depth % 8)))
+        put_indent(c);
+    put_char(c, (type == LaxJsonTypeArray) ? ']' : '}');
+    return 0;
+}
+
+static int report(struct LaxJsonContext *context, const char *name, enum LaxJsonError err) {
+    fprintf(stderr, "%s:%d:%d: %s\n", name, context->line, context->column,
+            lax_json_str_err(err));
+    return 1;
+}
+
+static int convert_fd(struct LaxJsonContext *context, int fd, const char *name) {
+    static char buf[READ_BUF_SIZE];
+    struct stat st;
+    enum LaxJsonError err;
+    char *map;
+    off_t offset;
+    ssize_t amt_read;
+    int amt;
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            for (offset = 0; offset < st.st_size; offset += amt) {
+                amt = (st.st_size - offset > MAP_FEED_SIZE) ? MAP_FEED_SIZE : (int)(st.st_size - offset);
+                if ((err = lax_json_feed(context, amt, map + offset))) {
+                    munmap(map, st.st_size);
+                    return report(context, name, err);
+                }
+            }
+            munmap(map, st.st_size);
+            goto done;
+        }
+    }
+
+    while ((amt_read = read(fd, buf, sizeof(buf))) != 0) {
+        if (amt_read < 0) {
+            perror(name);
+            return 1;
+        }
+        if ((err = lax_json_feed(context, (int)amt_read, buf)))
+            return report(context, name, err);
+    }
+
+done:
+    if ((err = lax_json_eof(context)))
+        return report(context, name, err);
+    return 0;
+}
+
+static int usage(const char *exe) {
+    fprintf(stderr, "Usage: %s [--pretty] [file]\n"
+            "Converts lax JSON from file (or stdin) to strict JSON on stdout.\n"
+            "\n"
+            "Options:\n"
+            "  -p, --pretty  indent the output instead of minifying it\n", exe);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    struct LaxJsonContext *context;
+    struct Converter *c;
+    const char *path = NULL;
+    int fd;
+    int ret;
+    int i;
+
+    c = calloc(1, sizeof(struct Converter));
+    context = lax_json_create();
+    if (!c || !context) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (i = 1; i < argc; i += 1) {
+        if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--pretty") == 0)
+            c->pretty = 1;
+        else if (argv[i][0] == '-' && argv[i][1] != 0)
+            return usage(argv[0]);
+        else if (path)
+            return usage(argv[0]);
+        else
+            path = argv[i];
+    }
+
+    c->out = stdout;
+    /* every begin pushes at least one parser state, so this bounds the depth */
+    c->first = malloc(context->max_state_stack_size / 8 + 1);
+    if (!c->first) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    context->userdata = c;
+    context->string = on_string;
+    context->raw_number = on_number;
+    context->primitive = on_primitive;
+    context->begin = on_begin;
+    context->end = on_end;
+
+    if (path && strcmp(path, "-") != 0) {
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            perror(path);
+            return 1;
+        }
+        ret = convert_fd(context, fd, path);
+        close(fd);
+    } else {
+        ret = convert_fd(context, STDIN_FILENO, "<stdin>");
+    }
+
+    if (ret == 0)
+        put_char(c, '\n');
+    flush_out(c);
+    if (fflush(c->out) != 0 || c->write_failed) {
+        perror("write");
+        ret = 1;
+    }
+
+    lax_json_destroy(context);
+    free(c->first);
+    free(c);
+    return ret;
+}
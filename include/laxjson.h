@@ -8,6 +8,8 @@
 #ifndef LAXJSON_H_INCLUDED
 #define LAXJSON_H_INCLUDED
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -42,7 +44,9 @@ enum LaxJsonState {
     LaxJsonStateNumber,
     LaxJsonStateNumberDecimal,
     LaxJsonStateNumberExponent,
-    LaxJsonStateNumberExponentSign
+    LaxJsonStateNumberExponentSign,
+    LaxJsonStateSurrogateBackslash,
+    LaxJsonStateSurrogateU
 };
 
 enum LaxJsonError {
@@ -56,10 +60,63 @@ enum LaxJsonError {
     LaxJsonErrorInvalidUnicodePoint,
     LaxJsonErrorExpectedColon,
     LaxJsonErrorUnexpectedEof,
-    LaxJsonErrorAborted
+    LaxJsonErrorAborted,
+    LaxJsonErrorTypeMismatch,
+    LaxJsonErrorArrayTooLong,
+    LaxJsonErrorIo,
+    LaxJsonErrorInvalidCheckpoint,
+    LaxJsonErrorInvalidUtf8,
+    LaxJsonErrorInvalidIndex,
+    LaxJsonErrorNotFound,
+    LaxJsonErrorCompression
+};
+
+/* Longer property names are not interned */
+#define LAX_JSON_MAX_INTERNED_LENGTH 256
+
+/* The most numbers passed to number_array at once */
+#define LAX_JSON_NUMBER_BLOCK 256
+
+/* Describes the text of a number passed to raw_number */
+enum LaxJsonNumberFlags {
+    /* no fraction and no exponent */
+    LaxJsonNumberInteger = 1,
+    LaxJsonNumberFraction = 2,
+    LaxJsonNumberExponent = 4,
+    LaxJsonNumberNegative = 8
 };
 
-/* All callbacks must be provided. Return nonzero to abort the ongoing feed operation. */
+enum LaxJsonTokenKind {
+    /* everything passed to lax_json_input has been consumed */
+    LaxJsonTokenNeedInput,
+    /* type is array or object */
+    LaxJsonTokenBegin,
+    LaxJsonTokenEnd,
+    /* type is property or string */
+    LaxJsonTokenString,
+    LaxJsonTokenNumber,
+    /* type is true, false or null */
+    LaxJsonTokenPrimitive
+};
+
+struct LaxJsonToken {
+    enum LaxJsonTokenKind kind;
+    enum LaxJsonType type;
+    /* strings, properties and numbers. Strings are NUL terminated. Numbers
+     * are as passed to raw_number. Valid until the next call to
+     * lax_json_next, and for numbers as long as the input. */
+    const char *value;
+    int length;
+    /* numbers only: enum LaxJsonNumberFlags */
+    int flags;
+    /* as event_start and event_end */
+    int64_t start;
+    int64_t end;
+};
+
+/* All callbacks must be provided, except that raw_number and raw_string are
+ * optional, and number and string are unused while they are set. Return
+ * nonzero to abort the ongoing feed operation. */
 struct LaxJsonContext {
     void *userdata;
     /* type can be property or string */
@@ -76,14 +133,97 @@ struct LaxJsonContext {
     int line;
     int column;
 
+    /* in levels of nesting, each taking two bits */
     int max_state_stack_size;
     int max_value_buffer_size;
 
+    /* The members above keep the offsets they had in 1.0, so that programs
+     * built against it still work; new public members go below. */
+
+    /* NULL by default. When set, it is called instead of number with the text
+     * of the number as written, without a leading +, and a combination of
+     * enum LaxJsonNumberFlags. value points into the fed data when the whole
+     * number is in one feed call, so it is not NUL terminated. */
+    int (*raw_number)(struct LaxJsonContext *, const char *value, int length, int flags);
+    /* NULL by default. When set, it is called instead of string. value
+     * points into the fed data when a quoted string or property name is
+     * whole in one feed call and has no escapes, so it is not NUL
+     * terminated; others are copied to the value buffer as for string. */
+    int (*raw_string)(struct LaxJsonContext *, enum LaxJsonType type, const char *value, int length);
+    /* NULL by default. When set, numbers that are elements of an array are
+     * collected and passed here in blocks of up to LAX_JSON_NUMBER_BLOCK
+     * instead of to number or raw_number. A block is passed when it is full,
+     * before any other event and at the end of each lax_json_feed, so a run
+     * of numbers can arrive in several blocks. A feed that fails still passes
+     * the numbers before the error, as number would have seen them. During
+     * the call event_start and event_end span the numbers in the block.
+     * lax_json_next ignores it. */
+    int (*number_array)(struct LaxJsonContext *, const double *values, int count);
+    /* NULL by default. In record mode, when set, a record that fails to
+     * parse is reported here instead of failing lax_json_feed. line, column
+     * and offset locate the error, and event_start is the offset of the
+     * start of the record; events already delivered for the record are not
+     * taken back. The rest of the record is skipped and parsing goes on with
+     * the next one. Not called for LaxJsonErrorAborted or LaxJsonErrorNoMem,
+     * which still fail the feed. */
+    int (*error)(struct LaxJsonContext *, enum LaxJsonError err);
+    /* NULL by default. Called before an interned property name is evicted
+     * to make room for another, after which its id and pointer are reused. */
+    int (*key_evicted)(struct LaxJsonContext *, int id, const char *value, int length);
+
+    /* number of bytes consumed. During a callback, the offset just past the
+     * byte that triggered it. */
+    int64_t offset;
+    /* During a callback, the offsets of the first byte of the value and of
+     * the byte after its last. For begin and end that is the bracket, and
+     * for strings and properties it includes the quotes. */
+    int64_t event_start;
+    int64_t event_end;
+
+    /* set to nonzero to fail with LaxJsonErrorInvalidUtf8 on strings and
+     * properties that are not valid UTF-8, and with
+     * LaxJsonErrorInvalidUnicodePoint on escapes of unpaired surrogates */
+    int validate_utf8;
+    /* 0 by default, for a single document. Set to a byte such as '\n' to
+     * have lax_json_feed and lax_json_eof parse a sequence of records
+     * separated by that byte, each holding at most one value. The delimiter
+     * always ends a record, wherever it appears. Records with nothing but
+     * whitespace and comments are ignored. lax_json_next ignores it. */
+    int record_delimiter;
+    /* In record mode, the number of records parsed and the number that
+     * failed. Reset by lax_json_reset. Record mode state is not saved by
+     * lax_json_checkpoint. */
+    int64_t good_records;
+    int64_t bad_records;
+    /* 0 by default. Set before the first feed to keep up to this many
+     * property names interned, across documents and lax_json_reset. Names
+     * shorter than LAX_JSON_MAX_INTERNED_LENGTH are then passed to string
+     * and in tokens as a pointer to the interned copy, equal for equal
+     * names, valid until the name is evicted or the context destroyed. When
+     * the table is full, the least recently seen names are evicted first. */
+    int max_interned_keys;
+    /* While a property name is reported, the id of its interned copy, below
+     * max_interned_keys, or -1 if it is not interned. Not saved by
+     * lax_json_checkpoint. */
+    int key_id;
+    /* set to nonzero to compute content_hash */
+    int hash_content;
+    /* A 64 bit hash of the events so far: their kinds and types, the decoded
+     * text of strings and properties and the values of numbers. Comments,
+     * whitespace, quoting, escapes and the way a number is written do not
+     * change it. The contents of skipped containers are not included. */
+    uint64_t content_hash;
+
     /* private members */
     enum LaxJsonState state;
-    enum LaxJsonState *state_stack;
+    /* two bits per level: object, array, end, or the innermost of
+     * rare_states. Colon and value are only pushed around a comment or a
+     * quoted property name, so there are never more than a few. */
+    unsigned char *state_stack;
     int state_stack_index;
     int state_stack_size;
+    unsigned char rare_states[4];
+    int rare_state_count;
 
     char *value_buffer;
     int value_buffer_index;
@@ -91,18 +231,104 @@ struct LaxJsonContext {
 
     unsigned int unicode_point;
     unsigned int unicode_digit_index;
+    unsigned int unicode_high;
+    int utf8_state;
 
-    char *expected;
+    const char *expected;
+    int64_t value_start;
+    const char *input;
+    const char *input_end;
+    /* one more than the stack index of the container being skipped, or 0 */
+    int skip_index;
+    /* numbers not yet passed to number_array, always empty between feeds */
+    double *number_block;
+    int number_count;
+    int64_t number_block_start;
+    int64_t number_block_end;
+    struct LaxJsonInternTable *interned;
+    int64_t record_start;
+    /* skipping the rest of a record that failed */
+    char recovering;
+    char in_begin;
     char delim;
     enum LaxJsonType string_type;
 };
 
 struct LaxJsonContext *lax_json_create(void);
 void lax_json_destroy(struct LaxJsonContext *context);
+/* Prepares context to parse a new document, keeping its callbacks, userdata,
+ * limits and allocated buffers. */
+void lax_json_reset(struct LaxJsonContext *context);
 
 enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const char *data);
 enum LaxJsonError lax_json_eof(struct LaxJsonContext *context);
 
+/* from <sys/uio.h> */
+struct iovec;
+/* Feeds iovcnt segments in order, as one lax_json_feed call would feed them
+ * joined. A number that is inside one segment reaches raw_number pointing
+ * into it, and a quoted string or property name without escapes reaches
+ * raw_string the same way. Only those that straddle segments, and strings
+ * with escapes, are put together in the value buffer. Numbers for number_array are passed
+ * after the last segment, not at the end of each. */
+enum LaxJsonError lax_json_feedv(struct LaxJsonContext *context, const struct iovec *iov,
+        int iovcnt);
+
+/* Checks that data is one well formed document, as lax_json_feed followed by
+ * lax_json_eof would, without reporting or buffering any of it and without
+ * converting numbers. context may be NULL; otherwise it must be freshly
+ * created or reset, its max_state_stack_size and validate_utf8 apply, its
+ * callbacks are not used and its line and column describe the location of
+ * an error. Strings are not buffered, so max_value_buffer_size does not
+ * apply. */
+enum LaxJsonError lax_json_validate(struct LaxJsonContext *context, int size, const char *data);
+
+/* Skips the rest of the innermost array or object being read; from a begin
+ * callback or right after a begin token, that is the one just begun. Nothing
+ * inside it is reported or buffered, but its end is. Not saved by
+ * lax_json_checkpoint. */
+void lax_json_skip(struct LaxJsonContext *context);
+
+/* Pull interface, an alternative to callbacks that are then not used: give
+ * the next chunk of input to lax_json_input, then call lax_json_next until it
+ * returns a LaxJsonTokenNeedInput token. The input must stay valid until
+ * then. Call lax_json_eof after the last chunk. */
+void lax_json_input(struct LaxJsonContext *context, int size, const char *data);
+enum LaxJsonError lax_json_next(struct LaxJsonContext *context, struct LaxJsonToken *token);
+
+/* Feeds everything that can be read from fd. A reader thread fills a ring of
+ * queue_depth blocks of block_size bytes while the calling thread parses
+ * them in place, so reading and parsing overlap. 0 selects defaults for
+ * either size. Callbacks run on the calling thread. A parse error returns
+ * at once, even while the reader waits on a pipe or socket whose writer
+ * has stopped sending. Does not call lax_json_eof. */
+enum LaxJsonError lax_json_feed_fd(struct LaxJsonContext *context, int fd,
+        int block_size, int queue_depth);
+
+/* Parses the whole file at path, reading it on another thread as
+ * lax_json_feed_fd does, then calls lax_json_eof. Files compressed with gzip
+ * or zstd are recognized by their first bytes and decompressed block by
+ * block on the reading thread, straight into the blocks the parser reads.
+ * That needs the library to be built with zlib or libzstd; otherwise, and
+ * for corrupt or truncated data, it fails with LaxJsonErrorCompression. */
+enum LaxJsonError lax_json_parse_file(struct LaxJsonContext *context, const char *path);
+
+/* Serializes the state of a parse suspended between two feed calls into buf,
+ * so that it can be resumed later, possibly in another process, by feeding
+ * the input that follows. Returns the size of the checkpoint; like snprintf,
+ * nothing is written unless it fits in size bytes. Callbacks, userdata and
+ * limits are not part of the checkpoint. */
+int lax_json_checkpoint(const struct LaxJsonContext *context, char *buf, int size);
+/* Replaces the parse state of context with a checkpoint. The limits of
+ * context apply to the restored state. */
+enum LaxJsonError lax_json_restore(struct LaxJsonContext *context, const char *buf, int size);
+
+/* Convert the text passed to raw_number. to_int64 fails with
+ * LaxJsonErrorTypeMismatch when the number has a fraction or an exponent or
+ * does not fit. */
+enum LaxJsonError lax_json_number_to_double(const char *value, int length, double *out);
+enum LaxJsonError lax_json_number_to_int64(const char *value, int length, int64_t *out);
+
 const char *lax_json_str_err(enum LaxJsonError err);
 
 #ifdef __cplusplus
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef LAXJSON_HPP_INCLUDED
+#define LAXJSON_HPP_INCLUDED
+
+#include "laxjson.h"
+
+#include <climits>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+/* C++17 front end. Instead of function pointers, a handler object is called
+ * directly from a loop over lax_json_next, so its methods can be inlined.
+ * A handler provides:
+ *
+ *     on_begin(LaxJsonType type)     array or object
+ *     on_end(LaxJsonType type)
+ *     on_string(LaxJsonType type, std::string_view value)   property or string
+ *     on_number(double x)
+ *     on_primitive(LaxJsonType type) true, false or null
+ *
+ * and, optionally, on_raw_number(std::string_view value, int flags), which is
+ * then called instead of on_number as with raw_number in the C API. Methods
+ * return void, or a value that converts to true to abort. */
+namespace laxjson {
+
+/* Owns a LaxJsonContext. */
+class Context {
+public:
+    Context() : context_(lax_json_create()) {
+        if (!context_)
+            throw std::bad_alloc();
+    }
+    /* takes ownership */
+    explicit Context(LaxJsonContext *context) noexcept : context_(context) {}
+    Context(Context &&other) noexcept : context_(other.context_) {
+        other.context_ = nullptr;
+    }
+    Context &operator=(Context &&other) noexcept {
+        std::swap(context_, other.context_);
+        return *this;
+    }
+    Context(const Context &) = delete;
+    Context &operator=(const Context &) = delete;
+    ~Context() {
+        if (context_)
+            lax_json_destroy(context_);
+    }
+
+    LaxJsonContext *get() const noexcept { return context_; }
+    LaxJsonContext *operator->() const noexcept { return context_; }
+    LaxJsonContext *release() noexcept {
+        return std::exchange(context_, nullptr);
+    }
+
+private:
+    LaxJsonContext *context_;
+};
+
+namespace detail {
+
+template <class Handler, class = void>
+struct HasRawNumber : std::false_type {};
+
+template <class Handler>
+struct HasRawNumber<Handler, std::void_t<decltype(
+        std::declval<Handler &>().on_raw_number(std::string_view(), 0))>> : std::true_type {};
+
+template <class Call>
+inline bool aborted(Call &&call) {
+    if constexpr (std::is_void_v<decltype(call())>) {
+        call();
+        return false;
+    } else {
+        return static_cast<bool>(call());
+    }
+}
+
+template <class Handler>
+inline LaxJsonError emit(Handler &handler, const LaxJsonToken &token) {
+    std::string_view value(token.value, token.length);
+    bool stop = false;
+
+    switch (token.kind) {
+        case LaxJsonTokenBegin:
+            stop = aborted([&] { return handler.on_begin(token.type); });
+            break;
+        case LaxJsonTokenEnd:
+            stop = aborted([&] { return handler.on_end(token.type); });
+            break;
+        case LaxJsonTokenString:
+            stop = aborted([&] { return handler.on_string(token.type, value); });
+            break;
+        case LaxJsonTokenNumber:
+            if constexpr (HasRawNumber<Handler>::value) {
+                stop = aborted([&] { return handler.on_raw_number(value, token.flags); });
+            } else {
+                double x;
+                if (LaxJsonError err = lax_json_number_to_double(token.value, token.length, &x))
+                    return err;
+                stop = aborted([&] { return handler.on_number(x); });
+            }
+            break;
+        case LaxJsonTokenPrimitive:
+            stop = aborted([&] { return handler.on_primitive(token.type); });
+            break;
+        case LaxJsonTokenNeedInput:
+            break;
+    }
+    return stop ? LaxJsonErrorAborted : LaxJsonErrorNone;
+}
+
+} /* namespace detail */
+
+/* Like lax_json_feed. Handlers are only referenced, never copied, so they may
+ * be move-only and may be temporaries. */
+template <class Handler>
+LaxJsonError feed(Context &context, Handler &&handler, std::string_view data) {
+    LaxJsonToken token;
+    LaxJsonError err;
+    size_t chunk;
+
+    while (!data.empty()) {
+        chunk = data.size() < INT_MAX ? data.size() : INT_MAX;
+        lax_json_input(context.get(), static_cast<int>(chunk), data.data());
+        for (;;) {
+            if ((err = lax_json_next(context.get(), &token)))
+                return err;
+            if (token.kind == LaxJsonTokenNeedInput)
+                break;
+            if ((err = detail::emit(handler, token)))
+                return err;
+        }
+        data.remove_prefix(chunk);
+    }
+    return LaxJsonErrorNone;
+}
+
+/* Parses a complete document. The location of an error is in context. */
+template <class Handler>
+LaxJsonError parse(Context &context, Handler &&handler, std::string_view data) {
+    if (LaxJsonError err = feed(context, handler, data))
+        return err;
+    return lax_json_eof(context.get());
+}
+
+template <class Handler>
+LaxJsonError parse(Handler &&handler, std::string_view data) {
+    Context context;
+    return parse(context, handler, data);
+}
+
+} /* namespace laxjson */
+
+#endif /* LAXJSON_HPP_INCLUDED */
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef LAXJSON_BIND_H_INCLUDED
+#define LAXJSON_BIND_H_INCLUDED
+
+#include "laxjson.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/* Binds a document directly into C structs described by tables of fields,
+ * so that loading a typed config needs no callbacks of its own. */
+
+enum LaxJsonBindType {
+    /* int, from a number with no fractional part */
+    LaxJsonBindInt,
+    /* long long, from a number with no fractional part */
+    LaxJsonBindInt64,
+    /* double, from a number */
+    LaxJsonBindDouble,
+    /* int set to 0 or 1, from true or false */
+    LaxJsonBindBool,
+    /* char *, from a string. Points into the binder's arena. */
+    LaxJsonBindString,
+    /* nested struct described by `nested`, from an object */
+    LaxJsonBindStruct,
+    /* elements of `element_type`, from an array */
+    LaxJsonBindArray
+};
+
+struct LaxJsonBindStruct;
+
+struct LaxJsonBindField {
+    const char *key;
+    enum LaxJsonBindType type;
+    /* offset of the member in the containing struct */
+    size_t offset;
+    /* for struct fields and arrays of structs */
+    const struct LaxJsonBindStruct *nested;
+
+    /* array fields only. The element count is stored in the int member at
+     * count_offset. If capacity is nonzero the member at offset is an inline
+     * array of that many elements, otherwise it is a pointer which is set to
+     * storage allocated from the binder's arena. Arrays of arrays are not
+     * supported. */
+    enum LaxJsonBindType element_type;
+    size_t count_offset;
+    int capacity;
+
+    /* values used when the key is missing or null */
+    double default_number;
+    const char *default_string;
+};
+
+struct LaxJsonBindStruct {
+    size_t size;
+    int field_count;
+    const struct LaxJsonBindField *fields;
+};
+
+#define LAX_JSON_BIND_NUMBER(key, type, s, member, default_number) \
+    {key, type, offsetof(s, member), NULL, LaxJsonBindInt, 0, 0, default_number, NULL}
+#define LAX_JSON_BIND_STRING(key, s, member, default_string) \
+    {key, LaxJsonBindString, offsetof(s, member), NULL, LaxJsonBindInt, 0, 0, 0, default_string}
+#define LAX_JSON_BIND_STRUCT(key, s, member, nested) \
+    {key, LaxJsonBindStruct, offsetof(s, member), nested, LaxJsonBindInt, 0, 0, 0, NULL}
+#define LAX_JSON_BIND_ARRAY(key, element_type, nested, s, member, count_member, capacity) \
+    {key, LaxJsonBindArray, offsetof(s, member), nested, element_type, \
+        offsetof(s, count_member), capacity, 0, NULL}
+
+/* A descriptor compiled into key lookup tables. It is immutable once created
+ * and may be shared by any number of binders, including across threads. The
+ * descriptors must outlive it. */
+struct LaxJsonBindSchema;
+
+struct LaxJsonBinder {
+    /* line and column describe the location of an error */
+    struct LaxJsonContext *context;
+
+    /* private members */
+    const struct LaxJsonBindSchema *schema;
+    void *dest;
+    struct LaxJsonBindFrame *frames;
+    int frame_index;
+    int frame_size;
+    int skip_depth;
+    int pending;
+    struct LaxJsonBindArena *arena;
+    enum LaxJsonError error;
+};
+
+struct LaxJsonBindSchema *lax_json_bind_schema_create(const struct LaxJsonBindStruct *root);
+void lax_json_bind_schema_destroy(struct LaxJsonBindSchema *schema);
+
+/* Applies defaults to dest and prepares to fill it. The top level value must
+ * be an object. Unknown keys are skipped. Strings and arrays stay valid until
+ * the binder is destroyed. */
+struct LaxJsonBinder *lax_json_bind_create(const struct LaxJsonBindSchema *schema, void *dest);
+void lax_json_bind_destroy(struct LaxJsonBinder *binder);
+
+enum LaxJsonError lax_json_bind_feed(struct LaxJsonBinder *binder, int size, const char *data);
+enum LaxJsonError lax_json_bind_eof(struct LaxJsonBinder *binder);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LAXJSON_BIND_H_INCLUDED */
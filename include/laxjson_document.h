@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef LAXJSON_DOCUMENT_H_INCLUDED
+#define LAXJSON_DOCUMENT_H_INCLUDED
+
+#include "laxjson.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/* A parsed document stored as a flat tape of nodes in document order plus a
+ * pool of NUL terminated strings. Objects are followed by a property node
+ * and then a value for each member. The layout has no pointers, so it can be
+ * written to a file and mapped back in. */
+struct LaxJsonNode {
+    /* enum LaxJsonType */
+    uint32_t type;
+    /* strings and properties: length in bytes. arrays: number of elements.
+     * objects: number of members. */
+    uint32_t size;
+    union {
+        double number;
+        /* strings and properties: offset into the string pool */
+        uint64_t offset;
+        /* arrays and objects: index of the first node after the container */
+        uint64_t next;
+    } u;
+};
+
+struct LaxJsonDocument {
+    const struct LaxJsonNode *nodes;
+    size_t node_count;
+    const char *strings;
+    size_t strings_size;
+
+    /* private members */
+    struct LaxJsonNode *owned_nodes;
+    size_t node_size;
+    char *owned_strings;
+    size_t strings_capacity;
+    size_t *open;
+    int open_index;
+    int open_size;
+    void *map;
+    size_t map_size;
+};
+
+/* Parses a complete buffer into a document. context may be NULL; otherwise it
+ * must be freshly created or reset, its callbacks and userdata are replaced,
+ * and its line and column describe the location of an error. */
+enum LaxJsonError lax_json_document_parse(struct LaxJsonContext *context, int size,
+        const char *data, struct LaxJsonDocument **out);
+void lax_json_document_destroy(struct LaxJsonDocument *doc);
+
+const struct LaxJsonNode *lax_json_document_root(const struct LaxJsonDocument *doc);
+/* strings and properties only */
+const char *lax_json_node_string(const struct LaxJsonDocument *doc, const struct LaxJsonNode *node);
+/* The first element of an array or the first property of an object, or NULL
+ * if it is empty. The value of a property is the node right after it. */
+const struct LaxJsonNode *lax_json_node_child(const struct LaxJsonDocument *doc,
+        const struct LaxJsonNode *node);
+/* The node after node and everything it contains. For a property that is the
+ * next property, skipping over the value. Only call this size - 1 times on
+ * the children of a container. */
+const struct LaxJsonNode *lax_json_node_next(const struct LaxJsonDocument *doc,
+        const struct LaxJsonNode *node);
+/* The value of the member of object named key, or NULL. */
+const struct LaxJsonNode *lax_json_object_get(const struct LaxJsonDocument *doc,
+        const struct LaxJsonNode *object, const char *key);
+
+/* Loads the lax JSON file at path into a document, using the snapshot at
+ * cache_path instead of parsing when it still matches the file's path,
+ * size, modification time or content hash. A valid snapshot is mapped into
+ * memory and used in place. Otherwise the file is parsed and the snapshot is
+ * rewritten; failing to write it is not an error. */
+enum LaxJsonError lax_json_snapshot_load(const char *path, const char *cache_path,
+        struct LaxJsonDocument **out);
+
+struct LaxJsonLoadResult {
+    /* NULL on error, and always NULL when an init callback is given */
+    struct LaxJsonDocument *document;
+    enum LaxJsonError error;
+    /* location of a parse error */
+    int line;
+    int column;
+};
+
+/* Parses count files concurrently on a pool of threads, 0 meaning one per
+ * online processor. Each thread reuses one context for all of the files it
+ * parses. Results are stored in input order, one per path.
+ *
+ * Without init, each file is parsed into a document. With init, it is
+ * called on the worker thread before each file is parsed to set the
+ * callbacks and userdata of context for the file at index, and returning
+ * nonzero fails that file with LaxJsonErrorAborted. Callbacks run
+ * concurrently on different files.
+ *
+ * Returns an error only when out of memory. Files that fail to parse are
+ * reported in their results. */
+enum LaxJsonError lax_json_load_many(const char *const *paths, int count, int threads,
+        int (*init)(struct LaxJsonContext *context, int index, void *userdata), void *userdata,
+        struct LaxJsonLoadResult *results);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LAXJSON_DOCUMENT_H_INCLUDED */
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef LAXJSON_EXTRACT_H_INCLUDED
+#define LAXJSON_EXTRACT_H_INCLUDED
+
+#include "laxjson.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/* The most patterns one extractor can look for */
+#define LAX_JSON_EXTRACT_MAX_PATTERNS 64
+
+/* Reports only the values at the paths described by a list of patterns. A
+ * pattern is a list of segments separated by dots, each of which matches a
+ * property name, an array index when it is a number, or anything when it is
+ * *. For example "server.port" or "limits.*.max". Arrays and objects that no
+ * pattern can match inside are skipped without buffering their contents.
+ *
+ * A pattern without a * matches one value at most, and one with a * can only
+ * match inside the container its leading exact segments lead to. Once no
+ * pattern can match anything more, parsing stops: done is set and feeding
+ * more input does nothing. Duplicate properties after that are not seen. */
+struct LaxJsonExtractor {
+    void *userdata;
+    /* Called when a value matches patterns[pattern], once for each pattern it
+     * matches. The other callbacks then receive the value, including
+     * everything inside it for an array or object. Values inside a value that
+     * matched are not matched again, which is why patterns that could
+     * match them are rejected. */
+    int (*match)(struct LaxJsonExtractor *, int pattern);
+    int (*string)(struct LaxJsonExtractor *, enum LaxJsonType type, const char *value, int length);
+    int (*number)(struct LaxJsonExtractor *, double x);
+    int (*primitive)(struct LaxJsonExtractor *, enum LaxJsonType type);
+    int (*begin)(struct LaxJsonExtractor *, enum LaxJsonType type);
+    int (*end)(struct LaxJsonExtractor *, enum LaxJsonType type);
+
+    int done;
+    /* line and column describe the location of an error */
+    struct LaxJsonContext *context;
+
+    /* private members */
+    char *text;
+    struct LaxJsonExtractSegment *segments;
+    struct LaxJsonExtractPattern *patterns;
+    int pattern_count;
+    uint64_t all;
+    /* patterns without a wildcard */
+    uint64_t exact;
+    /* patterns that cannot match anything more */
+    uint64_t finished;
+    struct LaxJsonExtractFrame *frames;
+    int frame_index;
+    int frame_size;
+    /* nesting inside a value being reported */
+    int report_depth;
+    enum LaxJsonError error;
+};
+
+/* Returns NULL when out of memory, when there are more than
+ * LAX_JSON_EXTRACT_MAX_PATTERNS patterns, when one has an empty segment, or
+ * when one can match a value inside a value another matches, such as "a"
+ * and "a.b" or "*.b" and "a.b.c". The patterns are copied. */
+struct LaxJsonExtractor *lax_json_extract_create(const char *const *patterns, int count);
+void lax_json_extract_destroy(struct LaxJsonExtractor *extractor);
+
+enum LaxJsonError lax_json_extract_feed(struct LaxJsonExtractor *extractor, int size, const char *data);
+/* Succeeds without checking the rest of the document once done is set. */
+enum LaxJsonError lax_json_extract_eof(struct LaxJsonExtractor *extractor);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LAXJSON_EXTRACT_H_INCLUDED */
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef LAXJSON_INCREMENTAL_H_INCLUDED
+#define LAXJSON_INCREMENTAL_H_INCLUDED
+
+#include "laxjson.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+enum LaxJsonEventKind {
+    /* a string, property, number, true, false or null */
+    LaxJsonEventValue,
+    /* the start of an array or object */
+    LaxJsonEventBegin,
+    /* the end of an array or object */
+    LaxJsonEventEnd
+};
+
+struct LaxJsonEvent {
+    enum LaxJsonEventKind kind;
+    enum LaxJsonType type;
+    /* offset just past the byte that produced the event. For begin events
+     * that is the opening bracket. */
+    int64_t offset;
+    double number;
+    /* strings and properties, NUL terminated */
+    char *string;
+    int length;
+
+    /* private members */
+    /* begin events: the parser state at the opening bracket */
+    char *checkpoint;
+    int checkpoint_size;
+};
+
+struct LaxJsonIncremental;
+
+/* Keeps the events of a document and updates them after edits by reparsing
+ * only the innermost container that encloses the edited bytes. The whole
+ * document is reparsed when there is no such container or when the edit
+ * changes where that container ends. */
+struct LaxJsonIncremental {
+    void *userdata;
+    /* Optional. Called for each event of the document after a full parse,
+     * and only for the events of the reparsed container after an edit. */
+    int (*event)(struct LaxJsonIncremental *, const struct LaxJsonEvent *event);
+    /* Optional. Called when an update changes the events: removed_count
+     * events starting at index were replaced by added_count events. Events
+     * are compared by kind, type and value, not by offset. */
+    int (*diff)(struct LaxJsonIncremental *, int index,
+            const struct LaxJsonEvent *removed, int removed_count,
+            const struct LaxJsonEvent *added, int added_count);
+
+    /* the events of the current document. Empty after an error. */
+    struct LaxJsonEvent *events;
+    int event_count;
+    /* number of bytes parsed by the last update */
+    int parsed_size;
+
+    /* limits can be set here. line and column describe the location of an
+     * error. */
+    struct LaxJsonContext *context;
+
+    /* private members */
+    int event_size;
+    struct LaxJsonEvent *pending;
+    int pending_count;
+    int pending_size;
+    char *initial;
+    int initial_size;
+    int stop_index;
+    int stopped;
+};
+
+struct LaxJsonIncremental *lax_json_incremental_create(void);
+void lax_json_incremental_destroy(struct LaxJsonIncremental *inc);
+
+/* Parses a complete document, replacing the previous one. */
+enum LaxJsonError lax_json_incremental_parse(struct LaxJsonIncremental *inc,
+        int size, const char *data);
+/* Updates the events after the bytes [start, old_end) of the previous
+ * document were replaced with the bytes [start, new_end) of data, which
+ * holds the complete new document. */
+enum LaxJsonError lax_json_incremental_edit(struct LaxJsonIncremental *inc,
+        int size, const char *data, int start, int old_end, int new_end);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LAXJSON_INCREMENTAL_H_INCLUDED */
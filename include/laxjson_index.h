@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef LAXJSON_INDEX_H_INCLUDED
+#define LAXJSON_INDEX_H_INCLUDED
+
+#include "laxjson.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/* A sidecar file recording where the arrays and objects of a large document
+ * are, so that later queries only parse the part they ask for.
+ *
+ * Paths use the syntax of laxjson_extract.h: segments separated by dots, each
+ * a property name or an array index, with "" being the whole document. The
+ * index holds the byte range of every container of at least min_size bytes
+ * and of the root, keyed by path. In those arrays that have more than
+ * element_stride elements, the offset of every element_stride-th element is
+ * recorded too. A query finds the deepest indexed container on its path,
+ * starts at the nearest recorded element before the one asked for, and
+ * parses forward from there, skipping whatever cannot lead to the answer.
+ *
+ * Property names containing a dot cannot be queried. When a name repeats,
+ * the first one is found. */
+struct LaxJsonIndex {
+    /* the indexed document, mapped into memory */
+    const char *source;
+    size_t source_size;
+
+    /* private members */
+    void *source_map;
+    void *map;
+    size_t map_size;
+    const struct LaxJsonIndexHeader *header;
+    const struct LaxJsonIndexEntry *entries;
+    const uint64_t *samples;
+    const uint64_t *table;
+    const char *paths;
+};
+
+/* Parses the document at path once and writes its index to index_path. 0
+ * selects defaults for min_size and element_stride. context may be NULL;
+ * otherwise it must be freshly created or reset, its callbacks and userdata
+ * are replaced, and its line and column describe the location of an
+ * error. */
+enum LaxJsonError lax_json_index_build(struct LaxJsonContext *context, const char *path,
+        const char *index_path, int64_t min_size, int element_stride);
+
+/* Maps the document at path and its index. Fails with
+ * LaxJsonErrorInvalidIndex when the index is damaged or the document has
+ * changed size or modification time since it was built. */
+enum LaxJsonError lax_json_index_open(const char *path, const char *index_path,
+        struct LaxJsonIndex **out);
+void lax_json_index_close(struct LaxJsonIndex *index);
+
+/* Finds the byte range of the value at path in index->source. A * segment
+ * matches anything, and the first match is found. Fails with
+ * LaxJsonErrorNotFound when there is no such value. */
+enum LaxJsonError lax_json_index_find(const struct LaxJsonIndex *index, const char *path,
+        int64_t *start, int64_t *end);
+
+/* Finds the value at path and feeds only its bytes to context, followed by
+ * lax_json_eof. context must be freshly created or reset. Its offset starts
+ * at the start of the value, so event offsets are offsets into
+ * index->source; line and column are relative to the value. */
+enum LaxJsonError lax_json_index_parse(const struct LaxJsonIndex *index, const char *path,
+        struct LaxJsonContext *context);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LAXJSON_INDEX_H_INCLUDED */
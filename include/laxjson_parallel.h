@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef LAXJSON_PARALLEL_H_INCLUDED
+#define LAXJSON_PARALLEL_H_INCLUDED
+
+#include "laxjson.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/* One part of a document parsed on its own thread. During callbacks, the
+ * context's userdata points to the slice. */
+struct LaxJsonParallelSlice {
+    /* for the caller */
+    void *userdata;
+    /* position among the slices of this attempt, and their number */
+    int index;
+    int count;
+    /* the bytes of the document parsed by this slice */
+    size_t offset;
+    size_t size;
+    /* number of top level array elements that begin in this slice. During a
+     * callback, the current element is element_count - 1 within the slice;
+     * during number_array, the count numbers passed are the last count
+     * elements when they are top level ones. */
+    int64_t element_count;
+    /* index in the whole array of the first element of this slice. Only set
+     * once every slice is known to be correct. */
+    int64_t first_element;
+    /* location of an error. Only meaningful for the first slice. */
+    int line;
+    int column;
+
+    /* private members */
+    struct LaxJsonContext *context;
+    int (*string)(struct LaxJsonContext *, enum LaxJsonType type, const char *value, int length);
+    int (*number)(struct LaxJsonContext *, double x);
+    int (*raw_number)(struct LaxJsonContext *, const char *value, int length, int flags);
+    int (*raw_string)(struct LaxJsonContext *, enum LaxJsonType type, const char *value, int length);
+    int (*number_array)(struct LaxJsonContext *, const double *values, int count);
+    int (*primitive)(struct LaxJsonContext *, enum LaxJsonType type);
+    int (*begin)(struct LaxJsonContext *, enum LaxJsonType type);
+    int (*end)(struct LaxJsonContext *, enum LaxJsonType type);
+    int (*init)(struct LaxJsonContext *, struct LaxJsonParallelSlice *, void *);
+    void *init_userdata;
+    const char *data;
+    enum LaxJsonError error;
+    int boundary_ok;
+};
+
+/* Parses a document that is one large top level array using up to
+ * max_slices threads. The data is split at guessed positions, each moved
+ * forward to what looks like the start of an array element: a value after a
+ * comma that is not followed by a colon, outside of strings and line
+ * comments. Elements may be containers or scalars. Each slice is
+ * parsed by its own context. The guesses are confirmed afterwards by checking
+ * that every slice ended exactly between two top level elements, which is
+ * where the next one started.
+ *
+ * init is called on the worker thread to set the callbacks of context and
+ * may set slice->userdata. When a guess turns out to be wrong, or any slice
+ * fails, the whole document is parsed again on the calling thread as a
+ * single slice and init is called again with count set to 1. Events
+ * delivered to earlier slices must be discarded then.
+ *
+ * slices must have room for max_slices. On success *slice_count is the
+ * number used, and 1 when the document was parsed on the calling thread,
+ * because it was too small or had no usable split points or a guess was
+ * wrong. A failure's location is in slices[0]. */
+enum LaxJsonError lax_json_parse_parallel(size_t size, const char *data, int max_slices,
+        int (*init)(struct LaxJsonContext *context, struct LaxJsonParallelSlice *slice,
+            void *userdata),
+        void *userdata, struct LaxJsonParallelSlice *slices, int *slice_count);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LAXJSON_PARALLEL_H_INCLUDED */
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef LAXJSON_RELOAD_H_INCLUDED
+#define LAXJSON_RELOAD_H_INCLUDED
+
+#include "laxjson_document.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif /* __cplusplus */
+
+/* Keeps the document parsed from a file current while other threads read
+ * it. A background thread watches the file and parses it again whenever it
+ * is rewritten or replaced, then publishes the new document with an atomic
+ * pointer swap. Documents are never modified after they are published.
+ *
+ * Each reader thread registers a slot once. Between acquire and release the
+ * document returned by acquire stays valid, even if a newer one is
+ * published in the meantime. Acquire and release never lock or wait. An
+ * old document is freed by the background thread once no slot could still
+ * be using it, so a reader that holds on to a document delays only the
+ * freeing of old documents, never the publishing of new ones.
+ *
+ * The members are private. */
+struct LaxJsonReloader;
+
+/* Parses the file at path and starts watching it. max_readers is the number
+ * of slots that can be registered at once. context may be NULL; otherwise
+ * its line and column describe the location of an error in the first parse
+ * and it is not used afterwards.
+ *
+ * on_reload may be NULL. It is called on the background thread after each
+ * attempt to reload the file. On error the previous document stays current,
+ * and line and column locate a parse error. */
+enum LaxJsonError lax_json_reloader_create(struct LaxJsonContext *context, const char *path,
+        int max_readers,
+        void (*on_reload)(struct LaxJsonReloader *reloader, enum LaxJsonError err,
+            int line, int column, void *userdata),
+        void *userdata, struct LaxJsonReloader **out);
+/* Stops the background thread and frees every document. No slot may be
+ * between acquire and release. */
+void lax_json_reloader_destroy(struct LaxJsonReloader *reloader);
+
+/* Returns a free slot for the calling thread, or -1 if all max_readers are
+ * taken. */
+int lax_json_reloader_register(struct LaxJsonReloader *reloader);
+void lax_json_reloader_unregister(struct LaxJsonReloader *reloader, int slot);
+
+/* The current document. Calls on one slot must not nest. */
+const struct LaxJsonDocument *lax_json_reloader_acquire(struct LaxJsonReloader *reloader, int slot);
+void lax_json_reloader_release(struct LaxJsonReloader *reloader, int slot);
+
+/* Counts the documents published so far, starting at 1 for the first parse. */
+uint64_t lax_json_reloader_generation(struct LaxJsonReloader *reloader);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* LAXJSON_RELOAD_H_INCLUDED */
@@ -0,0 +1,556 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "laxjson_bind.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define ARENA_BLOCK_SIZE 16384
+
+union ArenaAlign {
+    long long i;
+    double d;
+    void *p;
+};
+
+struct LaxJsonBindArena {
+    struct LaxJsonBindArena *next;
+    size_t used;
+    size_t size;
+    union ArenaAlign data[1];
+};
+
+/* open addressing table from key to field index, built once per descriptor */
+struct LaxJsonBindLookup {
+    const struct LaxJsonBindStruct *desc;
+    unsigned int mask;
+    int *slots;
+    int *key_lengths;
+    struct LaxJsonBindLookup **nested;
+};
+
+struct LaxJsonBindSchema {
+    struct LaxJsonBindLookup **lookups;
+    int lookup_count;
+    int lookup_size;
+};
+
+enum FrameKind {
+    FrameStruct,
+    FrameArray
+};
+
+struct LaxJsonBindFrame {
+    enum FrameKind kind;
+    /* struct frames: the struct being filled. array frames: the struct which
+     * holds the array field. */
+    char *base;
+    /* struct frames: the struct's lookup. array frames: the element lookup. */
+    const struct LaxJsonBindLookup *lookup;
+    /* array frames only */
+    const struct LaxJsonBindField *field;
+    int capacity;
+};
+
+static unsigned int hash_key(const char *key, int length) {
+    unsigned int h = 2166136261u;
+    int i;
+    for (i = 0; i < length; i += 1) {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void destroy_lookup(struct LaxJsonBindLookup *lookup) {
+    free(lookup->slots);
+    free(lookup->key_lengths);
+    free(lookup->nested);
+    free(lookup);
+}
+
+static struct LaxJsonBindLookup *compile(struct LaxJsonBindSchema *schema,
+        const struct LaxJsonBindStruct *desc)
+{
+    struct LaxJsonBindLookup *lookup;
+    struct LaxJsonBindLookup **new_ptr;
+    const struct LaxJsonBindField *field;
+    unsigned int table_size = 4;
+    unsigned int slot;
+    int i;
+
+    /* descriptors may be shared or recursive */
+    for (i = 0; i < schema->lookup_count; i += 1) {
+        if (schema->lookups[i]->desc == desc)
+            return schema->lookups[i];
+    }
+
+    if (schema->lookup_count >= schema->lookup_size) {
+        schema->lookup_size += 16;
+        new_ptr = realloc(schema->lookups, schema->lookup_size * sizeof(struct LaxJsonBindLookup *));
+        if (!new_ptr)
+            return NULL;
+        schema->lookups = new_ptr;
+    }
+
+    lookup = calloc(1, sizeof(struct LaxJsonBindLookup));
+    if (!lookup)
+        return NULL;
+    schema->lookups[schema->lookup_count] = lookup;
+    schema->lookup_count += 1;
+
+    while (table_size < (unsigned int)desc->field_count * 2)
+        table_size *= 2;
+    lookup->desc = desc;
+    lookup->mask = table_size - 1;
+    lookup->slots = calloc(table_size, sizeof(int));
+    lookup->key_lengths = calloc(desc->field_count + 1, sizeof(int));
+    lookup->nested = calloc(desc->field_count + 1, sizeof(struct LaxJsonBindLookup *));
+    if (!lookup->slots || !lookup->key_lengths || !lookup->nested)
+        return NULL;
+
+    for (i = 0; i < desc->field_count; i += 1) {
+        field = &desc->fields[i];
+        lookup->key_lengths[i] = strlen(field->key);
+        slot = hash_key(field->key, lookup->key_lengths[i]) & lookup->mask;
+        while (lookup->slots[slot])
+            slot = (slot + 1) & lookup->mask;
+        lookup->slots[slot] = i + 1;
+    }
+
+    for (i = 0; i < desc->field_count; i += 1) {
+        field = &desc->fields[i];
+        if (field->type == LaxJsonBindStruct ||
+            (field->type == LaxJsonBindArray && field->element_type == LaxJsonBindStruct))
+        {
+            lookup->nested[i] = compile(schema, field->nested);
+            if (!lookup->nested[i])
+                return NULL;
+        }
+    }
+
+    return lookup;
+}
+
+struct LaxJsonBindSchema *lax_json_bind_schema_create(const struct LaxJsonBindStruct *root) {
+    struct LaxJsonBindSchema *schema = calloc(1, sizeof(struct LaxJsonBindSchema));
+
+    if (!schema)
+        return NULL;
+
+    if (!compile(schema, root)) {
+        lax_json_bind_schema_destroy(schema);
+        return NULL;
+    }
+
+    return schema;
+}
+
+void lax_json_bind_schema_destroy(struct LaxJsonBindSchema *schema) {
+    int i;
+    for (i = 0; i < schema->lookup_count; i += 1)
+        destroy_lookup(schema->lookups[i]);
+    free(schema->lookups);
+    free(schema);
+}
+
+static int find_field(const struct LaxJsonBindLookup *lookup, const char *key, int length) {
+    unsigned int slot = hash_key(key, length) & lookup->mask;
+    int index;
+
+    while ((index = lookup->slots[slot])) {
+        index -= 1;
+        if (lookup->key_lengths[index] == length &&
+            memcmp(lookup->desc->fields[index].key, key, length) == 0)
+        {
+            return index;
+        }
+        slot = (slot + 1) & lookup->mask;
+    }
+    return -1;
+}
+
+static void *arena_alloc(struct LaxJsonBinder *binder, size_t size) {
+    struct LaxJsonBindArena *block = binder->arena;
+    size_t block_size;
+    char *ptr;
+
+    size = (size + sizeof(union ArenaAlign) - 1) / sizeof(union ArenaAlign) * sizeof(union ArenaAlign);
+    if (!block || block->size - block->used < size) {
+        block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(offsetof(struct LaxJsonBindArena, data) + block_size);
+        if (!block)
+            return NULL;
+        block->next = binder->arena;
+        block->used = 0;
+        block->size = block_size;
+        binder->arena = block;
+    }
+    ptr = (char *)block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+static size_t element_size(const struct LaxJsonBindField *field) {
+    switch (field->element_type) {
+        case LaxJsonBindInt:
+        case LaxJsonBindBool:
+            return sizeof(int);
+        case LaxJsonBindInt64:
+            return sizeof(long long);
+        case LaxJsonBindDouble:
+            return sizeof(double);
+        case LaxJsonBindString:
+            return sizeof(char *);
+        case LaxJsonBindStruct:
+            return field->nested->size;
+        case LaxJsonBindArray:
+            break;
+    }
+    return 0;
+}
+
+static void apply_defaults(const struct LaxJsonBindStruct *desc, char *base) {
+    const struct LaxJsonBindField *field;
+    int i;
+
+    for (i = 0; i < desc->field_count; i += 1) {
+        field = &desc->fields[i];
+        switch (field->type) {
+            case LaxJsonBindInt:
+                *(int *)(base + field->offset) = (int)field->default_number;
+                break;
+            case LaxJsonBindInt64:
+                *(long long *)(base + field->offset) = (long long)field->default_number;
+                break;
+            case LaxJsonBindDouble:
+                *(double *)(base + field->offset) = field->default_number;
+                break;
+            case LaxJsonBindBool:
+                *(int *)(base + field->offset) = field->default_number != 0;
+                break;
+            case LaxJsonBindString:
+                *(const char **)(base + field->offset) = field->default_string;
+                break;
+            case LaxJsonBindStruct:
+                apply_defaults(field->nested, base + field->offset);
+                break;
+            case LaxJsonBindArray:
+                *(int *)(base + field->count_offset) = 0;
+                if (!field->capacity)
+                    *(void **)(base + field->offset) = NULL;
+                break;
+        }
+    }
+}
+
+static enum LaxJsonError push_frame(struct LaxJsonBinder *binder, enum FrameKind kind, char *base,
+        const struct LaxJsonBindLookup *lookup, const struct LaxJsonBindField *field)
+{
+    struct LaxJsonBindFrame *new_ptr;
+    struct LaxJsonBindFrame *frame;
+
+    if (binder->frame_index >= binder->frame_size) {
+        binder->frame_size += 32;
+        new_ptr = realloc(binder->frames, binder->frame_size * sizeof(struct LaxJsonBindFrame));
+        if (!new_ptr)
+            return LaxJsonErrorNoMem;
+        binder->frames = new_ptr;
+    }
+    frame = &binder->frames[binder->frame_index];
+    frame->kind = kind;
+    frame->base = base;
+    frame->lookup = lookup;
+    frame->field = field;
+    frame->capacity = 0;
+    binder->frame_index += 1;
+    return LaxJsonErrorNone;
+}
+
+/* Finds where the next value goes. Returns NULL when the value should be
+ * skipped, with binder->error set if that is because of an error. */
+static char *next_target(struct LaxJsonBinder *binder, enum LaxJsonBindType *type,
+        const struct LaxJsonBindLookup **nested, const struct LaxJsonBindField **field_out)
+{
+    struct LaxJsonBindFrame *frame;
+    const struct LaxJsonBindField *field;
+    size_t size;
+    int *count;
+    char **storage;
+    char *new_storage;
+    int new_capacity;
+
+    if (binder->frame_index == 0) {
+        binder->error = LaxJsonErrorTypeMismatch;
+        return NULL;
+    }
+
+    frame = &binder->frames[binder->frame_index - 1];
+    if (frame->kind == FrameStruct) {
+        if (binder->pending < 0)
+            return NULL;
+        field = &frame->lookup->desc->fields[binder->pending];
+        *type = field->type;
+        *nested = frame->lookup->nested[binder->pending];
+        *field_out = field;
+        binder->pending = -1;
+        return frame->base + field->offset;
+    }
+
+    field = frame->field;
+    size = element_size(field);
+    count = (int *)(frame->base + field->count_offset);
+    *type = field->element_type;
+    *nested = frame->lookup;
+    *field_out = field;
+    if (field->capacity) {
+        if (*count >= field->capacity) {
+            binder->error = LaxJsonErrorArrayTooLong;
+            return NULL;
+        }
+        *count += 1;
+        return frame->base + field->offset + size * (*count - 1);
+    }
+
+    storage = (char **)(frame->base + field->offset);
+    if (*count >= frame->capacity) {
+        new_capacity = frame->capacity ? frame->capacity * 2 : 8;
+        new_storage = arena_alloc(binder, size * new_capacity);
+        if (!new_storage) {
+            binder->error = LaxJsonErrorNoMem;
+            return NULL;
+        }
+        if (*count)
+            memcpy(new_storage, *storage, size * *count);
+        *storage = new_storage;
+        frame->capacity = new_capacity;
+    }
+    *count += 1;
+    return *storage + size * (*count - 1);
+}
+
+static int mismatch(struct LaxJsonBinder *binder) {
+    binder->error = LaxJsonErrorTypeMismatch;
+    return 1;
+}
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    struct LaxJsonBinder *binder = context->userdata;
+    struct LaxJsonBindFrame *frame;
+    const struct LaxJsonBindLookup *nested;
+    const struct LaxJsonBindField *field;
+    enum LaxJsonBindType bind_type;
+    char *target;
+    char *copy;
+
+    if (binder->skip_depth)
+        return 0;
+
+    if (type == LaxJsonTypeProperty) {
+        frame = &binder->frames[binder->frame_index - 1];
+        binder->pending = find_field(frame->lookup, value, length);
+        return 0;
+    }
+
+    if (!(target = next_target(binder, &bind_type, &nested, &field)))
+        return binder->error != LaxJsonErrorNone;
+    if (bind_type != LaxJsonBindString)
+        return mismatch(binder);
+    copy = arena_alloc(binder, length + 1);
+    if (!copy) {
+        binder->error = LaxJsonErrorNoMem;
+        return 1;
+    }
+    memcpy(copy, value, length + 1);
+    *(char **)target = copy;
+    return 0;
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    struct LaxJsonBinder *binder = context->userdata;
+    const struct LaxJsonBindLookup *nested;
+    const struct LaxJsonBindField *field;
+    enum LaxJsonBindType bind_type;
+    char *target;
+
+    if (binder->skip_depth)
+        return 0;
+
+    if (!(target = next_target(binder, &bind_type, &nested, &field)))
+        return binder->error != LaxJsonErrorNone;
+    switch (bind_type) {
+        case LaxJsonBindInt:
+            if (!(x >= INT_MIN && x <= INT_MAX) || x != (int)x)
+                return mismatch(binder);
+            *(int *)target = (int)x;
+            return 0;
+        case LaxJsonBindInt64:
+            if (!(x >= -9223372036854775808.0 && x < 9223372036854775808.0) ||
+                x != (long long)x)
+            {
+                return mismatch(binder);
+            }
+            *(long long *)target = (long long)x;
+            return 0;
+        case LaxJsonBindDouble:
+            *(double *)target = x;
+            return 0;
+        default:
+            return mismatch(binder);
+    }
+}
+
+static int on_primitive(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonBinder *binder = context->userdata;
+    const struct LaxJsonBindLookup *nested;
+    const struct LaxJsonBindField *field;
+    enum LaxJsonBindType bind_type;
+    struct LaxJsonBindFrame *frame;
+    char *target;
+
+    if (binder->skip_depth)
+        return 0;
+
+    if (!(target = next_target(binder, &bind_type, &nested, &field)))
+        return binder->error != LaxJsonErrorNone;
+
+    if (type == LaxJsonTypeNull) {
+        /* a null member keeps its default. a null element is zeroed, or
+         * defaulted if it is a struct. */
+        frame = &binder->frames[binder->frame_index - 1];
+        if (frame->kind == FrameArray) {
+            memset(target, 0, element_size(frame->field));
+            if (bind_type == LaxJsonBindStruct)
+                apply_defaults(nested->desc, target);
+        }
+        return 0;
+    }
+    if (bind_type != LaxJsonBindBool)
+        return mismatch(binder);
+    *(int *)target = (type == LaxJsonTypeTrue);
+    return 0;
+}
+
+static int on_begin(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonBinder *binder = context->userdata;
+    const struct LaxJsonBindLookup *nested;
+    const struct LaxJsonBindField *field;
+    enum LaxJsonBindType bind_type;
+    struct LaxJsonBindFrame *frame;
+    char *target;
+
+    if (binder->skip_depth) {
+        binder->skip_depth += 1;
+        return 0;
+    }
+
+    if (binder->frame_index == 0 && binder->pending == -2) {
+        /* the root object */
+        if (type != LaxJsonTypeObject)
+            return mismatch(binder);
+        binder->pending = -1;
+        binder->error = push_frame(binder, FrameStruct, binder->dest,
+                binder->schema->lookups[0], NULL);
+        return binder->error != LaxJsonErrorNone;
+    }
+
+    if (!(target = next_target(binder, &bind_type, &nested, &field))) {
+        if (binder->error)
+            return 1;
+        binder->skip_depth = 1;
+        return 0;
+    }
+
+    frame = &binder->frames[binder->frame_index - 1];
+    if (type == LaxJsonTypeObject) {
+        if (bind_type != LaxJsonBindStruct)
+            return mismatch(binder);
+        if (frame->kind == FrameArray)
+            apply_defaults(nested->desc, target);
+        binder->error = push_frame(binder, FrameStruct, target, nested, NULL);
+    } else {
+        if (bind_type != LaxJsonBindArray)
+            return mismatch(binder);
+        if (frame->kind == FrameArray)
+            return mismatch(binder);
+        *(int *)(frame->base + field->count_offset) = 0;
+        binder->error = push_frame(binder, FrameArray, frame->base, nested, field);
+    }
+    return binder->error != LaxJsonErrorNone;
+}
+
+static int on_end(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonBinder *binder = context->userdata;
+
+    if (binder->skip_depth) {
+        binder->skip_depth -= 1;
+        return 0;
+    }
+    binder->frame_index -= 1;
+    return 0;
+}
+
+struct LaxJsonBinder *lax_json_bind_create(const struct LaxJsonBindSchema *schema, void *dest) {
+    struct LaxJsonBinder *binder = calloc(1, sizeof(struct LaxJsonBinder));
+
+    if (!binder)
+        return NULL;
+
+    binder->context = lax_json_create();
+    if (!binder->context) {
+        lax_json_bind_destroy(binder);
+        return NULL;
+    }
+
+    binder->schema = schema;
+    binder->dest = dest;
+    /* -2 marks that the root object has not been seen yet */
+    binder->pending = -2;
+
+    binder->context->userdata = binder;
+    binder->context->string = on_string;
+    binder->context->number = on_number;
+    binder->context->primitive = on_primitive;
+    binder->context->begin = on_begin;
+    binder->context->end = on_end;
+
+    apply_defaults(schema->lookups[0]->desc, dest);
+
+    return binder;
+}
+
+void lax_json_bind_destroy(struct LaxJsonBinder *binder) {
+    struct LaxJsonBindArena *block;
+    struct LaxJsonBindArena *next;
+
+    for (block = binder->arena; block; block = next) {
+        next = block->next;
+        free(block);
+    }
+    if (binder->context)
+        lax_json_destroy(binder->context);
+    free(binder->frames);
+    free(binder);
+}
+
+enum LaxJsonError lax_json_bind_feed(struct LaxJsonBinder *binder, int size, const char *data) {
+    enum LaxJsonError err = lax_json_feed(binder->context, size, data);
+    if (err == LaxJsonErrorAborted && binder->error)
+        return binder->error;
+    return err;
+}
+
+enum LaxJsonError lax_json_bind_eof(struct LaxJsonBinder *binder) {
+    enum LaxJsonError err = lax_json_eof(binder->context);
+    if (err == LaxJsonErrorNone && binder->pending == -2)
+        return LaxJsonErrorUnexpectedEof;
+    return err;
+}
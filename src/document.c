@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "laxjson_document.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+static struct LaxJsonNode *add_node(struct LaxJsonDocument *doc, enum LaxJsonType type) {
+    struct LaxJsonNode *new_ptr;
+    struct LaxJsonNode *node;
+    struct LaxJsonNode *parent;
+
+    if (doc->node_count >= doc->node_size) {
+        doc->node_size = doc->node_size ? doc->node_size * 2 : 256;
+        new_ptr = realloc(doc->owned_nodes, doc->node_size * sizeof(struct LaxJsonNode));
+        if (!new_ptr)
+            return NULL;
+        doc->owned_nodes = new_ptr;
+        doc->nodes = new_ptr;
+    }
+
+    /* object members are counted by their property nodes */
+    if (doc->open_index > 0) {
+        parent = &doc->owned_nodes[doc->open[doc->open_index - 1]];
+        if ((parent->type == LaxJsonTypeArray) != (type == LaxJsonTypeProperty))
+            parent->size += 1;
+    }
+
+    node = &doc->owned_nodes[doc->node_count];
+    doc->node_count += 1;
+    node->type = type;
+    node->size = 0;
+    node->u.offset = 0;
+    return node;
+}
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    struct LaxJsonDocument *doc = context->userdata;
+    struct LaxJsonNode *node;
+    size_t capacity;
+    char *new_ptr;
+
+    if (!(node = add_node(doc, type)))
+        return 1;
+
+    if (doc->strings_size + length + 1 > doc->strings_capacity) {
+        capacity = doc->strings_capacity ? doc->strings_capacity * 2 : 4096;
+        while (capacity < doc->strings_size + length + 1)
+            capacity *= 2;
+        new_ptr = realloc(doc->owned_strings, capacity);
+        if (!new_ptr)
+            return 1;
+        doc->owned_strings = new_ptr;
+        doc->strings = new_ptr;
+        doc->strings_capacity = capacity;
+    }
+    memcpy(doc->owned_strings + doc->strings_size, value, length + 1);
+    node->size = length;
+    node->u.offset = doc->strings_size;
+    doc->strings_size += length + 1;
+    return 0;
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    struct LaxJsonNode *node = add_node(context->userdata, LaxJsonTypeNumber);
+    if (!node)
+        return 1;
+    node->u.number = x;
+    return 0;
+}
+
+static int on_primitive(struct LaxJsonContext *context, enum LaxJsonType type) {
+    return add_node(context->userdata, type) == NULL;
+}
+
+static int on_begin(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonDocument *doc = context->userdata;
+    size_t *new_ptr;
+
+    if (!add_node(doc, type))
+        return 1;
+    if (doc->open_index >= doc->open_size) {
+        doc->open_size += 64;
+        new_ptr = realloc(doc->open, doc->open_size * sizeof(size_t));
+        if (!new_ptr)
+            return 1;
+        doc->open = new_ptr;
+    }
+    doc->open[doc->open_index] = doc->node_count - 1;
+    doc->open_index += 1;
+    return 0;
+}
+
+static int on_end(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonDocument *doc = context->userdata;
+    doc->open_index -= 1;
+    doc->owned_nodes[doc->open[doc->open_index]].u.next = doc->node_count;
+    return 0;
+}
+
+enum LaxJsonError lax_json_document_parse(struct LaxJsonContext *context, int size,
+        const char *data, struct LaxJsonDocument **out)
+{
+    struct LaxJsonContext *own_context = NULL;
+    struct LaxJsonDocument *doc;
+    enum LaxJsonError err;
+
+    *out = NULL;
+    doc = calloc(1, sizeof(struct LaxJsonDocument));
+    if (!doc)
+        return LaxJsonErrorNoMem;
+
+    if (!context) {
+        context = own_context = lax_json_create();
+        if (!context) {
+            free(doc);
+            return LaxJsonErrorNoMem;
+        }
+    }
+
+    context->userdata = doc;
+    context->string = on_string;
+    context->number = on_number;
+    context->primitive = on_primitive;
+    context->begin = on_begin;
+    context->end = on_end;
+    /* these would take numbers and names away from on_number and
+     * on_string, or report errors, with userdata pointing at the document */
+    context->raw_number = NULL;
+    context->raw_string = NULL;
+    context->number_array = NULL;
+    context->error = NULL;
+    context->key_evicted = NULL;
+    /* one document, not a sequence of records */
+    context->record_delimiter = 0;
+
+    err = lax_json_feed(context, size, data);
+    /* callbacks only abort when they run out of memory */
+    if (err == LaxJsonErrorAborted)
+        err = LaxJsonErrorNoMem;
+    if (!err)
+        err = lax_json_eof(context);
+    if (!err && doc->node_count == 0)
+        err = LaxJsonErrorUnexpectedEof;
+
+    if (own_context)
+        lax_json_destroy(own_context);
+    free(doc->open);
+    doc->open = NULL;
+
+    if (err) {
+        lax_json_document_destroy(doc);
+        return err;
+    }
+    *out = doc;
+    return LaxJsonErrorNone;
+}
+
+void lax_json_document_destroy(struct LaxJsonDocument *doc) {
+    if (doc->map)
+        munmap(doc->map, doc->map_size);
+    free(doc->owned_nodes);
+    free(doc->owned_strings);
+    free(doc->open);
+    free(doc);
+}
+
+const struct LaxJsonNode *lax_json_document_root(const struct LaxJsonDocument *doc) {
+    return &doc->nodes[0];
+}
+
+const char *lax_json_node_string(const struct LaxJsonDocument *doc, const struct LaxJsonNode *node) {
+    return doc->strings + node->u.offset;
+}
+
+const struct LaxJsonNode *lax_json_node_child(const struct LaxJsonDocument *doc,
+        const struct LaxJsonNode *node)
+{
+    return node->size ? node + 1 : NULL;
+}
+
+const struct LaxJsonNode *lax_json_node_next(const struct LaxJsonDocument *doc,
+        const struct LaxJsonNode *node)
+{
+    if (node->type == LaxJsonTypeProperty)
+        node += 1;
+    if (node->type == LaxJsonTypeObject || node->type == LaxJsonTypeArray)
+        return &doc->nodes[node->u.next];
+    return node + 1;
+}
+
+const struct LaxJsonNode *lax_json_object_get(const struct LaxJsonDocument *doc,
+        const struct LaxJsonNode *object, const char *key)
+{
+    const struct LaxJsonNode *property = lax_json_node_child(doc, object);
+    size_t length = strlen(key);
+    uint32_t i;
+
+    for (i = 0; i < object->size; i += 1) {
+        if (property->size == length &&
+            memcmp(lax_json_node_string(doc, property), key, length) == 0)
+        {
+            return property + 1;
+        }
+        if (i + 1 < object->size)
+            property = lax_json_node_next(doc, property);
+    }
+    return NULL;
+}
@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "laxjson_extract.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct LaxJsonExtractSegment {
+    /* points into the extractor's copy of the patterns */
+    const char *name;
+    int length;
+    /* the array index this segment matches, or -1 */
+    long index;
+    int wildcard;
+};
+
+struct LaxJsonExtractPattern {
+    int first_segment;
+    int segment_count;
+    /* number of segments before the first wildcard */
+    int exact_count;
+};
+
+/* An open array or object that some pattern can still match inside */
+struct LaxJsonExtractFrame {
+    /* patterns that match the path down to this container */
+    uint64_t alive;
+    /* objects: patterns that match the value of the current property */
+    uint64_t pending;
+    /* arrays: index of the next element. objects: -1 */
+    long next_index;
+};
+
+static int lowest_bit(uint64_t mask) {
+    int i = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        i += 1;
+    }
+    return i;
+}
+
+static const struct LaxJsonExtractSegment *segment_at(const struct LaxJsonExtractor *extractor,
+        int pattern, int depth)
+{
+    return &extractor->segments[extractor->patterns[pattern].first_segment + depth];
+}
+
+/* Whether some property name or array index matches both segments */
+static int segments_overlap(const struct LaxJsonExtractSegment *a, const struct LaxJsonExtractSegment *b) {
+    return a->wildcard || b->wildcard || (a->index >= 0 && a->index == b->index) ||
+        (a->length == b->length && memcmp(a->name, b->name, a->length) == 0);
+}
+
+/* Whether pattern b can match a value inside one that pattern a matches.
+ * Such values are reported as part of the outer one, so b could never
+ * match them itself. */
+static int pattern_contains(const struct LaxJsonExtractor *extractor, int a, int b) {
+    int i;
+
+    if (extractor->patterns[a].segment_count >= extractor->patterns[b].segment_count)
+        return 0;
+    for (i = 0; i < extractor->patterns[a].segment_count; i += 1) {
+        if (!segments_overlap(segment_at(extractor, a, i), segment_at(extractor, b, i)))
+            return 0;
+    }
+    return 1;
+}
+
+/* Of the patterns in mask, those whose segment at depth matches the element
+ * at index, or the property name when index is -1. */
+static uint64_t match_segment(const struct LaxJsonExtractor *extractor, uint64_t mask, int depth,
+        long index, const char *name, int length)
+{
+    const struct LaxJsonExtractSegment *segment;
+    uint64_t result = 0;
+    uint64_t rest;
+    int i;
+
+    for (rest = mask; rest; rest &= rest - 1) {
+        i = lowest_bit(rest);
+        segment = segment_at(extractor, i, depth);
+        if (segment->wildcard ||
+            (index >= 0 && segment->index == index) ||
+            (index < 0 && segment->length == length && memcmp(segment->name, name, length) == 0))
+        {
+            result |= (uint64_t)1 << i;
+        }
+    }
+    return result;
+}
+
+/* Finds the patterns that match the value starting now. Those that end at it
+ * are stored in *complete and the ones that continue inside it returned. */
+static uint64_t start_value(struct LaxJsonExtractor *extractor, uint64_t *complete) {
+    struct LaxJsonExtractFrame *parent;
+    uint64_t mask;
+    uint64_t rest;
+    int depth;
+    int i;
+
+    *complete = 0;
+    if (extractor->frame_index == 0) {
+        /* the root itself is not matched */
+        return extractor->all;
+    }
+
+    parent = &extractor->frames[extractor->frame_index - 1];
+    depth = extractor->frame_index - 1;
+    if (parent->next_index >= 0) {
+        mask = match_segment(extractor, parent->alive, depth, parent->next_index, NULL, 0);
+        parent->next_index += 1;
+    } else {
+        mask = parent->pending;
+        parent->pending = 0;
+    }
+    mask &= ~extractor->finished;
+
+    for (rest = mask; rest; rest &= rest - 1) {
+        i = lowest_bit(rest);
+        if (extractor->patterns[i].segment_count == depth + 1)
+            *complete |= (uint64_t)1 << i;
+    }
+    return mask & ~*complete;
+}
+
+/* Calls match for each pattern in complete. Returns nonzero to abort. */
+static int report(struct LaxJsonExtractor *extractor, uint64_t complete) {
+    uint64_t rest;
+
+    /* a path without a wildcard leads to one value at most */
+    extractor->finished |= complete & extractor->exact;
+    for (rest = complete; rest; rest &= rest - 1) {
+        if (extractor->match(extractor, lowest_bit(rest)))
+            return 1;
+    }
+    return 0;
+}
+
+/* Aborts the parse once no pattern can match anything more. */
+static int check_done(struct LaxJsonExtractor *extractor) {
+    if (extractor->finished == extractor->all) {
+        extractor->done = 1;
+        return 1;
+    }
+    /* nothing more to find in the rest of the container being read */
+    if (extractor->frame_index > 0 &&
+        !(extractor->frames[extractor->frame_index - 1].alive & ~extractor->finished))
+    {
+        lax_json_skip(extractor->context);
+    }
+    return 0;
+}
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    struct LaxJsonExtractor *extractor = context->userdata;
+    struct LaxJsonExtractFrame *frame;
+    uint64_t complete;
+
+    if (extractor->report_depth)
+        return extractor->string(extractor, type, value, length);
+
+    if (type == LaxJsonTypeProperty) {
+        frame = &extractor->frames[extractor->frame_index - 1];
+        frame->pending = match_segment(extractor, frame->alive, extractor->frame_index - 1,
+                -1, value, length);
+        return 0;
+    }
+    start_value(extractor, &complete);
+    if (!complete)
+        return 0;
+    if (report(extractor, complete) || extractor->string(extractor, type, value, length))
+        return 1;
+    return check_done(extractor);
+}
+
+static int on_raw_number(struct LaxJsonContext *context, const char *value, int length, int flags) {
+    struct LaxJsonExtractor *extractor = context->userdata;
+    uint64_t complete = 0;
+    double x;
+
+    if (!extractor->report_depth) {
+        start_value(extractor, &complete);
+        if (!complete)
+            return 0;
+        if (report(extractor, complete))
+            return 1;
+    }
+    if ((extractor->error = lax_json_number_to_double(value, length, &x)))
+        return 1;
+    if (extractor->number(extractor, x))
+        return 1;
+    return complete ? check_done(extractor) : 0;
+}
+
+static int on_primitive(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonExtractor *extractor = context->userdata;
+    uint64_t complete;
+
+    if (extractor->report_depth)
+        return extractor->primitive(extractor, type);
+
+    start_value(extractor, &complete);
+    if (!complete)
+        return 0;
+    if (report(extractor, complete) || extractor->primitive(extractor, type))
+        return 1;
+    return check_done(extractor);
+}
+
+static int on_begin(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonExtractor *extractor = context->userdata;
+    struct LaxJsonExtractFrame *new_ptr;
+    struct LaxJsonExtractFrame *frame;
+    uint64_t complete;
+    uint64_t partial;
+
+    if (extractor->report_depth) {
+        extractor->report_depth += 1;
+        return extractor->begin(extractor, type);
+    }
+
+    partial = start_value(extractor, &complete);
+    if (complete) {
+        extractor->report_depth = 1;
+        return report(extractor, complete) || extractor->begin(extractor, type);
+    }
+
+    if (extractor->frame_index >= extractor->frame_size) {
+        extractor->frame_size += 64;
+        new_ptr = realloc(extractor->frames, extractor->frame_size * sizeof(struct LaxJsonExtractFrame));
+        if (!new_ptr) {
+            extractor->error = LaxJsonErrorNoMem;
+            return 1;
+        }
+        extractor->frames = new_ptr;
+    }
+    frame = &extractor->frames[extractor->frame_index];
+    extractor->frame_index += 1;
+    frame->alive = partial;
+    frame->pending = 0;
+    frame->next_index = type == LaxJsonTypeArray ? 0 : -1;
+    /* nothing inside can match, so only its end is needed */
+    if (!partial)
+        lax_json_skip(context);
+    return 0;
+}
+
+static int on_end(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonExtractor *extractor = context->userdata;
+    struct LaxJsonExtractFrame *frame;
+    uint64_t rest;
+    int i;
+
+    if (extractor->report_depth) {
+        extractor->report_depth -= 1;
+        if (extractor->end(extractor, type))
+            return 1;
+        return extractor->report_depth ? 0 : check_done(extractor);
+    }
+    /* patterns whose path up to here has no wildcard cannot match outside
+     * this container */
+    extractor->frame_index -= 1;
+    frame = &extractor->frames[extractor->frame_index];
+    for (rest = frame->alive & ~extractor->finished; rest; rest &= rest - 1) {
+        i = lowest_bit(rest);
+        if (extractor->patterns[i].exact_count >= extractor->frame_index)
+            extractor->finished |= (uint64_t)1 << i;
+    }
+    return check_done(extractor);
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    /* numbers go through on_raw_number */
+    return 1;
+}
+
+struct LaxJsonExtractor *lax_json_extract_create(const char *const *patterns, int count) {
+    struct LaxJsonExtractor *extractor;
+    struct LaxJsonExtractSegment *segment;
+    size_t text_size = 0;
+    int segment_count = 0;
+    const char *p;
+    char *text;
+    char *dot;
+    int i;
+
+    if (count < 0 || count > LAX_JSON_EXTRACT_MAX_PATTERNS)
+        return NULL;
+    for (i = 0; i < count; i += 1) {
+        text_size += strlen(patterns[i]) + 1;
+        segment_count += 1;
+        for (p = patterns[i]; (p = strchr(p, '.')); p += 1)
+            segment_count += 1;
+    }
+
+    extractor = calloc(1, sizeof(struct LaxJsonExtractor));
+    if (!extractor)
+        return NULL;
+    extractor->text = malloc(text_size ? text_size : 1);
+    extractor->segments = malloc((segment_count ? segment_count : 1) * sizeof(struct LaxJsonExtractSegment));
+    extractor->patterns = malloc((count ? count : 1) * sizeof(struct LaxJsonExtractPattern));
+    extractor->context = lax_json_create();
+    if (!extractor->text || !extractor->segments || !extractor->patterns || !extractor->context) {
+        lax_json_extract_destroy(extractor);
+        return NULL;
+    }
+
+    text = extractor->text;
+    segment = extractor->segments;
+    for (i = 0; i < count; i += 1) {
+        strcpy(text, patterns[i]);
+        extractor->patterns[i].first_segment = segment - extractor->segments;
+        extractor->patterns[i].segment_count = 0;
+        extractor->exact |= (uint64_t)1 << i;
+        extractor->patterns[i].exact_count = -1;
+        for (;;) {
+            dot = strchr(text, '.');
+            segment->name = text;
+            segment->length = dot ? dot - text : (int)strlen(text);
+            if (segment->length == 0) {
+                lax_json_extract_destroy(extractor);
+                return NULL;
+            }
+            segment->wildcard = segment->length == 1 && text[0] == '*';
+            segment->index = segment->length < 10 &&
+                strspn(text, "0123456789") >= (size_t)segment->length ? atol(text) : -1;
+            if (segment->wildcard && extractor->patterns[i].exact_count < 0) {
+                extractor->exact &= ~((uint64_t)1 << i);
+                extractor->patterns[i].exact_count = extractor->patterns[i].segment_count;
+            }
+            extractor->patterns[i].segment_count += 1;
+            segment += 1;
+            text += segment[-1].length + 1;
+            if (!dot)
+                break;
+        }
+        if (extractor->patterns[i].exact_count < 0)
+            extractor->patterns[i].exact_count = extractor->patterns[i].segment_count;
+    }
+    for (i = 0; i < count * count; i += 1) {
+        if (pattern_contains(extractor, i / count, i % count)) {
+            lax_json_extract_destroy(extractor);
+            return NULL;
+        }
+    }
+    extractor->pattern_count = count;
+    extractor->all = count == 64 ? ~(uint64_t)0 : ((uint64_t)1 << count) - 1;
+
+    extractor->context->userdata = extractor;
+    extractor->context->string = on_string;
+    extractor->context->number = on_number;
+    extractor->context->raw_number = on_raw_number;
+    extractor->context->primitive = on_primitive;
+    extractor->context->begin = on_begin;
+    extractor->context->end = on_end;
+
+    return extractor;
+}
+
+void lax_json_extract_destroy(struct LaxJsonExtractor *extractor) {
+    if (extractor->context)
+        lax_json_destroy(extractor->context);
+    free(extractor->text);
+    free(extractor->segments);
+    free(extractor->patterns);
+    free(extractor->frames);
+    free(extractor);
+}
+
+enum LaxJsonError lax_json_extract_feed(struct LaxJsonExtractor *extractor, int size, const char *data) {
+    enum LaxJsonError err;
+
+    if (extractor->done)
+        return LaxJsonErrorNone;
+    err = lax_json_feed(extractor->context, size, data);
+    if (err == LaxJsonErrorAborted && extractor->done)
+        return LaxJsonErrorNone;
+    if (err == LaxJsonErrorAborted && extractor->error)
+        return extractor->error;
+    return err;
+}
+
+enum LaxJsonError lax_json_extract_eof(struct LaxJsonExtractor *extractor) {
+    if (extractor->done)
+        return LaxJsonErrorNone;
+    return lax_json_eof(extractor->context);
+}
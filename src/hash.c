@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "laxjson_internal.h"
+
+#include <string.h>
+
+#define PRIME1 0x9e3779b185ebca87ULL
+#define PRIME2 0xc2b2ae3d27d4eb4fULL
+#define PRIME3 0x165667b19e3779f9ULL
+
+static uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t mix(uint64_t h, uint64_t word) {
+    word *= PRIME2;
+    word = rotl(word, 31);
+    word *= PRIME1;
+    h ^= word;
+    return rotl(h, 27) * PRIME1 + PRIME3;
+}
+
+uint64_t lax_json_hash64(uint64_t seed, const void *data, size_t size) {
+    const unsigned char *p = data;
+    const unsigned char *end = p + size;
+    uint64_t h = seed ^ (size * PRIME3);
+    uint64_t a, b, c, d;
+    uint64_t word;
+
+    /* four independent lanes keep the multiplier busy on long inputs */
+    if (size >= 32) {
+        a = h + PRIME1;
+        b = h + PRIME2;
+        c = h;
+        d = h - PRIME1;
+        for (; end - p >= 32; p += 32) {
+            memcpy(&word, p, 8);
+            a = mix(a, word);
+            memcpy(&word, p + 8, 8);
+            b = mix(b, word);
+            memcpy(&word, p + 16, 8);
+            c = mix(c, word);
+            memcpy(&word, p + 24, 8);
+            d = mix(d, word);
+        }
+        h = rotl(a, 1) + rotl(b, 7) + rotl(c, 12) + rotl(d, 18);
+    }
+    for (; end - p >= 8; p += 8) {
+        memcpy(&word, p, 8);
+        h = mix(h, word);
+    }
+    for (word = 0; p < end; p += 1)
+        word = (word << 8) | *p;
+    h = mix(h, word);
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "laxjson_incremental.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void free_events(struct LaxJsonEvent *events, int count) {
+    int i;
+    for (i = 0; i < count; i += 1) {
+        free(events[i].string);
+        free(events[i].checkpoint);
+    }
+}
+
+static struct LaxJsonEvent *add_event(struct LaxJsonContext *context,
+        enum LaxJsonEventKind kind, enum LaxJsonType type)
+{
+    struct LaxJsonIncremental *inc = context->userdata;
+    struct LaxJsonEvent *new_ptr;
+    struct LaxJsonEvent *event;
+
+    if (inc->pending_count >= inc->pending_size) {
+        inc->pending_size = inc->pending_size ? inc->pending_size * 2 : 256;
+        new_ptr = realloc(inc->pending, inc->pending_size * sizeof(struct LaxJsonEvent));
+        if (!new_ptr)
+            return NULL;
+        inc->pending = new_ptr;
+    }
+    event = &inc->pending[inc->pending_count];
+    inc->pending_count += 1;
+    memset(event, 0, sizeof(struct LaxJsonEvent));
+    event->kind = kind;
+    event->type = type;
+    event->offset = context->offset;
+    return event;
+}
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    struct LaxJsonEvent *event = add_event(context, LaxJsonEventValue, type);
+    if (!event)
+        return 1;
+    event->string = malloc(length + 1);
+    if (!event->string)
+        return 1;
+    memcpy(event->string, value, length + 1);
+    event->length = length;
+    return 0;
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    struct LaxJsonEvent *event = add_event(context, LaxJsonEventValue, LaxJsonTypeNumber);
+    if (!event)
+        return 1;
+    event->number = x;
+    return 0;
+}
+
+static int on_primitive(struct LaxJsonContext *context, enum LaxJsonType type) {
+    return add_event(context, LaxJsonEventValue, type) == NULL;
+}
+
+/* The state is still that of the value being read, so restoring the
+ * checkpoint and feeding from the bracket reparses the container. */
+static int on_begin(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonEvent *event = add_event(context, LaxJsonEventBegin, type);
+    if (!event)
+        return 1;
+    event->checkpoint_size = lax_json_checkpoint(context, NULL, 0);
+    event->checkpoint = malloc(event->checkpoint_size);
+    if (!event->checkpoint)
+        return 1;
+    lax_json_checkpoint(context, event->checkpoint, event->checkpoint_size);
+    return 0;
+}
+
+static int on_end(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonIncremental *inc = context->userdata;
+    if (!add_event(context, LaxJsonEventEnd, type))
+        return 1;
+    /* the container being reparsed is closed at the depth it was opened */
+    if (context->state_stack_index == inc->stop_index) {
+        inc->stopped = 1;
+        return 1;
+    }
+    return 0;
+}
+
+struct LaxJsonIncremental *lax_json_incremental_create(void) {
+    struct LaxJsonIncremental *inc = calloc(1, sizeof(struct LaxJsonIncremental));
+
+    if (!inc)
+        return NULL;
+
+    inc->context = lax_json_create();
+    if (!inc->context) {
+        lax_json_incremental_destroy(inc);
+        return NULL;
+    }
+    inc->context->userdata = inc;
+    inc->context->string = on_string;
+    inc->context->number = on_number;
+    inc->context->primitive = on_primitive;
+    inc->context->begin = on_begin;
+    inc->context->end = on_end;
+
+    /* restoring this puts the context back at the start of a document */
+    inc->initial_size = lax_json_checkpoint(inc->context, NULL, 0);
+    inc->initial = malloc(inc->initial_size);
+    if (!inc->initial) {
+        lax_json_incremental_destroy(inc);
+        return NULL;
+    }
+    lax_json_checkpoint(inc->context, inc->initial, inc->initial_size);
+    inc->stop_index = -1;
+    return inc;
+}
+
+void lax_json_incremental_destroy(struct LaxJsonIncremental *inc) {
+    free_events(inc->events, inc->event_count);
+    free_events(inc->pending, inc->pending_count);
+    free(inc->events);
+    free(inc->pending);
+    free(inc->initial);
+    if (inc->context)
+        lax_json_destroy(inc->context);
+    free(inc);
+}
+
+static int events_equal(const struct LaxJsonEvent *a, const struct LaxJsonEvent *b) {
+    return a->kind == b->kind && a->type == b->type && a->number == b->number &&
+        a->length == b->length && (!a->string || memcmp(a->string, b->string, a->length) == 0);
+}
+
+static void discard(struct LaxJsonIncremental *inc) {
+    free_events(inc->events, inc->event_count);
+    inc->event_count = 0;
+    free_events(inc->pending, inc->pending_count);
+    inc->pending_count = 0;
+}
+
+/* Replaces remove_count events at index with the pending events, shifting the
+ * offsets of the events after them by delta. */
+static enum LaxJsonError commit(struct LaxJsonIncremental *inc, int index, int remove_count,
+        int64_t delta)
+{
+    struct LaxJsonEvent *removed = &inc->events[index];
+    struct LaxJsonEvent *new_ptr;
+    int count = inc->event_count - remove_count + inc->pending_count;
+    int tail = inc->event_count - index - remove_count;
+    int aborted = 0;
+    int prefix = 0;
+    int suffix = 0;
+    int i;
+
+    if (inc->event) {
+        for (i = 0; i < inc->pending_count && !aborted; i += 1)
+            aborted = inc->event(inc, &inc->pending[i]);
+    }
+
+    while (prefix < remove_count && prefix < inc->pending_count &&
+            events_equal(&removed[prefix], &inc->pending[prefix]))
+    {
+        prefix += 1;
+    }
+    while (suffix < remove_count - prefix && suffix < inc->pending_count - prefix &&
+            events_equal(&removed[remove_count - 1 - suffix],
+                &inc->pending[inc->pending_count - 1 - suffix]))
+    {
+        suffix += 1;
+    }
+    if (inc->diff && !aborted && (remove_count != prefix + suffix ||
+            inc->pending_count != prefix + suffix))
+    {
+        aborted = inc->diff(inc, index + prefix, removed + prefix, remove_count - prefix - suffix,
+                inc->pending + prefix, inc->pending_count - prefix - suffix);
+    }
+
+    free_events(removed, remove_count);
+    if (count > inc->event_size) {
+        new_ptr = realloc(inc->events, count * sizeof(struct LaxJsonEvent));
+        if (!new_ptr) {
+            /* the removed events are already gone, so start over */
+            memmove(removed, removed + remove_count, tail * sizeof(struct LaxJsonEvent));
+            inc->event_count -= remove_count;
+            discard(inc);
+            return LaxJsonErrorNoMem;
+        }
+        inc->events = new_ptr;
+        inc->event_size = count;
+        removed = &inc->events[index];
+    }
+    memmove(removed + inc->pending_count, removed + remove_count,
+            tail * sizeof(struct LaxJsonEvent));
+    memcpy(removed, inc->pending, inc->pending_count * sizeof(struct LaxJsonEvent));
+    for (i = index + inc->pending_count; i < count; i += 1)
+        inc->events[i].offset += delta;
+    inc->event_count = count;
+    inc->pending_count = 0;
+    return aborted ? LaxJsonErrorAborted : LaxJsonErrorNone;
+}
+
+enum LaxJsonError lax_json_incremental_parse(struct LaxJsonIncremental *inc,
+        int size, const char *data)
+{
+    enum LaxJsonError err;
+
+    free_events(inc->pending, inc->pending_count);
+    inc->pending_count = 0;
+    inc->stop_index = -1;
+    inc->parsed_size = size;
+
+    err = lax_json_restore(inc->context, inc->initial, inc->initial_size);
+    if (!err)
+        err = lax_json_feed(inc->context, size, data);
+    /* callbacks only abort when they run out of memory */
+    if (err == LaxJsonErrorAborted)
+        err = LaxJsonErrorNoMem;
+    if (!err)
+        err = lax_json_eof(inc->context);
+    if (err) {
+        discard(inc);
+        return err;
+    }
+    return commit(inc, 0, inc->event_count, 0);
+}
+
+/* Finds the innermost container that starts before start and ends at or
+ * after old_end, setting *begin and *end to its events. Containers that
+ * start at or after start are passed over, but their ends are matched to
+ * them so that the ones around them are still found. */
+static int find_container(struct LaxJsonIncremental *inc, int start, int old_end,
+        int *begin, int *end)
+{
+    int *open = malloc((inc->event_count + 1) * sizeof(int));
+    int open_index = 0;
+    int found = 0;
+    int i;
+
+    if (!open)
+        return 0;
+    for (i = 0; i < inc->event_count && !found; i += 1) {
+        switch (inc->events[i].kind) {
+            case LaxJsonEventBegin:
+                open[open_index++] = i;
+                break;
+            case LaxJsonEventEnd:
+                open_index -= 1;
+                if (inc->events[open[open_index]].offset - 1 < start &&
+                    inc->events[i].offset - 1 >= old_end)
+                {
+                    *begin = open[open_index];
+                    *end = i;
+                    found = 1;
+                }
+                break;
+            case LaxJsonEventValue:
+                break;
+        }
+    }
+    free(open);
+    return found;
+}
+
+enum LaxJsonError lax_json_incremental_edit(struct LaxJsonIncremental *inc,
+        int size, const char *data, int start, int old_end, int new_end)
+{
+    struct LaxJsonContext *context = inc->context;
+    int64_t delta = new_end - old_end;
+    const char *newline;
+    struct LaxJsonEvent *begin_event;
+    int64_t expected_end;
+    int bracket;
+    int begin;
+    int end;
+
+    if (start < 0 || old_end < start || new_end < start || new_end > size ||
+        !find_container(inc, start, old_end, &begin, &end))
+    {
+        return lax_json_incremental_parse(inc, size, data);
+    }
+    begin_event = &inc->events[begin];
+    bracket = begin_event->offset - 1;
+    expected_end = inc->events[end].offset + delta;
+
+    free_events(inc->pending, inc->pending_count);
+    inc->pending_count = 0;
+    if (lax_json_restore(context, begin_event->checkpoint, begin_event->checkpoint_size))
+        return lax_json_incremental_parse(inc, size, data);
+
+    /* the checkpoint was taken inside the begin callback, and events after an
+     * earlier edit keep checkpoints with old locations, so locate the bracket
+     * in the new document */
+    context->offset = bracket;
+    context->line = 1;
+    context->column = bracket;
+    for (newline = data; (newline = memchr(newline, '\n', data + bracket - newline)); newline += 1) {
+        context->line += 1;
+        context->column = data + bracket - newline - 1;
+    }
+
+    inc->stop_index = context->state_stack_index;
+    inc->stopped = 0;
+    lax_json_feed(context, size - bracket, data + bracket);
+    if (!inc->stopped || context->offset != expected_end)
+        return lax_json_incremental_parse(inc, size, data);
+
+    inc->parsed_size = context->offset - bracket;
+    return commit(inc, begin, end - begin + 1, delta);
+}
@@ -0,0 +1,740 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "laxjson_index.h"
+#include "laxjson_extract.h"
+#include "laxjson_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define INDEX_MAGIC "LAXJIDX1"
+#define INDEX_BYTE_ORDER 0x01020304u
+#define HASH_SEED 0x6c61786a696478ULL
+#define DEFAULT_MIN_SIZE 65536
+#define DEFAULT_ELEMENT_STRIDE 256
+#define FEED_CHUNK_SIZE (1 << 30)
+
+/* The file is the header followed by the entries, the sampled element
+ * offsets, the hash table and the NUL terminated paths. */
+struct LaxJsonIndexHeader {
+    char magic[8];
+    /* rejects indexes written on a machine with another byte order */
+    uint32_t byte_order;
+    uint32_t header_size;
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t entry_count;
+    uint64_t sample_count;
+    /* a power of two */
+    uint64_t table_size;
+    uint64_t paths_size;
+    uint64_t element_stride;
+};
+
+struct LaxJsonIndexEntry {
+    /* offset into the paths */
+    uint64_t path;
+    /* from the opening bracket to after the closing one */
+    uint64_t start;
+    uint64_t end;
+    /* arrays: number of elements. objects: number of members. */
+    uint64_t count;
+    /* arrays: the offsets of elements 0, element_stride, 2 * element_stride
+     * and so on are samples[first_sample] onwards */
+    uint64_t first_sample;
+    uint64_t sample_count;
+    /* enum LaxJsonType */
+    uint32_t type;
+    uint32_t reserved;
+};
+
+struct BuildFrame {
+    int64_t start;
+    int64_t count;
+    size_t path_length;
+    /* where this array's samples begin in open_samples */
+    size_t sample_base;
+    enum LaxJsonType type;
+};
+
+struct IndexBuilder {
+    int64_t min_size;
+    int element_stride;
+    struct BuildFrame *frames;
+    size_t frame_count;
+    size_t frame_size;
+    /* path of the value being read */
+    char *path;
+    size_t path_length;
+    size_t path_size;
+    /* samples of the open arrays, innermost last */
+    uint64_t *open_samples;
+    size_t open_sample_count;
+    size_t open_sample_size;
+    struct LaxJsonIndexEntry *entries;
+    size_t entry_count;
+    size_t entry_size;
+    uint64_t *samples;
+    size_t sample_count;
+    size_t sample_size;
+    char *paths;
+    size_t paths_size;
+    size_t paths_capacity;
+    enum LaxJsonError error;
+};
+
+/* Makes room for needed items in *ptr. Returns nonzero when out of memory. */
+static int reserve(void *ptr, size_t *capacity, size_t needed, size_t item_size) {
+    void **items = ptr;
+    size_t new_capacity;
+    void *new_ptr;
+
+    if (needed <= *capacity)
+        return 0;
+    new_capacity = *capacity ? *capacity * 2 : 64;
+    while (new_capacity < needed)
+        new_capacity *= 2;
+    new_ptr = realloc(*items, new_capacity * item_size);
+    if (!new_ptr)
+        return 1;
+    *items = new_ptr;
+    *capacity = new_capacity;
+    return 0;
+}
+
+/* Replaces everything after the path of frame with one more segment. */
+static int append_segment(struct IndexBuilder *builder, const struct BuildFrame *frame,
+        const char *segment, size_t length)
+{
+    size_t at = frame->path_length;
+
+    if (reserve(&builder->path, &builder->path_size, at + length + 2, 1))
+        return 1;
+    if (at > 0)
+        builder->path[at++] = '.';
+    memcpy(builder->path + at, segment, length);
+    builder->path_length = at + length;
+    return 0;
+}
+
+/* Counts a value starting in the innermost container, recording its offset
+ * when it is an array element to sample. */
+static int start_value(struct LaxJsonContext *context) {
+    struct IndexBuilder *builder = context->userdata;
+    struct BuildFrame *frame;
+
+    if (builder->frame_count == 0)
+        return 0;
+    frame = &builder->frames[builder->frame_count - 1];
+    if (frame->type != LaxJsonTypeArray)
+        return 0;
+    if (frame->count % builder->element_stride == 0) {
+        if (reserve(&builder->open_samples, &builder->open_sample_size,
+                    builder->open_sample_count + 1, sizeof(uint64_t)))
+        {
+            builder->error = LaxJsonErrorNoMem;
+            return 1;
+        }
+        builder->open_samples[builder->open_sample_count++] = context->event_start;
+    }
+    frame->count += 1;
+    return 0;
+}
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    struct IndexBuilder *builder = context->userdata;
+    struct BuildFrame *frame;
+
+    if (type != LaxJsonTypeProperty)
+        return start_value(context);
+    frame = &builder->frames[builder->frame_count - 1];
+    frame->count += 1;
+    if (append_segment(builder, frame, value, length)) {
+        builder->error = LaxJsonErrorNoMem;
+        return 1;
+    }
+    return 0;
+}
+
+static int on_raw_number(struct LaxJsonContext *context, const char *value, int length, int flags) {
+    return start_value(context);
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    return start_value(context);
+}
+
+static int on_primitive(struct LaxJsonContext *context, enum LaxJsonType type) {
+    return start_value(context);
+}
+
+static int on_begin(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct IndexBuilder *builder = context->userdata;
+    struct BuildFrame *parent;
+    struct BuildFrame *frame;
+    char segment[32];
+
+    if (start_value(context))
+        return 1;
+    if (builder->frame_count > 0) {
+        parent = &builder->frames[builder->frame_count - 1];
+        if (parent->type == LaxJsonTypeArray) {
+            sprintf(segment, "%lld", (long long)(parent->count - 1));
+            if (append_segment(builder, parent, segment, strlen(segment))) {
+                builder->error = LaxJsonErrorNoMem;
+                return 1;
+            }
+        }
+    }
+    if (reserve(&builder->frames, &builder->frame_size, builder->frame_count + 1,
+                sizeof(struct BuildFrame)))
+    {
+        builder->error = LaxJsonErrorNoMem;
+        return 1;
+    }
+    frame = &builder->frames[builder->frame_count++];
+    frame->start = context->event_start;
+    frame->count = 0;
+    frame->path_length = builder->frame_count > 1 ? builder->path_length : 0;
+    frame->sample_base = builder->open_sample_count;
+    frame->type = type;
+    return 0;
+}
+
+static int on_end(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct IndexBuilder *builder = context->userdata;
+    struct BuildFrame *frame = &builder->frames[--builder->frame_count];
+    struct LaxJsonIndexEntry *entry;
+    size_t sample_count = builder->open_sample_count - frame->sample_base;
+
+    builder->open_sample_count = frame->sample_base;
+    if (builder->frame_count > 0 && context->event_end - frame->start < builder->min_size)
+        return 0;
+
+    if (reserve(&builder->entries, &builder->entry_size, builder->entry_count + 1,
+                sizeof(struct LaxJsonIndexEntry)) ||
+        reserve(&builder->paths, &builder->paths_capacity,
+            builder->paths_size + frame->path_length + 1, 1))
+    {
+        builder->error = LaxJsonErrorNoMem;
+        return 1;
+    }
+    entry = &builder->entries[builder->entry_count++];
+    memset(entry, 0, sizeof(struct LaxJsonIndexEntry));
+    entry->path = builder->paths_size;
+    entry->start = frame->start;
+    entry->end = context->event_end;
+    entry->count = frame->count;
+    entry->type = type;
+    memcpy(builder->paths + builder->paths_size, builder->path, frame->path_length);
+    builder->paths_size += frame->path_length;
+    builder->paths[builder->paths_size++] = 0;
+
+    /* small arrays are quick enough to scan from the start, and objects
+     * are never sampled */
+    if (type == LaxJsonTypeArray && frame->count > builder->element_stride) {
+        if (reserve(&builder->samples, &builder->sample_size,
+                    builder->sample_count + sample_count, sizeof(uint64_t)))
+        {
+            builder->error = LaxJsonErrorNoMem;
+            return 1;
+        }
+        memcpy(builder->samples + builder->sample_count,
+                builder->open_samples + frame->sample_base, sample_count * sizeof(uint64_t));
+        entry->first_sample = builder->sample_count;
+        entry->sample_count = sample_count;
+        builder->sample_count += sample_count;
+    }
+    return 0;
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+    const char *p = data;
+    ssize_t amt;
+    while (size > 0) {
+        amt = write(fd, p, size);
+        if (amt < 0)
+            return -1;
+        p += amt;
+        size -= amt;
+    }
+    return 0;
+}
+
+/* Writes to a temporary file first so that readers never map a partially
+ * written index. */
+static enum LaxJsonError write_index(const struct IndexBuilder *builder, const char *index_path,
+        const struct stat *st)
+{
+    struct LaxJsonIndexHeader header;
+    const struct LaxJsonIndexEntry *entry;
+    uint64_t *table;
+    uint64_t table_size = 2;
+    uint64_t slot;
+    char *tmp_path;
+    size_t i;
+    int failed;
+    int fd;
+
+    while (table_size < builder->entry_count * 2)
+        table_size *= 2;
+    table = calloc(table_size, sizeof(uint64_t));
+    tmp_path = malloc(strlen(index_path) + 32);
+    if (!table || !tmp_path) {
+        free(table);
+        free(tmp_path);
+        return LaxJsonErrorNoMem;
+    }
+    for (i = 0; i < builder->entry_count; i += 1) {
+        entry = &builder->entries[i];
+        slot = lax_json_hash64(HASH_SEED, builder->paths + entry->path,
+                strlen(builder->paths + entry->path)) & (table_size - 1);
+        while (table[slot])
+            slot = (slot + 1) & (table_size - 1);
+        table[slot] = i + 1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, 8);
+    header.byte_order = INDEX_BYTE_ORDER;
+    header.header_size = sizeof(struct LaxJsonIndexHeader);
+    header.source_size = st->st_size;
+    header.source_mtime_sec = st->st_mtim.tv_sec;
+    header.source_mtime_nsec = st->st_mtim.tv_nsec;
+    header.entry_count = builder->entry_count;
+    header.sample_count = builder->sample_count;
+    header.table_size = table_size;
+    header.paths_size = builder->paths_size;
+    header.element_stride = builder->element_stride;
+
+    sprintf(tmp_path, "%s.%ld.tmp", index_path, (long)getpid());
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(table);
+        free(tmp_path);
+        return LaxJsonErrorIo;
+    }
+    failed = write_all(fd, &header, sizeof(header)) ||
+        write_all(fd, builder->entries, builder->entry_count * sizeof(struct LaxJsonIndexEntry)) ||
+        write_all(fd, builder->samples, builder->sample_count * sizeof(uint64_t)) ||
+        write_all(fd, table, table_size * sizeof(uint64_t)) ||
+        write_all(fd, builder->paths, builder->paths_size);
+    failed = close(fd) || failed;
+    if (!failed)
+        failed = rename(tmp_path, index_path);
+    if (failed)
+        unlink(tmp_path);
+    free(table);
+    free(tmp_path);
+    return failed ? LaxJsonErrorIo : LaxJsonErrorNone;
+}
+
+/* Feeds size bytes in pieces that fit in an int. */
+static enum LaxJsonError feed_all(struct LaxJsonContext *context, const char *data, size_t size) {
+    enum LaxJsonError err = LaxJsonErrorNone;
+    size_t amt;
+
+    while (size > 0 && !err) {
+        amt = size > FEED_CHUNK_SIZE ? FEED_CHUNK_SIZE : size;
+        err = lax_json_feed(context, amt, data);
+        data += amt;
+        size -= amt;
+    }
+    return err;
+}
+
+enum LaxJsonError lax_json_index_build(struct LaxJsonContext *context, const char *path,
+        const char *index_path, int64_t min_size, int element_stride)
+{
+    struct LaxJsonContext *own_context = NULL;
+    struct IndexBuilder builder;
+    enum LaxJsonError err;
+    struct stat st;
+    void *map = NULL;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return LaxJsonErrorIo;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return LaxJsonErrorIo;
+    }
+    if (st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return LaxJsonErrorIo;
+        }
+    }
+    close(fd);
+
+    if (!context) {
+        own_context = context = lax_json_create();
+        if (!context) {
+            if (map)
+                munmap(map, st.st_size);
+            return LaxJsonErrorNoMem;
+        }
+    }
+
+    memset(&builder, 0, sizeof(builder));
+    builder.min_size = min_size > 0 ? min_size : DEFAULT_MIN_SIZE;
+    builder.element_stride = element_stride > 0 ? element_stride : DEFAULT_ELEMENT_STRIDE;
+    context->userdata = &builder;
+    context->string = on_string;
+    context->number = on_number;
+    context->raw_number = on_raw_number;
+    context->primitive = on_primitive;
+    context->begin = on_begin;
+    context->end = on_end;
+    /* these would take events away from the builder */
+    context->raw_string = NULL;
+    context->number_array = NULL;
+    context->error = NULL;
+    context->key_evicted = NULL;
+    context->record_delimiter = 0;
+
+    err = feed_all(context, map, st.st_size);
+    if (!err)
+        err = lax_json_eof(context);
+    if (err == LaxJsonErrorAborted && builder.error)
+        err = builder.error;
+    if (!err)
+        err = write_index(&builder, index_path, &st);
+
+    if (map)
+        munmap(map, st.st_size);
+    if (own_context)
+        lax_json_destroy(own_context);
+    free(builder.frames);
+    free(builder.path);
+    free(builder.open_samples);
+    free(builder.entries);
+    free(builder.samples);
+    free(builder.paths);
+    return err;
+}
+
+/* Maps the file open as fd, or sets *out to NULL if it is empty. */
+static enum LaxJsonError map_file(int fd, const struct stat *st, void **out) {
+    *out = NULL;
+    if (st->st_size == 0)
+        return LaxJsonErrorNone;
+    *out = mmap(NULL, st->st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (*out == MAP_FAILED) {
+        *out = NULL;
+        return LaxJsonErrorIo;
+    }
+    return LaxJsonErrorNone;
+}
+
+/* Checks that the counts in the header describe a file of exactly size
+ * bytes, taking care that damaged counts do not overflow. */
+static int check_layout(const struct LaxJsonIndexHeader *header, size_t size) {
+    uint64_t rest = size - sizeof(struct LaxJsonIndexHeader);
+
+    if (header->entry_count > rest / sizeof(struct LaxJsonIndexEntry))
+        return 0;
+    rest -= header->entry_count * sizeof(struct LaxJsonIndexEntry);
+    if (header->sample_count > rest / sizeof(uint64_t))
+        return 0;
+    rest -= header->sample_count * sizeof(uint64_t);
+    if (header->table_size > rest / sizeof(uint64_t))
+        return 0;
+    rest -= header->table_size * sizeof(uint64_t);
+    return header->paths_size == rest;
+}
+
+enum LaxJsonError lax_json_index_open(const char *path, const char *index_path,
+        struct LaxJsonIndex **out)
+{
+    const struct LaxJsonIndexHeader *header;
+    struct LaxJsonIndex *index;
+    struct stat source_st;
+    struct stat st;
+    enum LaxJsonError err;
+    int fd;
+
+    *out = NULL;
+    index = calloc(1, sizeof(struct LaxJsonIndex));
+    if (!index)
+        return LaxJsonErrorNoMem;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(index);
+        return LaxJsonErrorIo;
+    }
+    err = fstat(fd, &source_st) ? LaxJsonErrorIo : map_file(fd, &source_st, &index->source_map);
+    close(fd);
+    if (err) {
+        free(index);
+        return err;
+    }
+    index->source = index->source_map ? index->source_map : "";
+    index->source_size = source_st.st_size;
+
+    fd = open(index_path, O_RDONLY);
+    if (fd < 0) {
+        lax_json_index_close(index);
+        return LaxJsonErrorIo;
+    }
+    err = fstat(fd, &st) ? LaxJsonErrorIo : map_file(fd, &st, &index->map);
+    close(fd);
+    if (err) {
+        lax_json_index_close(index);
+        return err;
+    }
+    index->map_size = st.st_size;
+
+    header = index->map;
+    if (index->map_size < sizeof(struct LaxJsonIndexHeader) ||
+        memcmp(header->magic, INDEX_MAGIC, 8) != 0 ||
+        header->byte_order != INDEX_BYTE_ORDER ||
+        header->header_size != sizeof(struct LaxJsonIndexHeader) ||
+        header->source_size != (uint64_t)source_st.st_size ||
+        header->source_mtime_sec != source_st.st_mtim.tv_sec ||
+        header->source_mtime_nsec != source_st.st_mtim.tv_nsec ||
+        header->element_stride == 0 ||
+        header->table_size == 0 || (header->table_size & (header->table_size - 1)) ||
+        !check_layout(header, index->map_size))
+    {
+        lax_json_index_close(index);
+        return LaxJsonErrorInvalidIndex;
+    }
+    index->header = header;
+    index->entries = (const struct LaxJsonIndexEntry *)(header + 1);
+    index->samples = (const uint64_t *)(index->entries + header->entry_count);
+    index->table = index->samples + header->sample_count;
+    index->paths = (const char *)(index->table + header->table_size);
+
+    *out = index;
+    return LaxJsonErrorNone;
+}
+
+void lax_json_index_close(struct LaxJsonIndex *index) {
+    if (index->source_map)
+        munmap(index->source_map, index->source_size);
+    if (index->map)
+        munmap(index->map, index->map_size);
+    free(index);
+}
+
+/* The entry of the container at the first length bytes of path, or NULL.
+ * Entries that do not make sense for the source are ignored. */
+static const struct LaxJsonIndexEntry *lookup(const struct LaxJsonIndex *index,
+        const char *path, size_t length)
+{
+    const struct LaxJsonIndexHeader *header = index->header;
+    const struct LaxJsonIndexEntry *entry;
+    uint64_t mask = header->table_size - 1;
+    uint64_t slot = lax_json_hash64(HASH_SEED, path, length) & mask;
+    uint64_t probes;
+    uint64_t i;
+
+    for (probes = 0; probes < header->table_size; probes += 1) {
+        i = index->table[slot];
+        if (i == 0 || i > header->entry_count)
+            return NULL;
+        entry = &index->entries[i - 1];
+        if (entry->path < header->paths_size && header->paths_size - entry->path > length &&
+            memcmp(index->paths + entry->path, path, length) == 0 &&
+            index->paths[entry->path + length] == 0)
+        {
+            if (entry->start >= entry->end || entry->end > index->source_size ||
+                entry->sample_count > header->sample_count ||
+                entry->first_sample > header->sample_count - entry->sample_count)
+            {
+                return NULL;
+            }
+            return entry;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+struct FindResult {
+    int64_t start;
+    int64_t end;
+    int depth;
+    int found;
+};
+
+static int find_match(struct LaxJsonExtractor *extractor, int pattern) {
+    struct FindResult *result = extractor->userdata;
+    result->start = extractor->context->event_start;
+    return 0;
+}
+
+/* The match is complete once a value at depth 0 ends. */
+static int find_value_end(struct LaxJsonExtractor *extractor) {
+    struct FindResult *result = extractor->userdata;
+    if (result->depth > 0)
+        return 0;
+    result->end = extractor->context->event_end;
+    result->found = 1;
+    return 1;
+}
+
+static int find_string(struct LaxJsonExtractor *extractor,
+    enum LaxJsonType type, const char *value, int length)
+{
+    return find_value_end(extractor);
+}
+
+static int find_number(struct LaxJsonExtractor *extractor, double x) {
+    return find_value_end(extractor);
+}
+
+static int find_primitive(struct LaxJsonExtractor *extractor, enum LaxJsonType type) {
+    return find_value_end(extractor);
+}
+
+static int find_begin(struct LaxJsonExtractor *extractor, enum LaxJsonType type) {
+    struct FindResult *result = extractor->userdata;
+    result->depth += 1;
+    return 0;
+}
+
+static int find_end(struct LaxJsonExtractor *extractor, enum LaxJsonType type) {
+    struct FindResult *result = extractor->userdata;
+    result->depth -= 1;
+    return find_value_end(extractor);
+}
+
+/* Looks for pattern in the bytes from start to end. When in_array is set,
+ * those bytes are the elements of an array from some element on. */
+static enum LaxJsonError find_in(const struct LaxJsonIndex *index, const char *pattern,
+        uint64_t start, uint64_t end, int in_array, int64_t *start_out, int64_t *end_out)
+{
+    struct LaxJsonExtractor *extractor;
+    struct FindResult result;
+    enum LaxJsonError err = LaxJsonErrorNone;
+    uint64_t pos = start;
+    size_t amt;
+
+    extractor = lax_json_extract_create(&pattern, 1);
+    if (!extractor)
+        return LaxJsonErrorNoMem;
+    memset(&result, 0, sizeof(result));
+    extractor->userdata = &result;
+    extractor->match = find_match;
+    extractor->string = find_string;
+    extractor->number = find_number;
+    extractor->primitive = find_primitive;
+    extractor->begin = find_begin;
+    extractor->end = find_end;
+
+    if (in_array)
+        err = lax_json_extract_feed(extractor, 1, "[");
+    extractor->context->offset = start;
+    while (pos < end && !err && !extractor->done) {
+        amt = end - pos > FEED_CHUNK_SIZE ? FEED_CHUNK_SIZE : end - pos;
+        err = lax_json_extract_feed(extractor, amt, index->source + pos);
+        pos += amt;
+    }
+    if (result.found) {
+        *start_out = result.start;
+        *end_out = result.end;
+        err = LaxJsonErrorNone;
+    } else if (!err) {
+        err = LaxJsonErrorNotFound;
+    }
+    lax_json_extract_destroy(extractor);
+    return err;
+}
+
+enum LaxJsonError lax_json_index_find(const struct LaxJsonIndex *index, const char *path,
+        int64_t *start, int64_t *end)
+{
+    const struct LaxJsonIndexEntry *entry;
+    enum LaxJsonError err;
+    uint64_t from;
+    uint64_t until;
+    uint64_t stride = index->header->element_stride;
+    uint64_t sample;
+    size_t length = strlen(path);
+    size_t prefix = length;
+    size_t segment_length;
+    const char *rest;
+    char *pattern;
+    long element;
+
+    if (length > 0 && (path[0] == '.' || path[length - 1] == '.' || strstr(path, "..")))
+        return LaxJsonErrorNotFound;
+
+    /* the deepest indexed container on the path */
+    for (;;) {
+        entry = lookup(index, path, prefix);
+        if (entry || prefix == 0)
+            break;
+        while (prefix > 0 && path[prefix - 1] != '.')
+            prefix -= 1;
+        if (prefix > 0)
+            prefix -= 1;
+    }
+    rest = path + prefix + (prefix > 0 && prefix < length);
+    from = entry ? entry->start : 0;
+    until = entry ? entry->end : index->source_size;
+    if (!*rest) {
+        /* a root that is not indexed is the only element of an array
+         * around the document */
+        if (!entry)
+            return find_in(index, "*", from, until, 1, start, end);
+        *start = from;
+        *end = until;
+        return LaxJsonErrorNone;
+    }
+
+    /* start at the nearest sampled element */
+    segment_length = strcspn(rest, ".");
+    if (entry && entry->sample_count > 0 && segment_length < 10 &&
+        strspn(rest, "0123456789") >= segment_length)
+    {
+        element = atol(rest);
+        sample = element / stride;
+        if (sample >= entry->sample_count)
+            sample = entry->sample_count - 1;
+        if (sample > 0) {
+            pattern = malloc(strlen(rest) + 32);
+            if (!pattern)
+                return LaxJsonErrorNoMem;
+            sprintf(pattern, "%ld%s", element - (long)(sample * stride), rest + segment_length);
+            err = find_in(index, pattern, index->samples[entry->first_sample + sample], until, 1,
+                    start, end);
+            free(pattern);
+            return err;
+        }
+    }
+    return find_in(index, rest, from, until, 0, start, end);
+}
+
+enum LaxJsonError lax_json_index_parse(const struct LaxJsonIndex *index, const char *path,
+        struct LaxJsonContext *context)
+{
+    enum LaxJsonError err;
+    int64_t start;
+    int64_t end;
+
+    if ((err = lax_json_index_find(index, path, &start, &end)))
+        return err;
+    context->offset = start;
+    if ((err = feed_all(context, index->source + start, end - start)))
+        return err;
+    return lax_json_eof(context);
+}
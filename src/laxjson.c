@@ -6,9 +6,24 @@
  */
 
 #include "laxjson.h"
+#include "laxjson_internal.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <sys/uio.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* so that the callback and pull versions of the state machine are each
+ * compiled without checks for the other */
+#ifdef __GNUC__
+#define ALWAYS_INLINE __inline__ __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE
+#endif
 
 #define WHITESPACE \
     ' ': \
@@ -116,6 +131,9 @@
 
 static const int HEX_MULT[] = {4096, 256, 16, 1};
 
+/* the rest of true, false and null, indexed by checkpoints */
+static const char *EXPECTED[] = {"rue", "alse", "ull"};
+
 /*
 static const char *STATE_NAMES[] = {
     "LaxJsonStateValue",
@@ -135,29 +153,224 @@ static const char *STATE_NAMES[] = {
     "LaxJsonStateNumber",
     "LaxJsonStateNumberDecimal",
     "LaxJsonStateNumberExponent",
-    "LaxJsonStateNumberExponentSign"
+    "LaxJsonStateNumberExponentSign",
+    "LaxJsonStateSurrogateBackslash",
+    "LaxJsonStateSurrogateU"
 };
 */
 
+/* The states stored in two bits on the state stack */
+#define STACK_OBJECT 0
+#define STACK_ARRAY 1
+#define STACK_END 2
+#define STACK_RARE 3
+/* skip_index while validating, which no container end matches */
+#define SKIP_ALL -1
+#define RARE_STATE_COUNT 4
+#define STACK_LEVELS_PER_BYTE 4
+
+static const enum LaxJsonState STACK_STATES[] = {
+    LaxJsonStateObject,
+    LaxJsonStateArray,
+    LaxJsonStateEnd,
+};
+
+static int stack_code(const struct LaxJsonContext *context, int index) {
+    return (context->state_stack[index / STACK_LEVELS_PER_BYTE] >>
+            (index % STACK_LEVELS_PER_BYTE * 2)) & 3;
+}
+
 static enum LaxJsonError push_state(struct LaxJsonContext *context, enum LaxJsonState state) {
-    enum LaxJsonState *new_ptr;
+    int index = context->state_stack_index;
+    unsigned char *byte;
+    unsigned char *new_ptr;
+    int new_size;
+    int code;
+    int shift;
 
     /* fprintf(stderr, "push state %s\n", STATE_NAMES[state]); */
-    if (context->state_stack_index >= context->state_stack_size) {
-        context->state_stack_size += 1024;
-        if (context->state_stack_size > context->max_state_stack_size)
-            return LaxJsonErrorExceededMaxStack;
+    if (index >= context->max_state_stack_size)
+        return LaxJsonErrorExceededMaxStack;
+    if (index >= context->state_stack_size) {
+        new_size = context->state_stack_size < context->max_state_stack_size / 2 ?
+            context->state_stack_size * 2 : context->max_state_stack_size;
         new_ptr = realloc(context->state_stack,
-                context->state_stack_size * sizeof(enum LaxJsonState));
+                ((unsigned)new_size + STACK_LEVELS_PER_BYTE - 1) / STACK_LEVELS_PER_BYTE);
         if (!new_ptr)
             return LaxJsonErrorNoMem;
         context->state_stack = new_ptr;
+        context->state_stack_size = new_size;
     }
-    context->state_stack[context->state_stack_index] = state;
+    switch (state) {
+        case LaxJsonStateObject:
+            code = STACK_OBJECT;
+            break;
+        case LaxJsonStateArray:
+            code = STACK_ARRAY;
+            break;
+        case LaxJsonStateEnd:
+            code = STACK_END;
+            break;
+        default:
+            if (context->rare_state_count >= RARE_STATE_COUNT)
+                return LaxJsonErrorExceededMaxStack;
+            context->rare_states[context->rare_state_count] = state;
+            context->rare_state_count += 1;
+            code = STACK_RARE;
+            break;
+    }
+    byte = &context->state_stack[index / STACK_LEVELS_PER_BYTE];
+    shift = index % STACK_LEVELS_PER_BYTE * 2;
+    *byte = (*byte & ~(3 << shift)) | (code << shift);
     context->state_stack_index += 1;
     return LaxJsonErrorNone;
 }
 
+struct InternedKey {
+    char *value;
+    int length;
+    int capacity;
+    uint64_t hash;
+    /* next id in the same bucket, or -1 */
+    int next;
+    /* seen since the clock hand last passed */
+    char referenced;
+};
+
+struct LaxJsonInternTable {
+    struct InternedKey *keys;
+    int count;
+    int capacity;
+    /* first id in each bucket, or -1 */
+    int *buckets;
+    uint64_t bucket_mask;
+    int hand;
+};
+
+static void free_interned(struct LaxJsonInternTable *table) {
+    int i;
+
+    if (!table)
+        return;
+    for (i = 0; i < table->count; i += 1)
+        free(table->keys[i].value);
+    free(table->keys);
+    free(table->buckets);
+    free(table);
+}
+
+static struct LaxJsonInternTable *create_interned(int capacity) {
+    struct LaxJsonInternTable *table = calloc(1, sizeof(struct LaxJsonInternTable));
+    size_t bucket_count = 16;
+    size_t i;
+
+    if (!table)
+        return NULL;
+    while (bucket_count < (size_t)capacity * 2)
+        bucket_count *= 2;
+    table->capacity = capacity;
+    table->bucket_mask = bucket_count - 1;
+    table->keys = calloc(capacity, sizeof(struct InternedKey));
+    table->buckets = malloc(bucket_count * sizeof(int));
+    if (!table->keys || !table->buckets) {
+        free_interned(table);
+        return NULL;
+    }
+    for (i = 0; i < bucket_count; i += 1)
+        table->buckets[i] = -1;
+    return table;
+}
+
+/* Picks a key to replace with the clock algorithm: keys seen since the hand
+ * last passed them get another turn. */
+static enum LaxJsonError evict_key(struct LaxJsonContext *context, int *id_out) {
+    struct LaxJsonInternTable *table = context->interned;
+    struct InternedKey *key;
+    int *link;
+
+    while (table->keys[table->hand].referenced) {
+        table->keys[table->hand].referenced = 0;
+        table->hand = (table->hand + 1) % table->capacity;
+    }
+    key = &table->keys[table->hand];
+    /* a key left out after running out of memory is not in a bucket */
+    if (key->length >= 0) {
+        if (context->key_evicted &&
+            context->key_evicted(context, table->hand, key->value, key->length))
+        {
+            return LaxJsonErrorAborted;
+        }
+        link = &table->buckets[key->hash & table->bucket_mask];
+        while (*link != table->hand)
+            link = &table->keys[*link].next;
+        *link = key->next;
+    }
+    *id_out = table->hand;
+    table->hand = (table->hand + 1) % table->capacity;
+    return LaxJsonErrorNone;
+}
+
+/* Replaces *value, a NUL terminated property name, with its interned copy
+ * and sets key_id. */
+static enum LaxJsonError intern_key(struct LaxJsonContext *context, const char **value,
+        int length)
+{
+    struct LaxJsonInternTable *table = context->interned;
+    struct InternedKey *key;
+    enum LaxJsonError err;
+    uint64_t hash;
+    char *new_ptr;
+    int id;
+
+    context->key_id = -1;
+    if (length >= LAX_JSON_MAX_INTERNED_LENGTH)
+        return LaxJsonErrorNone;
+    if (!table) {
+        table = context->interned = create_interned(context->max_interned_keys);
+        if (!table)
+            return LaxJsonErrorNoMem;
+    }
+    hash = lax_json_hash64(0, *value, length);
+    for (id = table->buckets[hash & table->bucket_mask]; id >= 0; id = table->keys[id].next) {
+        key = &table->keys[id];
+        if (key->hash == hash && key->length == length && memcmp(key->value, *value, length) == 0) {
+            key->referenced = 1;
+            context->key_id = id;
+            *value = key->value;
+            return LaxJsonErrorNone;
+        }
+    }
+
+    if (table->count < table->capacity) {
+        id = table->count;
+        table->count += 1;
+    } else if ((err = evict_key(context, &id))) {
+        return err;
+    }
+    key = &table->keys[id];
+    if (length + 1 > key->capacity) {
+        new_ptr = realloc(key->value, length + 1);
+        if (!new_ptr) {
+            /* leave the key out of the table until it is reused */
+            key->length = -1;
+            return LaxJsonErrorNoMem;
+        }
+        key->value = new_ptr;
+        key->capacity = length + 1;
+    }
+    /* value is not NUL terminated when it comes from raw_string */
+    memcpy(key->value, *value, length);
+    key->value[length] = 0;
+    key->length = length;
+    key->hash = hash;
+    key->referenced = 0;
+    key->next = table->buckets[hash & table->bucket_mask];
+    table->buckets[hash & table->bucket_mask] = id;
+    context->key_id = id;
+    *value = key->value;
+    return LaxJsonErrorNone;
+}
+
 struct LaxJsonContext *lax_json_create(void) {
     struct LaxJsonContext *context = calloc(1, sizeof(struct LaxJsonContext));
 
@@ -172,36 +385,93 @@ struct LaxJsonContext *lax_json_create(void) {
         return NULL;
     }
 
+    context->number_block = malloc(LAX_JSON_NUMBER_BLOCK * sizeof(double));
+    if (!context->number_block) {
+        lax_json_destroy(context);
+        return NULL;
+    }
+
     context->state_stack_size = 1024;
-    context->state_stack = malloc(context->state_stack_size * sizeof(enum LaxJsonState));
+    context->state_stack = calloc(context->state_stack_size / STACK_LEVELS_PER_BYTE, 1);
     if (!context->state_stack) {
         lax_json_destroy(context);
         return NULL;
     }
 
-    context->line = 1;
-    context->max_state_stack_size = 16384;
+    context->key_id = -1;
+    context->max_state_stack_size = 1048576; /* 256 KB of stack */
     context->max_value_buffer_size = 1048576; /* 1 MB */
 
-    push_state(context, LaxJsonStateEnd);
+    lax_json_reset(context);
 
     return context;
 }
 
+/* Prepares to parse a new value, keeping the location. */
+static void reset_parse_state(struct LaxJsonContext *context) {
+    context->state = LaxJsonStateValue;
+    context->state_stack_index = 0;
+    context->rare_state_count = 0;
+    context->value_buffer_index = 0;
+    context->unicode_point = 0;
+    context->unicode_digit_index = 0;
+    context->unicode_high = 0;
+    context->utf8_state = 0;
+    context->expected = NULL;
+    context->skip_index = 0;
+    context->number_count = 0;
+    context->recovering = 0;
+    context->in_begin = 0;
+    context->delim = 0;
+    context->string_type = LaxJsonTypeString;
+
+    push_state(context, LaxJsonStateEnd);
+}
+
+void lax_json_reset(struct LaxJsonContext *context) {
+    context->line = 1;
+    context->column = 0;
+    context->offset = 0;
+    context->value_start = 0;
+    context->event_start = 0;
+    context->event_end = 0;
+    context->input = NULL;
+    context->input_end = NULL;
+    context->content_hash = 0;
+    context->good_records = 0;
+    context->bad_records = 0;
+    context->record_start = 0;
+
+    reset_parse_state(context);
+}
+
 void lax_json_destroy(struct LaxJsonContext *context) {
     free(context->state_stack);
     free(context->value_buffer);
+    free(context->number_block);
+    free_interned(context->interned);
     free(context);
 }
 
 static void pop_state(struct LaxJsonContext *context) {
+    int code;
+
     context->state_stack_index -= 1;
-    context->state = context->state_stack[context->state_stack_index];
     assert(context->state_stack_index >= 0);
+    code = stack_code(context, context->state_stack_index);
+    if (code == STACK_RARE) {
+        context->rare_state_count -= 1;
+        context->state = context->rare_states[context->rare_state_count];
+    } else {
+        context->state = STACK_STATES[code];
+    }
 }
 
 static enum LaxJsonError buffer_char(struct LaxJsonContext *context, char c) {
     char *new_ptr;
+    /* nothing reads values inside a skipped container */
+    if (context->skip_index)
+        return LaxJsonErrorNone;
     if (context->value_buffer_index >= context->value_buffer_size) {
         context->value_buffer_size += 16384;
         if (context->value_buffer_size > context->max_value_buffer_size)
@@ -216,20 +486,630 @@ static enum LaxJsonError buffer_char(struct LaxJsonContext *context, char c) {
     return LaxJsonErrorNone;
 }
 
-enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const char *data) {
+/* Grows the value buffer so that it can hold size more bytes, in the same
+ * steps as buffer_char so that the limit is the same. */
+static enum LaxJsonError reserve_buffer(struct LaxJsonContext *context, int size) {
+    char *new_ptr;
+    int new_size = context->value_buffer_size;
+
+    if (context->value_buffer_index + size <= new_size)
+        return LaxJsonErrorNone;
+    while (context->value_buffer_index + size > new_size)
+        new_size += 16384;
+    if (new_size > context->max_value_buffer_size)
+        return LaxJsonErrorExceededMaxValueSize;
+    new_ptr = realloc(context->value_buffer, new_size);
+    if (!new_ptr)
+        return LaxJsonErrorNoMem;
+    context->value_buffer = new_ptr;
+    context->value_buffer_size = new_size;
+    return LaxJsonErrorNone;
+}
+
+static enum LaxJsonError buffer_code_point(struct LaxJsonContext *context, unsigned int point) {
+    enum LaxJsonError err;
+    unsigned char bytes[4];
+    int size;
+
+    if (point <= 0x7f) {
+        bytes[0] = point;
+        size = 1;
+    } else if (point <= 0x7ff) {
+        bytes[0] = 0xc0 | (point >> 6);
+        bytes[1] = 0x80 | (point & 0x3f);
+        size = 2;
+    } else if (point <= 0xffff) {
+        bytes[0] = 0xe0 | (point >> 12);
+        bytes[1] = 0x80 | ((point >> 6) & 0x3f);
+        bytes[2] = 0x80 | (point & 0x3f);
+        size = 3;
+    } else if (point <= 0x10ffff) {
+        bytes[0] = 0xf0 | (point >> 18);
+        bytes[1] = 0x80 | ((point >> 12) & 0x3f);
+        bytes[2] = 0x80 | ((point >> 6) & 0x3f);
+        bytes[3] = 0x80 | (point & 0x3f);
+        size = 4;
+    } else {
+        return LaxJsonErrorInvalidUnicodePoint;
+    }
+    if (context->skip_index)
+        return LaxJsonErrorNone;
+    err = reserve_buffer(context, size);
+    if (err)
+        return err;
+    memcpy(context->value_buffer + context->value_buffer_index, bytes, size);
+    context->value_buffer_index += size;
+    return LaxJsonErrorNone;
+}
+
+/* Half of a surrogate pair without the other half. There is no valid UTF-8
+ * for it, so it is an error when validating and otherwise encoded as if it
+ * were a code point, as older versions did. */
+static enum LaxJsonError buffer_lone_surrogate(struct LaxJsonContext *context) {
+    unsigned int point = context->unicode_high;
+
+    context->unicode_high = 0;
+    if (context->validate_utf8)
+        return LaxJsonErrorInvalidUnicodePoint;
+    return buffer_code_point(context, point);
+}
+
+/* UTF-8 validation states. Each names the bytes that may come next. */
+enum {
+    UTF8_ACCEPT,
+    UTF8_TAIL1,
+    UTF8_TAIL2,
+    UTF8_TAIL3,
+    /* after E0, which must not start an overlong sequence */
+    UTF8_E0,
+    /* after ED, which must not encode a surrogate */
+    UTF8_ED,
+    /* after F0, which must not start an overlong sequence */
+    UTF8_F0,
+    /* after F4, which must not go past U+10FFFF */
+    UTF8_F4,
+    UTF8_REJECT
+};
+
+static int utf8_next(int state, unsigned char byte) {
+    switch (state) {
+        case UTF8_ACCEPT:
+            if (byte < 0x80)
+                return UTF8_ACCEPT;
+            if (byte >= 0xc2 && byte <= 0xdf)
+                return UTF8_TAIL1;
+            if (byte == 0xe0)
+                return UTF8_E0;
+            if (byte == 0xed)
+                return UTF8_ED;
+            if (byte >= 0xe1 && byte <= 0xef)
+                return UTF8_TAIL2;
+            if (byte == 0xf0)
+                return UTF8_F0;
+            if (byte >= 0xf1 && byte <= 0xf3)
+                return UTF8_TAIL3;
+            if (byte == 0xf4)
+                return UTF8_F4;
+            return UTF8_REJECT;
+        case UTF8_TAIL1:
+        case UTF8_TAIL2:
+        case UTF8_TAIL3:
+            return (byte >= 0x80 && byte <= 0xbf) ? state - 1 : UTF8_REJECT;
+        case UTF8_E0:
+            return (byte >= 0xa0 && byte <= 0xbf) ? UTF8_TAIL1 : UTF8_REJECT;
+        case UTF8_ED:
+            return (byte >= 0x80 && byte <= 0x9f) ? UTF8_TAIL1 : UTF8_REJECT;
+        case UTF8_F0:
+            return (byte >= 0x90 && byte <= 0xbf) ? UTF8_TAIL2 : UTF8_REJECT;
+        case UTF8_F4:
+            return (byte >= 0x80 && byte <= 0x8f) ? UTF8_TAIL2 : UTF8_REJECT;
+    }
+    return UTF8_REJECT;
+}
+
+/* Validates size bytes continuing from *state. Returns the index of the first
+ * invalid byte, or size. Blocks of ASCII are skipped 16 bytes at a time. */
+static int validate_utf8(int *state, const unsigned char *bytes, int size) {
+    int i = 0;
+
+    while (i < size) {
+#ifdef __SSE2__
+        if (*state == UTF8_ACCEPT && size - i >= 16 &&
+            _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(bytes + i))) == 0)
+        {
+            i += 16;
+            continue;
+        }
+#endif
+        *state = utf8_next(*state, bytes[i]);
+        if (*state == UTF8_REJECT)
+            return i;
+        i += 1;
+    }
+    return size;
+}
+
+/* Returns the length of the run of string content starting at data, which
+ * ends at the delimiter, a backslash or the end of the input. The first byte
+ * is known to be content. */
+static int string_run(const char *data, const char *end, char delim) {
+    const char *p = data + 1;
+#ifdef __SSE2__
+    __m128i delims = _mm_set1_epi8(delim);
+    __m128i backslashes = _mm_set1_epi8('\\');
+    __m128i block;
+    int mask;
+
+    while (end - p >= 16) {
+        block = _mm_loadu_si128((const __m128i *)p);
+        mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, delims),
+                    _mm_cmpeq_epi8(block, backslashes)));
+        if (mask)
+            return p - data + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != delim && *p != '\\')
+        p += 1;
+    return p - data;
+}
+
+/* Steps over the rest of a string inside a skipped container, starting after
+ * data. Escapes that stand for one character are stepped over too, since
+ * nothing needs them decoded. Stops before any other escape, which is left
+ * to the state machine, or after the closing delimiter, setting *closed.
+ * Returns the number of bytes stepped over. */
+static int skip_string_run(const char *data, const char *end, char delim, int *closed) {
+    const char *p = data;
+
+    *closed = 0;
+    for (;;) {
+        p += string_run(p, end, delim);
+        if (p >= end)
+            return end - data - 1;
+        if (*p == delim) {
+            *closed = 1;
+            return p - data;
+        }
+        if (p + 1 >= end)
+            return p - data - 1;
+        switch (p[1]) {
+            case '\'':
+            case '"':
+            case '/':
+            case '\\':
+            case 'b':
+            case 'f':
+            case 'n':
+            case 'r':
+            case 't':
+                p += 1;
+                break;
+            default:
+                return p - data - 1;
+        }
+    }
+}
+
+static int is_whitespace(char c) {
+    switch (c) {
+        case WHITESPACE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Returns the length of the run of whitespace that continues after data,
+ * including data. Indentation makes these long in pretty printed documents. */
+static int whitespace_run(const char *data, const char *end) {
+    const char *p = data + 1;
+#ifdef __SSE2__
+    __m128i block;
+    __m128i space;
+    int mask;
+
+    while (end - p >= 16) {
+        block = _mm_loadu_si128((const __m128i *)p);
+        space = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')),
+                    _mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))),
+                _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\t')),
+                    _mm_cmpeq_epi8(block, _mm_set1_epi8('\r'))));
+        mask = _mm_movemask_epi8(space) ^ 0xffff;
+        if (mask) {
+            p += __builtin_ctz(mask);
+            break;
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && is_whitespace(*p))
+        p += 1;
+    return p - data;
+}
+
+static enum LaxJsonError buffer_run(struct LaxJsonContext *context, const char *data, int size) {
+    enum LaxJsonError err = reserve_buffer(context, size);
+    if (err)
+        return err;
+    memcpy(context->value_buffer + context->value_buffer_index, data, size);
+    context->value_buffer_index += size;
+    return LaxJsonErrorNone;
+}
+
+/* Updates the location for bytes consumed without going through the main
+ * loop. */
+static void advance_location(struct LaxJsonContext *context, const char *data, int size) {
+    const char *newline;
+    const char *end = data + size;
+
+    context->offset += size;
+    context->column += size;
+    while ((newline = memchr(data, '\n', end - data))) {
+        context->line += 1;
+        context->column = end - newline - 1;
+        data = newline + 1;
+    }
+}
+
+/* Returns the length of the number starting at data if it is well formed and
+ * its terminator is before end, or 0 to leave it to the state machine. */
+static int scan_number(const char *data, const char *end) {
+    const char *p = data + 1;
+
+    while (p < end && *p >= '0' && *p <= '9')
+        p += 1;
+    if (p < end && *p == '.') {
+        p += 1;
+        while (p < end && *p >= '0' && *p <= '9')
+            p += 1;
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p += 1;
+            if (p >= end || (*p != '+' && *p != '-'))
+                return 0;
+            p += 1;
+            while (p < end && *p >= '0' && *p <= '9')
+                p += 1;
+        }
+    }
+    if (p >= end)
+        return 0;
+    switch (*p) {
+        case NUMBER_TERMINATOR:
+            return p - data;
+        default:
+            return 0;
+    }
+}
+
+static int number_flags(const char *value, int length) {
+    int flags = 0;
+    int i;
+
+    if (length > 0 && value[0] == '-')
+        flags |= LaxJsonNumberNegative;
+    for (i = 0; i < length; i += 1) {
+        if (value[i] == '.')
+            flags |= LaxJsonNumberFraction;
+        else if (value[i] == 'e' || value[i] == 'E')
+            flags |= LaxJsonNumberExponent;
+    }
+    if (!(flags & (LaxJsonNumberFraction | LaxJsonNumberExponent)))
+        flags |= LaxJsonNumberInteger;
+    return flags;
+}
+
+static const double POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/* Converts numbers without an exponent and with at most 15 digits, which
+ * are a mantissa and a power of ten that are both exact doubles, so one
+ * division rounds correctly. Returns 0 for other numbers. */
+static int decode_simple_number(const char *value, int length, double *out) {
+    const char *p = value;
+    const char *end = value + length;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int scale = 0;
+    int negative = 0;
+    double x;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p += 1;
+    }
+    for (; p < end && *p >= '0' && *p <= '9'; p += 1) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += 1;
+    }
+    if (p < end && *p == '.') {
+        for (p += 1; p < end && *p >= '0' && *p <= '9'; p += 1) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += 1;
+            scale += 1;
+        }
+    }
+    if (p != end || digits == 0 || digits > 15)
+        return 0;
+    x = (double)mantissa / POWERS_OF_TEN[scale];
+    *out = negative ? -x : x;
+    return 1;
+}
+
+/* Converts a number followed by a byte that cannot continue it. */
+static double decode_number(const char *value, int length) {
+    double x;
+
+    if (decode_simple_number(value, length, &x))
+        return x;
+    return strtod(value, NULL);
+}
+
+/* Folds one word into content_hash. Strings are hashed on their own first,
+ * so most events cost a couple of multiplications. */
+static void hash_word(struct LaxJsonContext *context, uint64_t word) {
+    uint64_t h = context->content_hash ^ (word * 0xc2b2ae3d27d4eb4fULL);
+    context->content_hash = ((h << 31) | (h >> 33)) * 0x9e3779b185ebca87ULL;
+}
+
+/* -0 and 0 are the same value */
+static void hash_number(struct LaxJsonContext *context, double x) {
+    uint64_t bits;
+
+    if (x == 0)
+        x = 0;
+    memcpy(&bits, &x, 8);
+    hash_word(context, LaxJsonTokenNumber);
+    hash_word(context, bits);
+}
+
+static void hash_event(struct LaxJsonContext *context, enum LaxJsonTokenKind kind,
+        enum LaxJsonType type, const char *value, int length)
+{
+    switch (kind) {
+        case LaxJsonTokenNumber:
+            hash_number(context, decode_number(value, length));
+            break;
+        case LaxJsonTokenString:
+            hash_word(context, kind << 8 | type);
+            hash_word(context, lax_json_hash64(0, value, length));
+            break;
+        default:
+            hash_word(context, kind << 8 | type);
+            break;
+    }
+}
+
+static int flush_numbers(struct LaxJsonContext *context) {
+    int count = context->number_count;
+
+    context->number_count = 0;
+    context->event_start = context->number_block_start;
+    context->event_end = context->number_block_end;
+    return context->number_array(context, context->number_block, count);
+}
+
+/* Adds a number to the block, passing the block on once it is full. */
+static int append_number(struct LaxJsonContext *context, double x, int64_t start, int64_t end) {
+    if (context->number_count == 0)
+        context->number_block_start = start;
+    context->number_block[context->number_count] = x;
+    context->number_count += 1;
+    context->number_block_end = end;
+    if (context->number_count == LAX_JSON_NUMBER_BLOCK)
+        return flush_numbers(context);
+    return 0;
+}
+
+static int is_separator(char c) {
+    switch (c) {
+        case WHITESPACE:
+        case ',':
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* Decodes the array elements starting at data into the number block for as
+ * long as they are numbers complete in this feed. Returns the number of
+ * bytes consumed, including separators after the last number, or -1 when
+ * number_array aborted. */
+static int number_run(struct LaxJsonContext *context, const char *data, const char *end) {
+    /* the offset of data */
+    int64_t base = context->offset - 1;
+    const char *p = data;
+    double value;
+    int x;
+
+    while (p < end && (*p == '-' || *p == '+' || (*p >= '0' && *p <= '9'))) {
+        x = scan_number(p, end);
+        if (!x)
+            break;
+        value = decode_number(p, x);
+        if (context->hash_content)
+            hash_number(context, value);
+        if (append_number(context, value, base + (p - data), base + (p - data) + x))
+            return -1;
+        p += x;
+        while (p < end && is_separator(*p))
+            p += 1;
+        /* number_array asked to skip the rest of the array */
+        if (context->skip_index)
+            break;
+    }
+    return p - data;
+}
+
+/* value must be NUL terminated */
+static int emit_number(struct LaxJsonContext *context, const char *value, int length) {
+    double x;
+
+    if (context->number_array && context->state_stack_index > 0 &&
+        stack_code(context, context->state_stack_index - 1) == STACK_ARRAY)
+    {
+        x = decode_number(value, length);
+        if (context->hash_content)
+            hash_number(context, x);
+        return append_number(context, x, context->event_start, context->event_end);
+    }
+    if (context->raw_number) {
+        if (context->hash_content)
+            hash_number(context, decode_number(value, length));
+        return context->raw_number(context, value, length, number_flags(value, length));
+    }
+    x = atof(value);
+    if (context->hash_content)
+        hash_number(context, x);
+    return context->number(context, x);
+}
+
+static int emit_string(struct LaxJsonContext *context, enum LaxJsonType type,
+        const char *value, int length)
+{
+    if (context->raw_string)
+        return context->raw_string(context, type, value, length);
+    return context->string(context, type, value, length);
+}
+
+/* in_begin tells lax_json_skip that the container is not on the stack yet.
+ * It is cleared whether or not begin aborts, so that a later skip on the
+ * same context finds the right level. */
+static int emit_begin(struct LaxJsonContext *context, enum LaxJsonType type) {
+    int result;
+
+    context->in_begin = 1;
+    result = context->begin(context, type);
+    context->in_begin = 0;
+    return result;
+}
+
+static void set_token(struct LaxJsonToken *token, const struct LaxJsonContext *context,
+        enum LaxJsonTokenKind kind, enum LaxJsonType type, const char *value, int length, int flags)
+{
+    token->kind = kind;
+    token->start = context->event_start;
+    token->end = context->event_end;
+    token->type = type;
+    token->value = value;
+    token->length = length;
+    token->flags = flags;
+}
+
+/* The state machine behind both lax_json_feed and lax_json_next. Without a
+ * token, values are passed to the callbacks. With one, the first value is
+ * stored in it and the loop stops right after the byte that completed it.
+ * *data_ptr is advanced past the consumed input. */
+static ALWAYS_INLINE enum LaxJsonError feed(struct LaxJsonContext *context, const char **data_ptr,
+        const char *end, struct LaxJsonToken *token)
+{
 #define PUSH_STATE(state) \
     err = push_state(context, state); \
     if (err) return err;
+/* consumes the rest of a run of whitespace, which a single space is not
+ * worth scanning for */
+#define SKIP_WHITESPACE() \
+    if (data + 1 < end && is_whitespace(data[1])) { \
+        x = whitespace_run(data, end); \
+        advance_location(context, data + 1, x - 1); \
+        data += x - 1; \
+    }
+/* steps over as much of a string inside a skipped container as it can,
+ * without UTF-8 to validate */
+#define SKIP_STRING() \
+    if (context->skip_index && !context->validate_utf8) { \
+        x = skip_string_run(data, end, context->delim, &closed); \
+        advance_location(context, data + 1, x); \
+        data += x; \
+        if (closed) \
+            pop_state(context); \
+    }
+/* passes a string that is whole in this feed and free of escapes to
+ * raw_string where it is, without copying it */
+#define RAW_STRING() \
+    if (context->raw_string && !token && !context->skip_index && \
+        (x = string_run(data, end, context->delim)) < end - data && \
+        data[x] == context->delim) \
+    { \
+        utf8_state = 0; \
+        if (!context->validate_utf8 || \
+            (validate_utf8(&utf8_state, (const unsigned char *)data + 1, x - 1) == x - 1 && \
+             !utf8_state)) \
+        { \
+            advance_location(context, data + 1, x); \
+            EMIT_STRING(context->string_type, data + 1, x - 1, context->offset); \
+            pop_state(context); \
+            data += x; \
+        } \
+    }
 #define BUFFER_CHAR(c) \
     err = buffer_char(context, c); \
     if (err) return err;
+/* start and end are the offsets of the event's first byte and of the byte
+ * after its last */
+#define EMIT(kind, type, value, length, flags, start, end, call) \
+    context->event_start = start; \
+    context->event_end = end; \
+    if (context->skip_index) { \
+        /* inside a skipped container */ \
+    } else { \
+        /* callbacks hash numbers once they are converted */ \
+        if (context->hash_content && (token || kind != LaxJsonTokenNumber)) \
+            hash_event(context, kind, type, value, length); \
+        if (token) { \
+            set_token(token, context, kind, type, value, length, flags); \
+        } else if (call) { \
+            return LaxJsonErrorAborted; \
+        } \
+    }
+/* pending numbers come before any other event */
+#define FLUSH_NUMBERS() \
+    if (context->number_count && flush_numbers(context)) \
+        return LaxJsonErrorAborted;
+#define EMIT_BEGIN(type) \
+    FLUSH_NUMBERS() \
+    EMIT(LaxJsonTokenBegin, type, NULL, 0, 0, context->offset - 1, context->offset, \
+            emit_begin(context, type))
+/* the end of a skipped container is reported */
+#define EMIT_END(type) \
+    FLUSH_NUMBERS() \
+    if (context->skip_index == context->state_stack_index + 1) \
+        context->skip_index = 0; \
+    EMIT(LaxJsonTokenEnd, type, NULL, 0, 0, context->offset - 1, context->offset, \
+            context->end(context, type))
+/* reported at the first letter, which is enough to know the size */
+#define EMIT_PRIMITIVE(type, size) \
+    FLUSH_NUMBERS() \
+    EMIT(LaxJsonTokenPrimitive, type, NULL, 0, 0, context->offset - 1, context->offset - 1 + size, \
+            context->primitive(context, type))
+#define EMIT_STRING(type, value, length, end) \
+    FLUSH_NUMBERS() \
+    string_value = value; \
+    if ((type) == LaxJsonTypeProperty && context->max_interned_keys && !context->skip_index) { \
+        err = intern_key(context, &string_value, length); \
+        if (err) return err; \
+    } \
+    EMIT(LaxJsonTokenString, type, string_value, length, 0, context->value_start, end, \
+            emit_string(context, type, string_value, length))
+#define EMIT_NUMBER(value, length, end) \
+    EMIT(LaxJsonTokenNumber, LaxJsonTypeNumber, value, length, number_flags(value, length), \
+            context->value_start, end, emit_number(context, value, length))
 
     enum LaxJsonError err = LaxJsonErrorNone;
+    const char *data = *data_ptr;
+    const char *string_value;
     int x;
-    const char *end;
+    int invalid;
+    int utf8_state;
+    int closed;
+    int plus;
     char c;
-    unsigned char byte;
-    for (end = data + size; data < end; data += 1) {
+    for (; data < end; data += 1) {
+        if (token && token->kind != LaxJsonTokenNeedInput)
+            break;
         c = *data;
         if (c == '\n') {
             context->line += 1;
@@ -237,13 +1117,14 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
         } else {
             context->column += 1;
         }
+        context->offset += 1;
         /* fprintf(stderr, "line %d col %d state %s char %c\n", context->line, context->column,
                   STATE_NAMES[context->state], c); */
         switch (context->state) {
             case LaxJsonStateEnd:
                 switch (c) {
                     case WHITESPACE:
-                        /* ignore */
+                        SKIP_WHITESPACE();
                         break;
                     case '/':
                         context->state = LaxJsonStateCommentBegin;
@@ -258,6 +1139,7 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
                     case WHITESPACE:
                     case ',':
                         /* do nothing except eat these characters */
+                        SKIP_WHITESPACE();
                         break;
                     case '/':
                         context->state = LaxJsonStateCommentBegin;
@@ -267,19 +1149,22 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
                     case '\'':
                         context->state = LaxJsonStateString;
                         context->value_buffer_index = 0;
+                        context->value_start = context->offset - 1;
                         context->delim = c;
                         context->string_type = LaxJsonTypeProperty;
                         PUSH_STATE(LaxJsonStateColon);
+                        SKIP_STRING();
+                        RAW_STRING();
                         break;
                     case VALID_UNQUOTED:
                         context->state = LaxJsonStateBareProp;
                         context->value_buffer[0] = c;
                         context->value_buffer_index = 1;
+                        context->value_start = context->offset - 1;
                         context->delim = 0;
                         break;
                     case '}':
-                        if (context->end(context, LaxJsonTypeObject))
-                            return LaxJsonErrorAborted;
+                        EMIT_END(LaxJsonTypeObject);
                         pop_state(context);
                         break;
                     default:
@@ -293,20 +1178,14 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
                         break;
                     case WHITESPACE:
                         BUFFER_CHAR('\0');
-                        if (context->string(context, LaxJsonTypeProperty, context->value_buffer,
-                                context->value_buffer_index - 1))
-                        {
-                            return LaxJsonErrorAborted;
-                        }
+                        EMIT_STRING(LaxJsonTypeProperty, context->value_buffer,
+                                context->value_buffer_index - 1, context->offset - 1);
                         context->state = LaxJsonStateColon;
                         break;
                     case ':':
                         BUFFER_CHAR('\0');
-                        if (context->string(context, LaxJsonTypeProperty, context->value_buffer,
-                                context->value_buffer_index - 1))
-                        {
-                            return LaxJsonErrorAborted;
-                        }
+                        EMIT_STRING(LaxJsonTypeProperty, context->value_buffer,
+                                context->value_buffer_index - 1, context->offset - 1);
                         context->state = LaxJsonStateValue;
                         context->string_type = LaxJsonTypeString;
                         PUSH_STATE(LaxJsonStateObject);
@@ -317,17 +1196,34 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
                 break;
             case LaxJsonStateString:
                 if (c == context->delim) {
+                    if (context->utf8_state)
+                        return LaxJsonErrorInvalidUtf8;
                     BUFFER_CHAR('\0');
-                    if (context->string(context, context->string_type, context->value_buffer,
-                            context->value_buffer_index - 1))
-                    {
-                        return LaxJsonErrorAborted;
-                    }
+                    EMIT_STRING(context->string_type, context->value_buffer,
+                            context->value_buffer_index - 1, context->offset);
                     pop_state(context);
                 } else if (c == '\\') {
+                    if (context->utf8_state)
+                        return LaxJsonErrorInvalidUtf8;
                     context->state = LaxJsonStateStringEscape;
+                } else if (context->skip_index && !context->validate_utf8) {
+                    SKIP_STRING();
                 } else {
-                    BUFFER_CHAR(c);
+                    /* copy everything up to the next delimiter or escape at once */
+                    x = string_run(data, end, context->delim);
+                    if (context->validate_utf8) {
+                        invalid = validate_utf8(&context->utf8_state, (const unsigned char *)data, x);
+                        if (invalid < x) {
+                            advance_location(context, data + 1, invalid);
+                            return LaxJsonErrorInvalidUtf8;
+                        }
+                    }
+                    if (!context->skip_index) {
+                        err = buffer_run(context, data, x);
+                        if (err) return err;
+                    }
+                    advance_location(context, data + 1, x - 1);
+                    data += x - 1;
                 }
                 break;
             case LaxJsonStateStringEscape:
@@ -428,70 +1324,67 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
                 context->unicode_point += x * HEX_MULT[context->unicode_digit_index];
                 context->unicode_digit_index += 1;
                 if (context->unicode_digit_index == 4) {
-                    if (context->unicode_point <= 0x007f) {
-                        /* 1 byte */
-                        BUFFER_CHAR((char)context->unicode_point);
-                        context->state = LaxJsonStateString;
-                    } else if (context->unicode_point <= 0x07ff) {
-                        /* 2 bytes */
-                        byte = (0xc0 | (context->unicode_point >> 6));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | (context->unicode_point & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
-                    } else if (context->unicode_point <= 0xffff) {
-                        /* 3 bytes */
-                        byte = (0xe0 | (context->unicode_point >> 12));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | ((context->unicode_point >> 6) & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | (context->unicode_point & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
-                    } else if (context->unicode_point <= 0x1fffff) {
-                        /* 4 bytes */
-                        byte = (0xf0 | (context->unicode_point >> 18));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | ((context->unicode_point >> 12) & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | ((context->unicode_point >> 6) & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | (context->unicode_point & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
-                    } else if (context->unicode_point <= 0x3ffffff) {
-                        /* 5 bytes */
-                        byte = (0xf8 | (context->unicode_point >> 24));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | (context->unicode_point >> 18));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | ((context->unicode_point >> 12) & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | ((context->unicode_point >> 6) & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | (context->unicode_point & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
-                    } else if (context->unicode_point <= 0x7fffffff) {
-                        /* 6 bytes */
-                        byte = (0xfc | (context->unicode_point >> 30));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | ((context->unicode_point >> 24) & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | ((context->unicode_point >> 18) & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | ((context->unicode_point >> 12) & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | ((context->unicode_point >> 6) & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
-                        byte = (0x80 | (context->unicode_point & 0x3f));
-                        BUFFER_CHAR(*(char *)(&byte));
+                    context->state = LaxJsonStateString;
+                    if (context->unicode_high) {
+                        if (context->unicode_point >= 0xdc00 && context->unicode_point <= 0xdfff) {
+                            context->unicode_point = 0x10000 +
+                                ((context->unicode_high - 0xd800) << 10) +
+                                (context->unicode_point - 0xdc00);
+                            context->unicode_high = 0;
+                        } else {
+                            err = buffer_lone_surrogate(context);
+                            if (err) return err;
+                        }
+                    }
+                    if (context->unicode_point >= 0xd800 && context->unicode_point <= 0xdbff) {
+                        /* wait for the low half of the pair */
+                        context->unicode_high = context->unicode_point;
+                        context->state = LaxJsonStateSurrogateBackslash;
+                    } else if (context->unicode_point >= 0xdc00 && context->unicode_point <= 0xdfff) {
+                        context->unicode_high = context->unicode_point;
+                        err = buffer_lone_surrogate(context);
+                        if (err) return err;
                     } else {
-                        return LaxJsonErrorInvalidUnicodePoint;
+                        err = buffer_code_point(context, context->unicode_point);
+                        if (err) return err;
                     }
-                    context->state = LaxJsonStateString;
                 }
                 break;
+            case LaxJsonStateSurrogateBackslash:
+                if (c == '\\') {
+                    context->state = LaxJsonStateSurrogateU;
+                    break;
+                }
+                err = buffer_lone_surrogate(context);
+                if (err) return err;
+                context->state = LaxJsonStateString;
+
+                /* rewind 1 */
+                data -= 1;
+                context->column -= 1;
+                context->offset -= 1;
+                continue;
+            case LaxJsonStateSurrogateU:
+                if (c == 'u') {
+                    context->state = LaxJsonStateUnicodeEscape;
+                    context->unicode_digit_index = 0;
+                    context->unicode_point = 0;
+                    break;
+                }
+                err = buffer_lone_surrogate(context);
+                if (err) return err;
+                context->state = LaxJsonStateStringEscape;
+
+                /* rewind 1 */
+                data -= 1;
+                context->column -= 1;
+                context->offset -= 1;
+                continue;
             case LaxJsonStateColon:
                 switch (c) {
                     case WHITESPACE:
                         /* ignore it */
+                        SKIP_WHITESPACE();
                         break;
                     case '/':
                         context->state = LaxJsonStateCommentBegin;
@@ -509,20 +1402,18 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
             case LaxJsonStateValue:
                 switch (c) {
                     case WHITESPACE:
-                        /* ignore */
+                        SKIP_WHITESPACE();
                         break;
                     case '/':
                         context->state = LaxJsonStateCommentBegin;
                         PUSH_STATE(LaxJsonStateValue);
                         break;
                     case '{':
-                        if (context->begin(context, LaxJsonTypeObject))
-                            return LaxJsonErrorAborted;
+                        EMIT_BEGIN(LaxJsonTypeObject);
                         context->state = LaxJsonStateObject;
                         break;
                     case '[':
-                        if (context->begin(context, LaxJsonTypeArray))
-                            return LaxJsonErrorAborted;
+                        EMIT_BEGIN(LaxJsonTypeArray);
                         context->state = LaxJsonStateArray;
                         break;
                     case '\'':
@@ -530,38 +1421,51 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
                         context->state = LaxJsonStateString;
                         context->delim = c;
                         context->value_buffer_index = 0;
+                        context->value_start = context->offset - 1;
+                        SKIP_STRING();
+                        RAW_STRING();
                         break;
                     case '-':
-                        context->state = LaxJsonStateNumber;
-                        context->value_buffer[0] = c;
-                        context->value_buffer_index = 1;
-                        break;
                     case '+':
-                        context->state = LaxJsonStateNumber;
-                        context->value_buffer_index = 0;
-                        break;
                     case DIGIT:
+                        context->value_start = context->offset - 1;
+                        if ((token || context->raw_number || context->number_array || context->skip_index) &&
+                            (x = scan_number(data, end)))
+                        {
+                            /* the whole number is in this feed, so pass it without copying */
+                            plus = c == '+';
+                            advance_location(context, data + 1, x);
+                            EMIT_NUMBER(data + plus, x - plus, context->offset - 1);
+                            pop_state(context);
+
+                            /* rewind 1 */
+                            data += x - 1;
+                            context->column -= 1;
+                            context->offset -= 1;
+                            continue;
+                        }
                         context->state = LaxJsonStateNumber;
-                        context->value_buffer_index = 1;
-                        context->value_buffer[0] = c;
+                        if (c == '+') {
+                            context->value_buffer_index = 0;
+                        } else {
+                            context->value_buffer[0] = c;
+                            context->value_buffer_index = 1;
+                        }
                         break;
                     case 't':
-                        if (context->primitive(context, LaxJsonTypeTrue))
-                            return LaxJsonErrorAborted;
+                        EMIT_PRIMITIVE(LaxJsonTypeTrue, 4);
                         context->state = LaxJsonStateExpect;
-                        context->expected = "rue";
+                        context->expected = EXPECTED[0];
                         break;
                     case 'f':
-                        if (context->primitive(context, LaxJsonTypeFalse))
-                            return LaxJsonErrorAborted;
+                        EMIT_PRIMITIVE(LaxJsonTypeFalse, 5);
                         context->state = LaxJsonStateExpect;
-                        context->expected = "alse";
+                        context->expected = EXPECTED[1];
                         break;
                     case 'n':
-                        if (context->primitive(context, LaxJsonTypeNull))
-                            return LaxJsonErrorAborted;
+                        EMIT_PRIMITIVE(LaxJsonTypeNull, 4);
                         context->state = LaxJsonStateExpect;
-                        context->expected = "ull";
+                        context->expected = EXPECTED[2];
                         break;
                     default:
                         return LaxJsonErrorUnexpectedChar;
@@ -571,24 +1475,35 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
                 switch (c) {
                     case WHITESPACE:
                     case ',':
-                        /* ignore */
+                        SKIP_WHITESPACE();
                         break;
                     case '/':
                         context->state = LaxJsonStateCommentBegin;
                         PUSH_STATE(LaxJsonStateArray);
                         break;
                     case ']':
-                        if (context->end(context, LaxJsonTypeArray))
-                            return LaxJsonErrorAborted;
+                        EMIT_END(LaxJsonTypeArray);
                         pop_state(context);
                         break;
                     default:
+                        if (context->number_array && !token && !context->skip_index) {
+                            /* a run of numbers without going through the states */
+                            x = number_run(context, data, end);
+                            if (x < 0)
+                                return LaxJsonErrorAborted;
+                            if (x > 0) {
+                                advance_location(context, data + 1, x - 1);
+                                data += x - 1;
+                                continue;
+                            }
+                        }
                         context->state = LaxJsonStateValue;
                         PUSH_STATE(LaxJsonStateArray);
 
                         /* rewind 1 character */
                         data -= 1;
                         context->column -= 1;
+                        context->offset -= 1;
                         continue;
                 }
                 break;
@@ -603,13 +1518,14 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
                         break;
                     case NUMBER_TERMINATOR:
                         BUFFER_CHAR('\0');
-                        if (context->number(context, atof(context->value_buffer)))
-                            return LaxJsonErrorAborted;
+                        EMIT_NUMBER(context->value_buffer, context->value_buffer_index - 1,
+                                context->offset - 1);
                         pop_state(context);
 
                         /* rewind 1 */
                         data -= 1;
                         context->column -= 1;
+                        context->offset -= 1;
                         continue;
                     default:
                         return LaxJsonErrorUnexpectedChar;
@@ -622,7 +1538,7 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
                         break;
                     case 'e':
                     case 'E':
-                        BUFFER_CHAR('e');
+                        BUFFER_CHAR(c);
                         context->state = LaxJsonStateNumberExponentSign;
                         break;
                     case NUMBER_TERMINATOR:
@@ -630,6 +1546,7 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
                         /* rewind 1 */
                         data -= 1;
                         context->column -= 1;
+                        context->offset -= 1;
                         break;
                     default:
                         return LaxJsonErrorUnexpectedChar;
@@ -657,13 +1574,14 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
                     case '}':
                     case '/':
                         BUFFER_CHAR('\0');
-                        if (context->number(context, atof(context->value_buffer)))
-                            return LaxJsonErrorAborted;
+                        EMIT_NUMBER(context->value_buffer, context->value_buffer_index - 1,
+                                context->offset - 1);
                         pop_state(context);
 
                         /* rewind 1 */
                         data -= 1;
                         context->column -= 1;
+                        context->offset -= 1;
                         continue;
                     default:
                         return LaxJsonErrorUnexpectedChar;
@@ -707,10 +1625,189 @@ enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const
                 break;
         }
     }
+    *data_ptr = data;
     return err;
 }
 
-enum LaxJsonError lax_json_eof(struct LaxJsonContext *context) {
+/* Passes on the numbers still in the block at the end of a feed, including
+ * the ones before an error, which the number callback would already have
+ * seen. Returns err, or LaxJsonErrorAborted if there was none and
+ * number_array aborted. */
+static enum LaxJsonError end_feed(struct LaxJsonContext *context, enum LaxJsonError err) {
+    if (!context->number_count)
+        return err;
+    if (err == LaxJsonErrorAborted) {
+        context->number_count = 0;
+        return err;
+    }
+    if (flush_numbers(context) && !err)
+        return LaxJsonErrorAborted;
+    return err;
+}
+
+static enum LaxJsonError feed_block(struct LaxJsonContext *context, const char *data,
+        const char *end)
+{
+    return end_feed(context, feed(context, &data, end, NULL));
+}
+
+/* Reports a record that failed to the error callback and starts skipping
+ * the rest of it, or returns the error if it cannot be recovered from. */
+static enum LaxJsonError record_failed(struct LaxJsonContext *context, enum LaxJsonError err) {
+    if (err == LaxJsonErrorAborted || err == LaxJsonErrorNoMem)
+        return err;
+    context->bad_records += 1;
+    if (!context->error)
+        return err;
+    context->event_start = context->record_start;
+    context->event_end = context->offset;
+    if (context->error(context, err))
+        return LaxJsonErrorAborted;
+    context->recovering = 1;
+    return LaxJsonErrorNone;
+}
+
+/* Counts the record that just ended, unless it was blank, and prepares for
+ * the next one. */
+static enum LaxJsonError end_record(struct LaxJsonContext *context) {
+    enum LaxJsonError err = LaxJsonErrorNone;
+
+    if (!context->recovering && (context->state == LaxJsonStateNumber ||
+        context->state == LaxJsonStateNumberDecimal ||
+        context->state == LaxJsonStateNumberExponent))
+    {
+        /* a space ends a number at the end of the record, without moving
+         * the location. Other unfinished tokens, like a cut off literal, are
+         * an unexpected end, as at the end of a document. */
+        err = feed_block(context, " ", " " + 1);
+        context->offset -= 1;
+        context->column -= 1;
+        if (err && (err = record_failed(context, err)))
+            return err;
+    }
+    while (!context->recovering && context->state == LaxJsonStateCommentLine)
+        pop_state(context);
+    if (context->recovering) {
+        /* already reported */
+    } else if (context->state == LaxJsonStateEnd) {
+        context->good_records += 1;
+    } else if (context->state != LaxJsonStateValue || context->state_stack_index != 1) {
+        err = record_failed(context, LaxJsonErrorUnexpectedEof);
+    }
+    if (!err)
+        reset_parse_state(context);
+    return err;
+}
+
+static enum LaxJsonError feed_records(struct LaxJsonContext *context, const char *data,
+        const char *end)
+{
+    enum LaxJsonError err;
+    const char *stop;
+    int64_t start_offset;
+    int64_t consumed;
+
+    for (;;) {
+        stop = memchr(data, context->record_delimiter, end - data);
+        if (!stop)
+            stop = end;
+        if (context->recovering) {
+            advance_location(context, data, stop - data);
+        } else {
+            start_offset = context->offset;
+            if ((err = feed_block(context, data, stop))) {
+                if ((err = record_failed(context, err)))
+                    return err;
+                /* the parser stopped at the byte in error */
+                consumed = context->offset - start_offset;
+                if (consumed < stop - data)
+                    advance_location(context, data + consumed, stop - data - consumed);
+            }
+        }
+        if (stop == end)
+            return LaxJsonErrorNone;
+        if ((err = end_record(context)))
+            return err;
+        advance_location(context, stop, 1);
+        context->record_start = context->offset;
+        data = stop + 1;
+    }
+}
+
+enum LaxJsonError lax_json_feed(struct LaxJsonContext *context, int size, const char *data) {
+    if (context->record_delimiter)
+        return feed_records(context, data, data + size);
+    return feed_block(context, data, data + size);
+}
+
+enum LaxJsonError lax_json_feedv(struct LaxJsonContext *context, const struct iovec *iov,
+        int iovcnt)
+{
+    enum LaxJsonError err = LaxJsonErrorNone;
+    const char *data;
+    int i;
+
+    for (i = 0; i < iovcnt && !err; i += 1) {
+        data = iov[i].iov_base;
+        if (context->record_delimiter)
+            err = feed_records(context, data, data + iov[i].iov_len);
+        else
+            err = feed(context, &data, data + iov[i].iov_len, NULL);
+    }
+    if (context->record_delimiter)
+        return err;
+    return end_feed(context, err);
+}
+
+void lax_json_input(struct LaxJsonContext *context, int size, const char *data) {
+    context->input = data;
+    context->input_end = data + size;
+}
+
+enum LaxJsonError lax_json_next(struct LaxJsonContext *context, struct LaxJsonToken *token) {
+    token->kind = LaxJsonTokenNeedInput;
+    return feed(context, &context->input, context->input_end, token);
+}
+
+static int is_container_state(enum LaxJsonState state) {
+    switch (state) {
+        case LaxJsonStateObject:
+        case LaxJsonStateArray:
+        /* between a property and its value */
+        case LaxJsonStateBareProp:
+        case LaxJsonStateColon:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+void lax_json_skip(struct LaxJsonContext *context) {
+    int i = context->state_stack_index;
+    int rare = context->rare_state_count;
+    int code;
+
+    /* an array or object's own state is only on the stack while something
+     * inside it is being read */
+    if (!context->in_begin && !is_container_state(context->state)) {
+        for (;;) {
+            if (i == 0)
+                return;
+            i -= 1;
+            code = stack_code(context, i);
+            if (code == STACK_RARE) {
+                rare -= 1;
+                if (is_container_state(context->rare_states[rare]))
+                    break;
+            } else if (code != STACK_END) {
+                break;
+            }
+        }
+    }
+    context->skip_index = i + 1;
+}
+
+static enum LaxJsonError end_document(struct LaxJsonContext *context) {
     for (;;) {
         switch (context->state) {
             case LaxJsonStateEnd:
@@ -724,6 +1821,69 @@ enum LaxJsonError lax_json_eof(struct LaxJsonContext *context) {
     }
 }
 
+enum LaxJsonError lax_json_eof(struct LaxJsonContext *context) {
+    if (context->record_delimiter)
+        return end_record(context);
+    return end_document(context);
+}
+
+enum LaxJsonError lax_json_validate(struct LaxJsonContext *context, int size, const char *data) {
+    struct LaxJsonContext *own_context = NULL;
+    enum LaxJsonError err;
+
+    if (!context) {
+        own_context = context = lax_json_create();
+        if (!context)
+            return LaxJsonErrorNoMem;
+    }
+    /* the whole document is skipped: nothing is reported or buffered */
+    context->skip_index = SKIP_ALL;
+    err = feed(context, &data, data + size, NULL);
+    if (!err)
+        err = end_document(context);
+    context->skip_index = 0;
+    if (own_context)
+        lax_json_destroy(own_context);
+    return err;
+}
+
+enum LaxJsonError lax_json_number_to_double(const char *value, int length, double *out) {
+    char small[64];
+    char *copy = small;
+
+    /* value is not terminated, so only the others are copied for atof */
+    if (decode_simple_number(value, length, out))
+        return LaxJsonErrorNone;
+    if (length >= (int)sizeof(small) && !(copy = malloc(length + 1)))
+        return LaxJsonErrorNoMem;
+    memcpy(copy, value, length);
+    copy[length] = 0;
+    *out = atof(copy);
+    if (copy != small)
+        free(copy);
+    return LaxJsonErrorNone;
+}
+
+enum LaxJsonError lax_json_number_to_int64(const char *value, int length, int64_t *out) {
+    uint64_t limit = (uint64_t)INT64_MAX;
+    uint64_t x = 0;
+    int negative = length > 0 && value[0] == '-';
+    int i;
+
+    if (negative)
+        limit += 1;
+    for (i = negative; i < length; i += 1) {
+        if (value[i] < '0' || value[i] > '9')
+            return LaxJsonErrorTypeMismatch;
+        if (x > (limit - (value[i] - '0')) / 10)
+            return LaxJsonErrorTypeMismatch;
+        x = x * 10 + (value[i] - '0');
+    }
+    /* -(x - 1) - 1 so that INT64_MIN does not overflow */
+    *out = negative && x ? -(int64_t)(x - 1) - 1 : (int64_t)x;
+    return LaxJsonErrorNone;
+}
+
 const char *lax_json_str_err(enum LaxJsonError err) {
     switch (err) {
         case LaxJsonErrorNone: return "none";
@@ -737,6 +1897,255 @@ const char *lax_json_str_err(enum LaxJsonError err) {
         case LaxJsonErrorExpectedColon: return "expected colon";
         case LaxJsonErrorUnexpectedEof: return "unexpected end of file";
         case LaxJsonErrorAborted: return "aborted";
+        case LaxJsonErrorTypeMismatch: return "type mismatch";
+        case LaxJsonErrorArrayTooLong: return "array too long";
+        case LaxJsonErrorIo: return "input/output error";
+        case LaxJsonErrorInvalidCheckpoint: return "invalid checkpoint";
+        case LaxJsonErrorInvalidUtf8: return "invalid UTF-8";
+        case LaxJsonErrorInvalidIndex: return "invalid or out of date index";
+        case LaxJsonErrorNotFound: return "not found";
+        case LaxJsonErrorCompression: return "invalid or unsupported compressed data";
     }
     return "invalid error code";
 }
+
+/* Checkpoint layout, all integers little endian:
+ *   magic "LAXC", u32 version, u32 state, i32 line, i32 column, u64 offset,
+ *   u64 value start, u64 content hash,
+ *   u32 stack size, one byte per stacked state,
+ *   u32 buffer size, buffered bytes,
+ *   u32 unicode point, u32 unicode digit index, u32 high surrogate,
+ *   u8 UTF-8 validation state,
+ *   u32 expected literal (0 for none), u32 offset into it,
+ *   u8 delimiter, u8 string type, u64 hash of everything before it
+ */
+#define CHECKPOINT_MAGIC "LAXC"
+/* Bumped whenever the layout changes: 2 added the offset, 3 the high
+ * surrogate and UTF-8 state, 4 the value start and 5 the content hash. */
+#define CHECKPOINT_VERSION 5
+#define CHECKPOINT_FIXED_SIZE 83
+#define CHECKPOINT_SEED 0x6c61786370ULL
+
+static char *put_u32(char *p, uint32_t x) {
+    p[0] = x & 0xff;
+    p[1] = (x >> 8) & 0xff;
+    p[2] = (x >> 16) & 0xff;
+    p[3] = (x >> 24) & 0xff;
+    return p + 4;
+}
+
+static const char *get_u32(const char *p, uint32_t *x) {
+    const unsigned char *b = (const unsigned char *)p;
+    *x = b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+    return p + 4;
+}
+
+static char *put_u64(char *p, uint64_t x) {
+    p = put_u32(p, x & 0xffffffff);
+    return put_u32(p, x >> 32);
+}
+
+static const char *get_u64(const char *p, uint64_t *x) {
+    uint32_t lo, hi;
+    p = get_u32(p, &lo);
+    p = get_u32(p, &hi);
+    *x = lo | ((uint64_t)hi << 32);
+    return p;
+}
+
+/* The value buffer only holds live data while a string, property or number
+ * is being read. */
+static int state_uses_buffer(enum LaxJsonState state) {
+    switch (state) {
+        case LaxJsonStateString:
+        case LaxJsonStateStringEscape:
+        case LaxJsonStateUnicodeEscape:
+        case LaxJsonStateBareProp:
+        case LaxJsonStateNumber:
+        case LaxJsonStateNumberDecimal:
+        case LaxJsonStateNumberExponent:
+        case LaxJsonStateNumberExponentSign:
+        case LaxJsonStateSurrogateBackslash:
+        case LaxJsonStateSurrogateU:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int lax_json_checkpoint(const struct LaxJsonContext *context, char *buf, int size) {
+    int buffer_size = state_uses_buffer(context->state) ? context->value_buffer_index : 0;
+    int total = CHECKPOINT_FIXED_SIZE + context->state_stack_index + buffer_size;
+    uint32_t expected_id = 0;
+    uint32_t expected_offset = 0;
+    char *p = buf;
+    int rare = 0;
+    int code;
+    int i;
+
+    if (total > size)
+        return total;
+
+    if (context->state == LaxJsonStateExpect) {
+        for (i = 0; i < 3; i += 1) {
+            if (context->expected >= EXPECTED[i] &&
+                context->expected < EXPECTED[i] + strlen(EXPECTED[i]))
+            {
+                expected_id = i + 1;
+                expected_offset = context->expected - EXPECTED[i];
+            }
+        }
+    }
+
+    memcpy(p, CHECKPOINT_MAGIC, 4);
+    p = put_u32(p + 4, CHECKPOINT_VERSION);
+    p = put_u32(p, context->state);
+    p = put_u32(p, context->line);
+    p = put_u32(p, context->column);
+    p = put_u64(p, context->offset);
+    p = put_u64(p, context->value_start);
+    p = put_u64(p, context->content_hash);
+    p = put_u32(p, context->state_stack_index);
+    for (i = 0; i < context->state_stack_index; i += 1) {
+        code = stack_code(context, i);
+        *p++ = code == STACK_RARE ? context->rare_states[rare++] : STACK_STATES[code];
+    }
+    p = put_u32(p, buffer_size);
+    memcpy(p, context->value_buffer, buffer_size);
+    p += buffer_size;
+    p = put_u32(p, context->unicode_point);
+    p = put_u32(p, context->unicode_digit_index);
+    p = put_u32(p, context->unicode_high);
+    *p++ = context->utf8_state;
+    p = put_u32(p, expected_id);
+    p = put_u32(p, expected_offset);
+    *p++ = context->delim;
+    *p++ = context->string_type;
+    put_u64(p, lax_json_hash64(CHECKPOINT_SEED, buf, p - buf));
+    return total;
+}
+
+enum LaxJsonError lax_json_restore(struct LaxJsonContext *context, const char *buf, int size) {
+    const char *p = buf;
+    const char *end = buf + size;
+    uint32_t version, state, line, column, stack_size, buffer_size;
+    uint32_t unicode_point, unicode_digit_index, unicode_high, expected_id, expected_offset;
+    unsigned char utf8_state;
+    unsigned char *new_stack;
+    char *new_buffer;
+    uint64_t offset;
+    uint64_t value_start;
+    uint64_t content_hash;
+    uint64_t hash;
+    int new_size;
+    uint32_t rare;
+    uint32_t i;
+    enum LaxJsonError err;
+
+    if (size < CHECKPOINT_FIXED_SIZE || memcmp(p, CHECKPOINT_MAGIC, 4) != 0)
+        return LaxJsonErrorInvalidCheckpoint;
+    get_u64(end - 8, &hash);
+    if (hash != lax_json_hash64(CHECKPOINT_SEED, buf, size - 8))
+        return LaxJsonErrorInvalidCheckpoint;
+
+    p = get_u32(p + 4, &version);
+    p = get_u32(p, &state);
+    p = get_u32(p, &line);
+    p = get_u32(p, &column);
+    p = get_u64(p, &offset);
+    p = get_u64(p, &value_start);
+    p = get_u64(p, &content_hash);
+    p = get_u32(p, &stack_size);
+    if (version != CHECKPOINT_VERSION || state > LaxJsonStateSurrogateU ||
+        stack_size > (uint32_t)(size - CHECKPOINT_FIXED_SIZE))
+    {
+        return LaxJsonErrorInvalidCheckpoint;
+    }
+    /* only states that are pushed, and no more rare ones than fit */
+    rare = 0;
+    for (i = 0; i < stack_size; i += 1) {
+        switch ((unsigned char)p[i]) {
+            case LaxJsonStateObject:
+            case LaxJsonStateArray:
+            case LaxJsonStateEnd:
+                break;
+            case LaxJsonStateColon:
+            case LaxJsonStateValue:
+                rare += 1;
+                break;
+            default:
+                return LaxJsonErrorInvalidCheckpoint;
+        }
+    }
+    if (rare > RARE_STATE_COUNT)
+        return LaxJsonErrorInvalidCheckpoint;
+    get_u32(p + stack_size, &buffer_size);
+    if ((uint64_t)CHECKPOINT_FIXED_SIZE + stack_size + buffer_size != (uint64_t)size)
+        return LaxJsonErrorInvalidCheckpoint;
+    get_u32(end - 27, &unicode_digit_index);
+    utf8_state = end[-19];
+    get_u32(end - 18, &expected_id);
+    get_u32(end - 14, &expected_offset);
+    if ((state == LaxJsonStateUnicodeEscape && unicode_digit_index > 3) ||
+        utf8_state >= UTF8_REJECT || expected_id > 3 ||
+        (expected_id == 0) != (state != LaxJsonStateExpect) ||
+        (expected_id && expected_offset >= strlen(EXPECTED[expected_id - 1])))
+    {
+        return LaxJsonErrorInvalidCheckpoint;
+    }
+
+    /* everything is validated, so the context is only modified from here on */
+    if ((int)stack_size > context->max_state_stack_size)
+        return LaxJsonErrorExceededMaxStack;
+    if ((int)stack_size > context->state_stack_size) {
+        new_stack = realloc(context->state_stack,
+                ((size_t)stack_size + STACK_LEVELS_PER_BYTE - 1) / STACK_LEVELS_PER_BYTE);
+        if (!new_stack)
+            return LaxJsonErrorNoMem;
+        context->state_stack = new_stack;
+        context->state_stack_size = stack_size;
+    }
+    if ((int)buffer_size > context->value_buffer_size) {
+        if ((int)buffer_size > context->max_value_buffer_size)
+            return LaxJsonErrorExceededMaxValueSize;
+        new_size = context->value_buffer_size;
+        while (new_size < (int)buffer_size)
+            new_size += 16384;
+        new_buffer = realloc(context->value_buffer, new_size);
+        if (!new_buffer)
+            return LaxJsonErrorNoMem;
+        context->value_buffer = new_buffer;
+        context->value_buffer_size = new_size;
+    }
+
+    context->state_stack_index = 0;
+    context->rare_state_count = 0;
+    for (i = 0; i < stack_size; i += 1) {
+        err = push_state(context, (unsigned char)*p++);
+        if (err)
+            return err;
+    }
+    p += 4;
+    memcpy(context->value_buffer, p, buffer_size);
+    context->value_buffer_index = buffer_size;
+    p += buffer_size;
+    p = get_u32(p, &unicode_point);
+    p = get_u32(p, &unicode_digit_index);
+    p = get_u32(p, &unicode_high);
+    p += 1 + 8;
+
+    context->state = state;
+    context->line = line;
+    context->column = column;
+    context->offset = offset;
+    context->value_start = value_start;
+    context->content_hash = content_hash;
+    context->unicode_point = unicode_point;
+    context->unicode_digit_index = unicode_digit_index;
+    context->unicode_high = unicode_high;
+    context->utf8_state = utf8_state;
+    context->expected = expected_id ? EXPECTED[expected_id - 1] + expected_offset : NULL;
+    context->delim = p[0];
+    context->string_type = (unsigned char)p[1];
+    return LaxJsonErrorNone;
+}
@@ -0,0 +1,20 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#ifndef LAXJSON_INTERNAL_H_INCLUDED
+#define LAXJSON_INTERNAL_H_INCLUDED
+
+/* Declarations shared between the library's translation units. Not
+ * installed. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Fast non-cryptographic 64 bit hash. */
+uint64_t lax_json_hash64(uint64_t seed, const void *data, size_t size);
+
+#endif /* LAXJSON_INTERNAL_H_INCLUDED */
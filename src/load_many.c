@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "laxjson_document.h"
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+struct LoadPool {
+    const char *const *paths;
+    int count;
+    int (*init)(struct LaxJsonContext *context, int index, void *userdata);
+    void *userdata;
+    struct LaxJsonLoadResult *results;
+    atomic_int next;
+};
+
+struct LoadWorker {
+    struct LoadPool *pool;
+    struct LaxJsonContext *context;
+    char *buffer;
+    size_t buffer_size;
+};
+
+/* Reads the whole file into the worker's buffer, which is kept for the next
+ * file. */
+static enum LaxJsonError read_file(struct LoadWorker *worker, const char *path, int *size_out) {
+    struct stat st;
+    size_t total = 0;
+    ssize_t amt;
+    char *new_ptr;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return LaxJsonErrorIo;
+    if (fstat(fd, &st) || st.st_size > 0x7fffffff) {
+        close(fd);
+        return LaxJsonErrorIo;
+    }
+    if ((size_t)st.st_size > worker->buffer_size) {
+        new_ptr = realloc(worker->buffer, st.st_size);
+        if (!new_ptr) {
+            close(fd);
+            return LaxJsonErrorNoMem;
+        }
+        worker->buffer = new_ptr;
+        worker->buffer_size = st.st_size;
+    }
+    while (total < (size_t)st.st_size) {
+        amt = read(fd, worker->buffer + total, st.st_size - total);
+        if (amt <= 0) {
+            close(fd);
+            return LaxJsonErrorIo;
+        }
+        total += amt;
+    }
+    close(fd);
+    *size_out = total;
+    return LaxJsonErrorNone;
+}
+
+static void load_one(struct LoadWorker *worker, int index) {
+    struct LoadPool *pool = worker->pool;
+    struct LaxJsonLoadResult *result = &pool->results[index];
+    struct LaxJsonContext *context = worker->context;
+    int size;
+
+    lax_json_reset(context);
+    result->document = NULL;
+    result->line = 0;
+    result->column = 0;
+    if ((result->error = read_file(worker, pool->paths[index], &size)))
+        return;
+
+    if (pool->init) {
+        if (pool->init(context, index, pool->userdata)) {
+            result->error = LaxJsonErrorAborted;
+            return;
+        }
+        result->error = lax_json_feed(context, size, worker->buffer);
+        if (!result->error)
+            result->error = lax_json_eof(context);
+    } else {
+        result->error = lax_json_document_parse(context, size, worker->buffer, &result->document);
+    }
+    if (result->error) {
+        result->line = context->line;
+        result->column = context->column;
+    }
+}
+
+static void *worker_main(void *arg) {
+    struct LoadWorker *worker = arg;
+    struct LoadPool *pool = worker->pool;
+    int index;
+
+    while ((index = atomic_fetch_add(&pool->next, 1)) < pool->count)
+        load_one(worker, index);
+    return NULL;
+}
+
+enum LaxJsonError lax_json_load_many(const char *const *paths, int count, int threads,
+        int (*init)(struct LaxJsonContext *context, int index, void *userdata), void *userdata,
+        struct LaxJsonLoadResult *results)
+{
+    enum LaxJsonError err = LaxJsonErrorNone;
+    struct LoadPool pool;
+    struct LoadWorker *workers;
+    pthread_t *handles;
+    int started = 0;
+    int i;
+
+    if (threads <= 0)
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > count)
+        threads = count;
+    if (threads < 1)
+        threads = 1;
+
+    pool.paths = paths;
+    pool.count = count;
+    pool.init = init;
+    pool.userdata = userdata;
+    pool.results = results;
+    atomic_init(&pool.next, 0);
+
+    workers = calloc(threads, sizeof(struct LoadWorker));
+    handles = calloc(threads, sizeof(pthread_t));
+    if (!workers || !handles) {
+        free(workers);
+        free(handles);
+        return LaxJsonErrorNoMem;
+    }
+    for (i = 0; i < threads; i += 1) {
+        workers[i].pool = &pool;
+        workers[i].context = lax_json_create();
+        if (!workers[i].context) {
+            err = LaxJsonErrorNoMem;
+            goto cleanup;
+        }
+    }
+
+    /* the calling thread is the first worker */
+    for (started = 1; started < threads; started += 1) {
+        if (pthread_create(&handles[started], NULL, worker_main, &workers[started]))
+            break;
+    }
+    worker_main(&workers[0]);
+    for (i = 1; i < started; i += 1)
+        pthread_join(handles[i], NULL);
+
+cleanup:
+    for (i = 0; i < threads; i += 1) {
+        if (workers[i].context)
+            lax_json_destroy(workers[i].context);
+        free(workers[i].buffer);
+    }
+    free(workers);
+    free(handles);
+    return err;
+}
@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "laxjson_parallel.h"
+
+#include <stdlib.h>
+#include <pthread.h>
+
+/* smaller slices are not worth a thread */
+#define MIN_SLICE_SIZE 65536
+#define FEED_CHUNK_SIZE (1 << 30)
+
+/* The stack of a slice holds the end of the document and the top level
+ * array, so callbacks for top level elements happen at this depth. */
+#define ELEMENT_DEPTH 2
+
+static int skip_begin(struct LaxJsonContext *context, enum LaxJsonType type) {
+    return 0;
+}
+
+static int slice_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    struct LaxJsonParallelSlice *slice = context->userdata;
+    if (type == LaxJsonTypeString && context->state_stack_index == ELEMENT_DEPTH)
+        slice->element_count += 1;
+    return slice->string(context, type, value, length);
+}
+
+static int slice_raw_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    struct LaxJsonParallelSlice *slice = context->userdata;
+    if (type == LaxJsonTypeString && context->state_stack_index == ELEMENT_DEPTH)
+        slice->element_count += 1;
+    return slice->raw_string(context, type, value, length);
+}
+
+static int slice_number(struct LaxJsonContext *context, double x) {
+    struct LaxJsonParallelSlice *slice = context->userdata;
+    if (context->state_stack_index == ELEMENT_DEPTH)
+        slice->element_count += 1;
+    return slice->number(context, x);
+}
+
+static int slice_raw_number(struct LaxJsonContext *context, const char *value, int length,
+        int flags)
+{
+    struct LaxJsonParallelSlice *slice = context->userdata;
+    if (context->state_stack_index == ELEMENT_DEPTH)
+        slice->element_count += 1;
+    return slice->raw_number(context, value, length, flags);
+}
+
+/* A block is passed either from the array state itself or from a value in
+ * the array, whichever follows the numbers, so the array's depth is one
+ * more in the first case. */
+static int slice_number_array(struct LaxJsonContext *context, const double *values, int count) {
+    struct LaxJsonParallelSlice *slice = context->userdata;
+    if (context->state_stack_index + (context->state == LaxJsonStateArray) == ELEMENT_DEPTH)
+        slice->element_count += count;
+    return slice->number_array(context, values, count);
+}
+
+static int slice_primitive(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonParallelSlice *slice = context->userdata;
+    if (context->state_stack_index == ELEMENT_DEPTH)
+        slice->element_count += 1;
+    return slice->primitive(context, type);
+}
+
+static int slice_begin(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonParallelSlice *slice = context->userdata;
+    if (context->state_stack_index == ELEMENT_DEPTH)
+        slice->element_count += 1;
+    return slice->begin(context, type);
+}
+
+static int slice_end(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonParallelSlice *slice = context->userdata;
+    return slice->end(context, type);
+}
+
+static int is_whitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\f' || c == '\r' || c == 0xb;
+}
+
+/* Whether the value at pos follows a comma that is not inside a string or
+ * line comment begun on the same line. Strings and comments spanning lines
+ * are not detected; the validation of split points catches those. */
+static int looks_like_element(const char *data, size_t lower, size_t pos) {
+    size_t comma = pos;
+    size_t i;
+    char quote = 0;
+
+    do {
+        if (comma == lower)
+            return 0;
+        comma -= 1;
+    } while (is_whitespace(data[comma]));
+    if (data[comma] != ',')
+        return 0;
+
+    for (i = comma; i > lower && data[i - 1] != '\n'; i -= 1) {}
+    for (; i < comma; i += 1) {
+        if (quote) {
+            if (data[i] == '\\')
+                i += 1;
+            else if (data[i] == quote)
+                quote = 0;
+        } else if (data[i] == '"' || data[i] == '\'') {
+            quote = data[i];
+        } else if (data[i] == '/' && data[i + 1] == '/') {
+            return 0;
+        }
+    }
+    return !quote;
+}
+
+static int ends_token(char c) {
+    switch (c) {
+        case ',':
+        case ':':
+        case '[':
+        case ']':
+        case '{':
+        case '}':
+        case '"':
+        case '\'':
+        case '/':
+            return 1;
+        default:
+            return is_whitespace(c);
+    }
+}
+
+/* Whether the token at pos is followed by a colon, which makes it the name
+ * of an object member rather than an array element. */
+static int is_property_name(const char *data, size_t pos, size_t size) {
+    char quote = data[pos];
+
+    if (quote == '"' || quote == '\'') {
+        for (pos += 1; pos < size && data[pos] != quote && data[pos] != '\n'; pos += 1) {
+            if (data[pos] == '\\')
+                pos += 1;
+        }
+        pos += 1;
+    } else {
+        while (pos < size && !ends_token(data[pos]))
+            pos += 1;
+    }
+    while (pos < size && is_whitespace(data[pos]))
+        pos += 1;
+    return pos < size && data[pos] == ':';
+}
+
+/* Returns the first position at or after from that looks like the start of
+ * an array element, or size. After a comma, a scalar is either an element
+ * or the name of the next object member. */
+static size_t resync(const char *data, size_t lower, size_t from, size_t size) {
+    size_t pos;
+
+    for (pos = from; pos < size; pos += 1) {
+        switch (data[pos]) {
+            case '{':
+            case '[':
+                if (looks_like_element(data, lower, pos))
+                    return pos;
+                break;
+            default:
+                if (ends_token(data[pos]) && data[pos] != '"' && data[pos] != '\'')
+                    break;
+                if (looks_like_element(data, lower, pos) && !is_property_name(data, pos, size))
+                    return pos;
+                break;
+        }
+    }
+    return size;
+}
+
+static void *run_slice(void *arg) {
+    struct LaxJsonParallelSlice *slice = arg;
+    struct LaxJsonContext *context = slice->context;
+    enum LaxJsonError err = LaxJsonErrorNone;
+    size_t pos = slice->offset;
+    size_t end = slice->offset + slice->size;
+    size_t amt;
+
+    lax_json_reset(context);
+    slice->element_count = 0;
+    slice->first_element = 0;
+    if (slice->index > 0) {
+        /* enter the top level array without reporting it again */
+        context->begin = skip_begin;
+        lax_json_feed(context, 1, "[");
+        context->offset = slice->offset;
+    }
+    context->userdata = slice;
+    if (slice->init(context, slice, slice->init_userdata)) {
+        slice->error = LaxJsonErrorAborted;
+        return NULL;
+    }
+    slice->string = context->string;
+    slice->number = context->number;
+    slice->raw_number = context->raw_number;
+    slice->raw_string = context->raw_string;
+    slice->number_array = context->number_array;
+    slice->primitive = context->primitive;
+    slice->begin = context->begin;
+    slice->end = context->end;
+    context->userdata = slice;
+    context->string = slice_string;
+    context->number = slice_number;
+    if (slice->raw_number)
+        context->raw_number = slice_raw_number;
+    if (slice->raw_string)
+        context->raw_string = slice_raw_string;
+    if (slice->number_array)
+        context->number_array = slice_number_array;
+    context->primitive = slice_primitive;
+    context->begin = slice_begin;
+    context->end = slice_end;
+
+    while (pos < end && !err) {
+        amt = end - pos;
+        if (amt > FEED_CHUNK_SIZE)
+            amt = FEED_CHUNK_SIZE;
+        err = lax_json_feed(context, amt, slice->data + pos);
+        pos += amt;
+    }
+    if (!err && slice->index == slice->count - 1)
+        err = lax_json_eof(context);
+
+    /* the next slice assumed it starts at an element of the top level array */
+    slice->boundary_ok = slice->index == slice->count - 1 ||
+        (context->state == LaxJsonStateArray && context->state_stack_index == 1);
+    slice->error = err;
+    slice->line = context->line;
+    slice->column = context->column;
+    return NULL;
+}
+
+static void init_slice(struct LaxJsonParallelSlice *slice, int index, int count,
+        size_t start, size_t end, const char *data,
+        int (*init)(struct LaxJsonContext *, struct LaxJsonParallelSlice *, void *),
+        void *userdata)
+{
+    slice->userdata = NULL;
+    slice->index = index;
+    slice->count = count;
+    slice->offset = start;
+    slice->size = end - start;
+    slice->element_count = 0;
+    slice->first_element = 0;
+    slice->line = 0;
+    slice->column = 0;
+    slice->context = NULL;
+    slice->init = init;
+    slice->init_userdata = userdata;
+    slice->data = data;
+    slice->error = LaxJsonErrorNone;
+    slice->boundary_ok = 0;
+}
+
+/* Runs slices 1 to count - 1 on their own threads and slice 0 on the calling
+ * thread. *confirmed is set if every slice succeeded and every split point
+ * turned out to be between two top level elements. */
+static enum LaxJsonError run_speculative(struct LaxJsonParallelSlice *slices, int count,
+        int *confirmed)
+{
+    enum LaxJsonError err = LaxJsonErrorNone;
+    pthread_t *threads;
+    char *started;
+    int i;
+
+    *confirmed = 0;
+    threads = calloc(count, sizeof(pthread_t));
+    started = calloc(count, 1);
+    if (!threads || !started) {
+        free(threads);
+        free(started);
+        return LaxJsonErrorNoMem;
+    }
+    for (i = 0; i < count; i += 1) {
+        slices[i].context = lax_json_create();
+        if (!slices[i].context) {
+            err = LaxJsonErrorNoMem;
+            goto cleanup;
+        }
+    }
+
+    for (i = 1; i < count; i += 1)
+        started[i] = pthread_create(&threads[i], NULL, run_slice, &slices[i]) == 0;
+    run_slice(&slices[0]);
+    for (i = 1; i < count; i += 1) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            run_slice(&slices[i]);
+    }
+
+    *confirmed = 1;
+    for (i = 0; i < count; i += 1) {
+        if (slices[i].error == LaxJsonErrorAborted)
+            err = LaxJsonErrorAborted;
+        if (slices[i].error || !slices[i].boundary_ok)
+            *confirmed = 0;
+    }
+    if (*confirmed) {
+        for (i = 1; i < count; i += 1)
+            slices[i].first_element = slices[i - 1].first_element + slices[i - 1].element_count;
+    }
+
+cleanup:
+    for (i = 0; i < count; i += 1) {
+        if (slices[i].context)
+            lax_json_destroy(slices[i].context);
+        slices[i].context = NULL;
+    }
+    free(threads);
+    free(started);
+    return err;
+}
+
+enum LaxJsonError lax_json_parse_parallel(size_t size, const char *data, int max_slices,
+        int (*init)(struct LaxJsonContext *context, struct LaxJsonParallelSlice *slice,
+            void *userdata),
+        void *userdata, struct LaxJsonParallelSlice *slices, int *slice_count)
+{
+    enum LaxJsonError err;
+    size_t starts_at;
+    size_t guess;
+    int confirmed;
+    int count = 1;
+    int wanted;
+    int i;
+
+    wanted = max_slices;
+    if ((size_t)wanted > size / MIN_SLICE_SIZE)
+        wanted = size / MIN_SLICE_SIZE;
+
+    /* slice 0 starts at the beginning, the others at guessed elements */
+    for (i = 1; i < wanted; i += 1) {
+        guess = size / wanted * i;
+        starts_at = resync(data, (count > 1) ? slices[count - 1].offset : 0, guess, size);
+        if (starts_at >= size)
+            break;
+        if (count > 1 && starts_at <= slices[count - 1].offset)
+            continue;
+        slices[count].offset = starts_at;
+        count += 1;
+    }
+
+    if (count > 1) {
+        for (i = 0; i < count; i += 1) {
+            init_slice(&slices[i], i, count, (i == 0) ? 0 : slices[i].offset,
+                    (i + 1 < count) ? slices[i + 1].offset : size, data, init, userdata);
+        }
+        err = run_speculative(slices, count, &confirmed);
+        if (err)
+            return err;
+        if (confirmed) {
+            *slice_count = count;
+            return LaxJsonErrorNone;
+        }
+    }
+
+    /* parse everything as one slice on the calling thread */
+    *slice_count = 1;
+    init_slice(&slices[0], 0, 1, 0, size, data, init, userdata);
+    slices[0].context = lax_json_create();
+    if (!slices[0].context)
+        return LaxJsonErrorNoMem;
+    run_slice(&slices[0]);
+    lax_json_destroy(slices[0].context);
+    slices[0].context = NULL;
+    return slices[0].error;
+}
@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "laxjson.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef LAXJSON_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef LAXJSON_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define DEFAULT_BLOCK_SIZE 1048576
+#define DEFAULT_QUEUE_DEPTH 4
+#define COMPRESSED_READ_SIZE 131072
+
+/* block sizes other than a count of bytes */
+#define BLOCK_READ_ERROR -1
+#define BLOCK_BAD_DATA -2
+
+enum Compression {
+    CompressionNone,
+    CompressionGzip,
+    CompressionZstd
+};
+
+/* Single producer, single consumer ring of blocks. head counts the blocks
+ * filled by the reader thread and tail the blocks released by the parser.
+ * The size of a block is published by the release store of head. A size of
+ * 0 marks the end of the file, BLOCK_READ_ERROR a read error and
+ * BLOCK_BAD_DATA compressed data that could not be decompressed. */
+struct Ring {
+    int fd;
+    int block_size;
+    int queue_depth;
+    char *blocks;
+    int *sizes;
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_int stop;
+    /* written to when the parser stops, to wake a reader waiting on fd */
+    int wake[2];
+
+    /* fills a block on the reader thread and returns its size */
+    int (*fill)(struct Ring *ring, char *block);
+    /* compressed input read from fd but not yet decompressed */
+    char *in;
+    int in_eof;
+    /* the last compressed stream or frame ended */
+    int stream_done;
+#ifdef LAXJSON_HAVE_ZLIB
+    z_stream zlib;
+#endif
+#ifdef LAXJSON_HAVE_ZSTD
+    ZSTD_DStream *zstd;
+    ZSTD_inBuffer zstd_in;
+#endif
+};
+
+/* Spins briefly, then yields, then sleeps, so that a side waiting on slow
+ * storage does not keep a core busy. */
+static void backoff(int *spins) {
+    struct timespec ts;
+
+    *spins += 1;
+    if (*spins < 64)
+        return;
+    if (*spins < 256) {
+        sched_yield();
+        return;
+    }
+    ts.tv_sec = 0;
+    ts.tv_nsec = 50000;
+    nanosleep(&ts, NULL);
+}
+
+/* Waits for fd together with the wake pipe, so that a reader blocked on a
+ * pipe or socket returns as soon as the parser stops. Fails when it does. */
+static ssize_t read_some(struct Ring *ring, char *buf, size_t size) {
+    struct pollfd fds[2];
+    ssize_t amt;
+
+    fds[0].fd = ring->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = ring->wake[0];
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    for (;;) {
+        /* poll ignores a negative fd, which read then rejects */
+        if (ring->fd >= 0 && poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (fds[1].revents)
+            return -1;
+        amt = read(ring->fd, buf, size);
+        if (amt >= 0 || (errno != EINTR && errno != EAGAIN))
+            return amt;
+    }
+}
+
+/* Hands over what one read returns, which for a regular file is a whole
+ * block, so that the parser sees data from a pipe or socket as it comes
+ * instead of when a block fills. */
+static int fill_plain(struct Ring *ring, char *block) {
+    ssize_t amt = read_some(ring, block, ring->block_size);
+    return (amt < 0) ? BLOCK_READ_ERROR : (int)amt;
+}
+
+#ifdef LAXJSON_HAVE_ZLIB
+/* Decompresses gzip or zlib data, including several gzip members one after
+ * the other as written by appending to a .gz file. */
+static int fill_gzip(struct Ring *ring, char *block) {
+    z_stream *strm = &ring->zlib;
+    unsigned int before;
+    ssize_t amt;
+    int ret;
+
+    strm->next_out = (Bytef *)block;
+    strm->avail_out = ring->block_size;
+    while (strm->avail_out > 0) {
+        if (strm->avail_in == 0 && !ring->in_eof) {
+            amt = read_some(ring, ring->in, COMPRESSED_READ_SIZE);
+            if (amt < 0)
+                return BLOCK_READ_ERROR;
+            ring->in_eof = amt == 0;
+            strm->next_in = (Bytef *)ring->in;
+            strm->avail_in = amt;
+        }
+        if (ring->stream_done) {
+            if (strm->avail_in == 0)
+                break;
+            if (inflateReset(strm) != Z_OK)
+                return BLOCK_BAD_DATA;
+            ring->stream_done = 0;
+        }
+        before = strm->avail_out;
+        ret = inflate(strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END)
+            ring->stream_done = 1;
+        else if (ret != Z_OK && ret != Z_BUF_ERROR)
+            return BLOCK_BAD_DATA;
+        /* truncated */
+        if (ring->in_eof && !ring->stream_done && strm->avail_out == before)
+            return BLOCK_BAD_DATA;
+    }
+    return ring->block_size - strm->avail_out;
+}
+#endif
+
+#ifdef LAXJSON_HAVE_ZSTD
+static int fill_zstd(struct Ring *ring, char *block) {
+    ZSTD_inBuffer *in = &ring->zstd_in;
+    ZSTD_outBuffer out;
+    size_t before;
+    size_t ret;
+    ssize_t amt;
+
+    out.dst = block;
+    out.size = ring->block_size;
+    out.pos = 0;
+    while (out.pos < out.size) {
+        if (in->pos == in->size && !ring->in_eof) {
+            amt = read_some(ring, ring->in, COMPRESSED_READ_SIZE);
+            if (amt < 0)
+                return BLOCK_READ_ERROR;
+            ring->in_eof = amt == 0;
+            in->src = ring->in;
+            in->size = amt;
+            in->pos = 0;
+        }
+        if (ring->in_eof && ring->stream_done)
+            break;
+        before = out.pos;
+        ret = ZSTD_decompressStream(ring->zstd, &out, in);
+        if (ZSTD_isError(ret))
+            return BLOCK_BAD_DATA;
+        /* 0 once a frame is decoded and flushed; more frames may follow */
+        ring->stream_done = ret == 0;
+        if (ring->in_eof && !ring->stream_done && out.pos == before)
+            return BLOCK_BAD_DATA;
+    }
+    return out.pos;
+}
+#endif
+
+static void *reader_main(void *arg) {
+    struct Ring *ring = arg;
+    unsigned int head = 0;
+    int spins = 0;
+    char *block;
+    int size;
+
+    for (;;) {
+        while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) ==
+                (unsigned int)ring->queue_depth)
+        {
+            if (atomic_load_explicit(&ring->stop, memory_order_relaxed))
+                return NULL;
+            backoff(&spins);
+        }
+        spins = 0;
+
+        block = ring->blocks + (size_t)(head % ring->queue_depth) * ring->block_size;
+        size = ring->fill(ring, block);
+        ring->sizes[head % ring->queue_depth] = size;
+        head += 1;
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+        if (size <= 0)
+            return NULL;
+    }
+}
+
+/* Feeds the blocks filled by the reader thread to the parser. */
+static enum LaxJsonError run_ring(struct LaxJsonContext *context, struct Ring *ring) {
+    enum LaxJsonError err = LaxJsonErrorNone;
+    pthread_t thread;
+    unsigned int tail = 0;
+    int spins = 0;
+    int size;
+
+    ring->blocks = malloc((size_t)ring->block_size * ring->queue_depth);
+    ring->sizes = malloc(ring->queue_depth * sizeof(int));
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->stop, 0);
+    if (!ring->blocks || !ring->sizes) {
+        free(ring->blocks);
+        free(ring->sizes);
+        return LaxJsonErrorNoMem;
+    }
+    if (pipe(ring->wake)) {
+        free(ring->blocks);
+        free(ring->sizes);
+        return LaxJsonErrorIo;
+    }
+    if (pthread_create(&thread, NULL, reader_main, ring)) {
+        close(ring->wake[0]);
+        close(ring->wake[1]);
+        free(ring->blocks);
+        free(ring->sizes);
+        return LaxJsonErrorNoMem;
+    }
+
+    for (;;) {
+        while (tail == atomic_load_explicit(&ring->head, memory_order_acquire))
+            backoff(&spins);
+        spins = 0;
+
+        size = ring->sizes[tail % ring->queue_depth];
+        if (size <= 0) {
+            if (size == BLOCK_READ_ERROR)
+                err = LaxJsonErrorIo;
+            else if (size == BLOCK_BAD_DATA)
+                err = LaxJsonErrorCompression;
+            break;
+        }
+        /* the parser reads the block in place */
+        err = lax_json_feed(context, size,
+                ring->blocks + (size_t)(tail % ring->queue_depth) * ring->block_size);
+        tail += 1;
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        if (err)
+            break;
+    }
+
+    atomic_store_explicit(&ring->stop, 1, memory_order_relaxed);
+    /* the pipe is empty, so this cannot block */
+    (void)write(ring->wake[1], "", 1);
+    pthread_join(thread, NULL);
+    close(ring->wake[0]);
+    close(ring->wake[1]);
+    free(ring->blocks);
+    free(ring->sizes);
+    return err;
+}
+
+enum LaxJsonError lax_json_feed_fd(struct LaxJsonContext *context, int fd,
+        int block_size, int queue_depth)
+{
+    struct Ring ring;
+
+    ring.fd = fd;
+    ring.block_size = (block_size > 0) ? block_size : DEFAULT_BLOCK_SIZE;
+    ring.queue_depth = (queue_depth > 0) ? queue_depth : DEFAULT_QUEUE_DEPTH;
+    ring.fill = fill_plain;
+    return run_ring(context, &ring);
+}
+
+static enum Compression detect_compression(int fd) {
+    unsigned char magic[4];
+    ssize_t amt = pread(fd, magic, 4, 0);
+
+    if (amt >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return CompressionGzip;
+    if (amt == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+        return CompressionZstd;
+    return CompressionNone;
+}
+
+/* Decompresses while the calling thread parses. Fails with
+ * LaxJsonErrorCompression when support for the format is not built in. */
+static enum LaxJsonError feed_compressed(struct LaxJsonContext *context, int fd,
+        enum Compression compression)
+{
+    enum LaxJsonError err = LaxJsonErrorCompression;
+    struct Ring ring;
+
+    ring.fd = fd;
+    ring.block_size = DEFAULT_BLOCK_SIZE;
+    ring.queue_depth = DEFAULT_QUEUE_DEPTH;
+    ring.in_eof = 0;
+    ring.stream_done = 0;
+    ring.in = malloc(COMPRESSED_READ_SIZE);
+    if (!ring.in)
+        return LaxJsonErrorNoMem;
+
+#ifdef LAXJSON_HAVE_ZLIB
+    if (compression == CompressionGzip) {
+        memset(&ring.zlib, 0, sizeof(ring.zlib));
+        /* 32 accepts both gzip and zlib headers */
+        if (inflateInit2(&ring.zlib, 15 + 32) != Z_OK) {
+            free(ring.in);
+            return LaxJsonErrorNoMem;
+        }
+        ring.fill = fill_gzip;
+        err = run_ring(context, &ring);
+        inflateEnd(&ring.zlib);
+    }
+#endif
+#ifdef LAXJSON_HAVE_ZSTD
+    if (compression == CompressionZstd) {
+        ring.zstd = ZSTD_createDStream();
+        if (!ring.zstd || ZSTD_isError(ZSTD_initDStream(ring.zstd))) {
+            ZSTD_freeDStream(ring.zstd);
+            free(ring.in);
+            return LaxJsonErrorNoMem;
+        }
+        ring.zstd_in.src = ring.in;
+        ring.zstd_in.size = 0;
+        ring.zstd_in.pos = 0;
+        ring.fill = fill_zstd;
+        err = run_ring(context, &ring);
+        ZSTD_freeDStream(ring.zstd);
+    }
+#endif
+
+    free(ring.in);
+    return err;
+}
+
+enum LaxJsonError lax_json_parse_file(struct LaxJsonContext *context, const char *path) {
+    enum Compression compression;
+    enum LaxJsonError err;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return LaxJsonErrorIo;
+    compression = detect_compression(fd);
+    if (compression == CompressionNone)
+        err = lax_json_feed_fd(context, fd, 0, 0);
+    else
+        err = feed_compressed(context, fd, compression);
+    close(fd);
+    if (err)
+        return err;
+    return lax_json_eof(context);
+}
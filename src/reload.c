@@ -0,0 +1,385 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "laxjson_reload.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+/* how often old documents still in use are checked again, in milliseconds */
+#define RECLAIM_INTERVAL 100
+/* without inotify, how often the file is checked for changes */
+#define STAT_INTERVAL 1000
+
+/* The epoch a reader saw when it acquired the current document, or 0 while
+ * it holds none. Each slot fills a cache line so that readers do not slow
+ * each other down. */
+struct ReaderSlot {
+    atomic_uint_least64_t epoch;
+    atomic_int used;
+    char padding[64 - sizeof(atomic_uint_least64_t) - sizeof(atomic_int)];
+};
+
+/* A replaced document, freed once every reader has moved past epoch. */
+struct Retired {
+    struct LaxJsonDocument *doc;
+    uint64_t epoch;
+    struct Retired *next;
+};
+
+struct LaxJsonReloader {
+    _Atomic(struct LaxJsonDocument *) current;
+    /* incremented after each swap of current */
+    atomic_uint_least64_t epoch;
+    atomic_uint_least64_t generation;
+    struct ReaderSlot *slots;
+    int slot_count;
+
+    /* only touched by the background thread after create */
+    char *path;
+    struct LaxJsonContext *context;
+    struct Retired *retired;
+    void (*on_reload)(struct LaxJsonReloader *reloader, enum LaxJsonError err,
+            int line, int column, void *userdata);
+    void *userdata;
+    int notify_fd;
+    struct stat last_stat;
+
+    /* written by destroy to stop the background thread */
+    int stop_pipe[2];
+    pthread_t thread;
+};
+
+static enum LaxJsonError read_file(const char *path, char **out, int *size_out,
+        struct stat *st)
+{
+    size_t total = 0;
+    ssize_t amt;
+    char *buffer;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return LaxJsonErrorIo;
+    if (fstat(fd, st) || st->st_size > 0x7fffffff) {
+        close(fd);
+        return LaxJsonErrorIo;
+    }
+    buffer = malloc(st->st_size ? st->st_size : 1);
+    if (!buffer) {
+        close(fd);
+        return LaxJsonErrorNoMem;
+    }
+    while (total < (size_t)st->st_size) {
+        amt = read(fd, buffer + total, st->st_size - total);
+        if (amt <= 0) {
+            free(buffer);
+            close(fd);
+            return LaxJsonErrorIo;
+        }
+        total += amt;
+    }
+    close(fd);
+    *out = buffer;
+    *size_out = total;
+    return LaxJsonErrorNone;
+}
+
+static enum LaxJsonError parse_file(struct LaxJsonReloader *reloader,
+        struct LaxJsonContext *context, struct LaxJsonDocument **out)
+{
+    enum LaxJsonError err;
+    char *buffer;
+    int size;
+
+    if ((err = read_file(reloader->path, &buffer, &size, &reloader->last_stat)))
+        return err;
+    err = lax_json_document_parse(context, size, buffer, out);
+    free(buffer);
+    return err;
+}
+
+/* Frees the retired documents that no reader can still hold. A reader that
+ * acquired a document retired at epoch e announced an epoch of at most e
+ * before loading current, and keeps it until release. */
+static void reclaim(struct LaxJsonReloader *reloader) {
+    struct Retired **link = &reloader->retired;
+    struct Retired *retired;
+    uint64_t oldest = UINT64_MAX;
+    uint64_t epoch;
+    int i;
+
+    if (!reloader->retired)
+        return;
+    for (i = 0; i < reloader->slot_count; i += 1) {
+        epoch = atomic_load(&reloader->slots[i].epoch);
+        if (epoch && epoch < oldest)
+            oldest = epoch;
+    }
+    while ((retired = *link)) {
+        if (retired->epoch < oldest) {
+            *link = retired->next;
+            lax_json_document_destroy(retired->doc);
+            free(retired);
+        } else {
+            link = &retired->next;
+        }
+    }
+}
+
+static void reload(struct LaxJsonReloader *reloader) {
+    struct LaxJsonContext *context = reloader->context;
+    struct LaxJsonDocument *doc;
+    struct Retired *retired;
+    enum LaxJsonError err;
+
+    lax_json_reset(context);
+    retired = malloc(sizeof(struct Retired));
+    if (!retired) {
+        err = LaxJsonErrorNoMem;
+    } else if ((err = parse_file(reloader, context, &doc))) {
+        free(retired);
+    } else {
+        retired->doc = atomic_exchange(&reloader->current, doc);
+        retired->epoch = atomic_fetch_add(&reloader->epoch, 1);
+        retired->next = reloader->retired;
+        reloader->retired = retired;
+        atomic_fetch_add(&reloader->generation, 1);
+    }
+    if (reloader->on_reload) {
+        reloader->on_reload(reloader, err, err ? context->line : 0, err ? context->column : 0,
+                reloader->userdata);
+    }
+}
+
+#ifdef __linux__
+/* Whether the events name the watched file. The directory is watched so that
+ * a file replaced by a rename is noticed; only finished writes count. */
+static int read_events(struct LaxJsonReloader *reloader) {
+    union {
+        struct inotify_event event;
+        char bytes[4096];
+    } buffer;
+    const char *name = strrchr(reloader->path, '/');
+    const struct inotify_event *event;
+    ssize_t amt;
+    ssize_t i;
+    int changed = 0;
+
+    name = name ? name + 1 : reloader->path;
+    while ((amt = read(reloader->notify_fd, buffer.bytes, sizeof(buffer))) > 0) {
+        i = 0;
+        while (i < amt) {
+            event = (const struct inotify_event *)(buffer.bytes + i);
+            if (event->len && strcmp(event->name, name) == 0)
+                changed = 1;
+            i += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+
+static int start_watching(struct LaxJsonReloader *reloader) {
+    const char *slash = strrchr(reloader->path, '/');
+    char *dir;
+    int ok;
+
+    reloader->notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (reloader->notify_fd < 0)
+        return 0;
+    if (!slash) {
+        dir = strdup(".");
+    } else {
+        dir = strdup(reloader->path);
+        if (dir)
+            dir[slash == reloader->path ? 1 : slash - reloader->path] = 0;
+    }
+    if (!dir)
+        return 0;
+    ok = inotify_add_watch(reloader->notify_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) >= 0;
+    free(dir);
+    return ok;
+}
+#else
+static int start_watching(struct LaxJsonReloader *reloader) {
+    reloader->notify_fd = -1;
+    return 1;
+}
+
+/* Whether the file looks different from when it was last read. */
+static int stat_changed(struct LaxJsonReloader *reloader) {
+    struct stat st;
+
+    if (stat(reloader->path, &st))
+        return 0;
+    return st.st_ino != reloader->last_stat.st_ino || st.st_size != reloader->last_stat.st_size ||
+        st.st_mtime != reloader->last_stat.st_mtime;
+}
+#endif
+
+static void *watch_main(void *arg) {
+    struct LaxJsonReloader *reloader = arg;
+    struct pollfd fds[2];
+    int timeout;
+    int changed;
+
+    fds[0].fd = reloader->stop_pipe[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = reloader->notify_fd;
+    fds[1].events = POLLIN;
+    for (;;) {
+        if (reloader->notify_fd < 0)
+            timeout = reloader->retired ? RECLAIM_INTERVAL : STAT_INTERVAL;
+        else
+            timeout = reloader->retired ? RECLAIM_INTERVAL : -1;
+        if (poll(fds, reloader->notify_fd < 0 ? 1 : 2, timeout) < 0)
+            continue;
+        if (fds[0].revents)
+            break;
+#ifdef __linux__
+        changed = (fds[1].revents & POLLIN) && read_events(reloader);
+#else
+        changed = stat_changed(reloader);
+#endif
+        if (changed)
+            reload(reloader);
+        reclaim(reloader);
+    }
+    return NULL;
+}
+
+enum LaxJsonError lax_json_reloader_create(struct LaxJsonContext *context, const char *path,
+        int max_readers,
+        void (*on_reload)(struct LaxJsonReloader *reloader, enum LaxJsonError err,
+            int line, int column, void *userdata),
+        void *userdata, struct LaxJsonReloader **out)
+{
+    struct LaxJsonReloader *reloader;
+    struct LaxJsonDocument *doc;
+    enum LaxJsonError err;
+    void *slots;
+    int i;
+
+    reloader = calloc(1, sizeof(struct LaxJsonReloader));
+    if (!reloader)
+        return LaxJsonErrorNoMem;
+    reloader->notify_fd = -1;
+    reloader->stop_pipe[0] = -1;
+    reloader->stop_pipe[1] = -1;
+    reloader->on_reload = on_reload;
+    reloader->userdata = userdata;
+    reloader->slot_count = max_readers;
+    reloader->path = strdup(path);
+    reloader->context = lax_json_create();
+    if (!reloader->path || !reloader->context ||
+        posix_memalign(&slots, 64, (max_readers > 0 ? max_readers : 1) * sizeof(struct ReaderSlot)))
+    {
+        free(reloader->path);
+        lax_json_destroy(reloader->context);
+        free(reloader);
+        return LaxJsonErrorNoMem;
+    }
+    reloader->slots = slots;
+    for (i = 0; i < max_readers; i += 1) {
+        atomic_init(&reloader->slots[i].epoch, 0);
+        atomic_init(&reloader->slots[i].used, 0);
+    }
+    atomic_init(&reloader->epoch, 1);
+    atomic_init(&reloader->generation, 1);
+
+    err = parse_file(reloader, context ? context : reloader->context, &doc);
+    if (err) {
+        atomic_init(&reloader->current, NULL);
+        lax_json_reloader_destroy(reloader);
+        return err;
+    }
+    atomic_init(&reloader->current, doc);
+
+    if (!start_watching(reloader) || pipe(reloader->stop_pipe)) {
+        lax_json_reloader_destroy(reloader);
+        return LaxJsonErrorIo;
+    }
+    if (pthread_create(&reloader->thread, NULL, watch_main, reloader)) {
+        close(reloader->stop_pipe[1]);
+        reloader->stop_pipe[1] = -1;
+        lax_json_reloader_destroy(reloader);
+        return LaxJsonErrorNoMem;
+    }
+
+    *out = reloader;
+    return LaxJsonErrorNone;
+}
+
+void lax_json_reloader_destroy(struct LaxJsonReloader *reloader) {
+    struct Retired *retired;
+    char c = 0;
+
+    if (!reloader)
+        return;
+    if (reloader->stop_pipe[1] >= 0) {
+        if (write(reloader->stop_pipe[1], &c, 1) == 1)
+            pthread_join(reloader->thread, NULL);
+        close(reloader->stop_pipe[1]);
+    }
+    if (reloader->stop_pipe[0] >= 0)
+        close(reloader->stop_pipe[0]);
+    if (reloader->notify_fd >= 0)
+        close(reloader->notify_fd);
+    while ((retired = reloader->retired)) {
+        reloader->retired = retired->next;
+        lax_json_document_destroy(retired->doc);
+        free(retired);
+    }
+    if (atomic_load(&reloader->current))
+        lax_json_document_destroy(atomic_load(&reloader->current));
+    lax_json_destroy(reloader->context);
+    free(reloader->slots);
+    free(reloader->path);
+    free(reloader);
+}
+
+int lax_json_reloader_register(struct LaxJsonReloader *reloader) {
+    int expected;
+    int i;
+
+    for (i = 0; i < reloader->slot_count; i += 1) {
+        expected = 0;
+        if (atomic_compare_exchange_strong(&reloader->slots[i].used, &expected, 1))
+            return i;
+    }
+    return -1;
+}
+
+void lax_json_reloader_unregister(struct LaxJsonReloader *reloader, int slot) {
+    atomic_store_explicit(&reloader->slots[slot].used, 0, memory_order_release);
+}
+
+/* The announced epoch must be visible before current is loaded, and the
+ * background thread swaps current before advancing the epoch, so both sides
+ * use sequentially consistent operations. */
+const struct LaxJsonDocument *lax_json_reloader_acquire(struct LaxJsonReloader *reloader, int slot) {
+    atomic_store(&reloader->slots[slot].epoch, atomic_load(&reloader->epoch));
+    return atomic_load(&reloader->current);
+}
+
+void lax_json_reloader_release(struct LaxJsonReloader *reloader, int slot) {
+    atomic_store_explicit(&reloader->slots[slot].epoch, 0, memory_order_release);
+}
+
+uint64_t lax_json_reloader_generation(struct LaxJsonReloader *reloader) {
+    return atomic_load(&reloader->generation);
+}
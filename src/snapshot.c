@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+#include "laxjson_document.h"
+#include "laxjson_internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_MAGIC "LAXJSNP1"
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#define HASH_SEED 0x6c61786a736f6eULL
+
+struct SnapshotHeader {
+    char magic[8];
+    /* rejects snapshots written on a machine with another byte order */
+    uint32_t byte_order;
+    uint32_t header_size;
+    uint64_t path_hash;
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t source_hash;
+    uint64_t node_count;
+    uint64_t strings_size;
+};
+
+static void fill_key(struct SnapshotHeader *header, const char *path, const struct stat *st) {
+    memset(header, 0, sizeof(struct SnapshotHeader));
+    memcpy(header->magic, SNAPSHOT_MAGIC, 8);
+    header->byte_order = SNAPSHOT_BYTE_ORDER;
+    header->header_size = sizeof(struct SnapshotHeader);
+    header->path_hash = lax_json_hash64(HASH_SEED, path, strlen(path));
+    header->source_size = st->st_size;
+    header->source_mtime_sec = st->st_mtim.tv_sec;
+    header->source_mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+    const char *p = data;
+    ssize_t amt;
+    while (size > 0) {
+        amt = write(fd, p, size);
+        if (amt < 0)
+            return -1;
+        p += amt;
+        size -= amt;
+    }
+    return 0;
+}
+
+/* Writes to a temporary file first so that concurrent loaders never map a
+ * partially written snapshot. */
+static void write_snapshot(const struct LaxJsonDocument *doc, const char *cache_path,
+        const struct SnapshotHeader *key)
+{
+    struct SnapshotHeader header = *key;
+    char *tmp_path;
+    int fd;
+    int failed;
+
+    tmp_path = malloc(strlen(cache_path) + 32);
+    if (!tmp_path)
+        return;
+    sprintf(tmp_path, "%s.%ld.tmp", cache_path, (long)getpid());
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(tmp_path);
+        return;
+    }
+    header.node_count = doc->node_count;
+    header.strings_size = doc->strings_size;
+    failed = write_all(fd, &header, sizeof(header)) ||
+        write_all(fd, doc->nodes, doc->node_count * sizeof(struct LaxJsonNode)) ||
+        write_all(fd, doc->strings, doc->strings_size);
+    failed = close(fd) || failed;
+    if (failed || rename(tmp_path, cache_path))
+        unlink(tmp_path);
+    free(tmp_path);
+}
+
+static enum LaxJsonError read_source(int fd, size_t size, char **out) {
+    char *data = malloc(size ? size : 1);
+    size_t total = 0;
+    ssize_t amt;
+
+    if (!data)
+        return LaxJsonErrorNoMem;
+    while (total < size) {
+        amt = read(fd, data + total, size - total);
+        if (amt <= 0) {
+            free(data);
+            return LaxJsonErrorIo;
+        }
+        total += amt;
+    }
+    *out = data;
+    return LaxJsonErrorNone;
+}
+
+/* a container being checked by check_nodes */
+struct NodeFrame {
+    /* index of the node after the container */
+    uint64_t end;
+    /* members not yet seen */
+    uint32_t remaining;
+    uint32_t type;
+};
+
+static int check_string(const struct LaxJsonNode *node, const char *strings, uint64_t strings_size) {
+    return node->u.offset < strings_size && node->size < strings_size - node->u.offset &&
+        strings[node->u.offset + node->size] == 0;
+}
+
+/* Checks that nodes hold one value laid out as lax_json_document_parse lays
+ * it out, with every string inside the pool, so that walking a corrupted
+ * snapshot cannot leave the mapping. */
+static int check_nodes(const struct LaxJsonNode *nodes, uint64_t count,
+        const char *strings, uint64_t strings_size)
+{
+    struct NodeFrame *frames = NULL;
+    struct NodeFrame *new_ptr;
+    struct NodeFrame *top = NULL;
+    size_t frame_count = 0;
+    size_t frame_size = 0;
+    uint64_t end;
+    uint64_t i = 0;
+    int ok = 0;
+
+    for (;;) {
+        top = frame_count ? &frames[frame_count - 1] : NULL;
+        end = top ? top->end : count;
+        if (top && top->remaining == 0) {
+            if (i != end)
+                goto done;
+            frame_count -= 1;
+            continue;
+        }
+        if (!top && i > 0) {
+            ok = i == count;
+            goto done;
+        }
+        if (top && top->type == LaxJsonTypeObject) {
+            if (i >= end || nodes[i].type != LaxJsonTypeProperty ||
+                !check_string(&nodes[i], strings, strings_size))
+            {
+                goto done;
+            }
+            i += 1;
+        }
+        if (i >= end)
+            goto done;
+        if (top)
+            top->remaining -= 1;
+        switch (nodes[i].type) {
+            case LaxJsonTypeString:
+                if (!check_string(&nodes[i], strings, strings_size))
+                    goto done;
+                break;
+            case LaxJsonTypeNumber:
+            case LaxJsonTypeTrue:
+            case LaxJsonTypeFalse:
+            case LaxJsonTypeNull:
+                break;
+            case LaxJsonTypeArray:
+            case LaxJsonTypeObject:
+                if (nodes[i].u.next <= i || nodes[i].u.next > end)
+                    goto done;
+                if (frame_count >= frame_size) {
+                    frame_size = frame_size ? frame_size * 2 : 64;
+                    new_ptr = realloc(frames, frame_size * sizeof(struct NodeFrame));
+                    if (!new_ptr)
+                        goto done;
+                    frames = new_ptr;
+                }
+                frames[frame_count].end = nodes[i].u.next;
+                frames[frame_count].remaining = nodes[i].size;
+                frames[frame_count].type = nodes[i].type;
+                frame_count += 1;
+                break;
+            default:
+                goto done;
+        }
+        i += 1;
+    }
+
+done:
+    free(frames);
+    return ok;
+}
+
+/* Maps cache_path if it holds a snapshot of the source described by key.
+ * Source content is only read and hashed when the modification time
+ * differs, in which case *source is set so that it is not read twice. */
+static struct LaxJsonDocument *map_snapshot(const char *cache_path, struct SnapshotHeader *key,
+        int source_fd, char **source)
+{
+    struct LaxJsonDocument *doc;
+    struct SnapshotHeader *header;
+    const struct LaxJsonNode *nodes;
+    struct stat st;
+    void *map;
+    int write_fd;
+    int fd;
+
+    fd = open(cache_path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct SnapshotHeader)) {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    header = map;
+
+    if (memcmp(header->magic, key->magic, 8) != 0 ||
+        header->byte_order != key->byte_order ||
+        header->header_size != key->header_size ||
+        header->path_hash != key->path_hash ||
+        header->source_size != key->source_size ||
+        header->node_count == 0 ||
+        header->node_count > (st.st_size - sizeof(struct SnapshotHeader)) / sizeof(struct LaxJsonNode) ||
+        header->strings_size != st.st_size - sizeof(struct SnapshotHeader) -
+            header->node_count * sizeof(struct LaxJsonNode))
+    {
+        goto invalid;
+    }
+    nodes = (const struct LaxJsonNode *)(header + 1);
+    if (!check_nodes(nodes, header->node_count, (const char *)(nodes + header->node_count),
+                header->strings_size))
+    {
+        goto invalid;
+    }
+
+    if (header->source_mtime_sec != key->source_mtime_sec ||
+        header->source_mtime_nsec != key->source_mtime_nsec)
+    {
+        /* touched but possibly unchanged, so compare content */
+        if (read_source(source_fd, key->source_size, source))
+            goto invalid;
+        key->source_hash = lax_json_hash64(HASH_SEED, *source, key->source_size);
+        if (header->source_hash != key->source_hash)
+            goto invalid;
+        /* record the new time so the next load takes the fast path. if this
+         * fails the snapshot is still valid, it will just be hashed again. */
+        if ((write_fd = open(cache_path, O_WRONLY)) >= 0) {
+            (void)pwrite(write_fd, (const char *)key + offsetof(struct SnapshotHeader, source_mtime_sec),
+                    2 * sizeof(int64_t), offsetof(struct SnapshotHeader, source_mtime_sec));
+            close(write_fd);
+        }
+    }
+    close(fd);
+
+    doc = calloc(1, sizeof(struct LaxJsonDocument));
+    if (!doc) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    doc->map = map;
+    doc->map_size = st.st_size;
+    doc->nodes = nodes;
+    doc->node_count = header->node_count;
+    doc->strings = (const char *)(doc->nodes + doc->node_count);
+    doc->strings_size = header->strings_size;
+    return doc;
+
+invalid:
+    munmap(map, st.st_size);
+    close(fd);
+    return NULL;
+}
+
+enum LaxJsonError lax_json_snapshot_load(const char *path, const char *cache_path,
+        struct LaxJsonDocument **out)
+{
+    struct SnapshotHeader key;
+    struct stat st;
+    enum LaxJsonError err;
+    char *source = NULL;
+    int fd;
+
+    *out = NULL;
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return LaxJsonErrorIo;
+    if (fstat(fd, &st) || st.st_size > 0x7fffffff) {
+        close(fd);
+        return LaxJsonErrorIo;
+    }
+    fill_key(&key, path, &st);
+
+    if ((*out = map_snapshot(cache_path, &key, fd, &source))) {
+        free(source);
+        close(fd);
+        return LaxJsonErrorNone;
+    }
+
+    if (!source && (err = read_source(fd, st.st_size, &source))) {
+        close(fd);
+        return err;
+    }
+    close(fd);
+
+    key.source_hash = lax_json_hash64(HASH_SEED, source, st.st_size);
+    err = lax_json_document_parse(NULL, st.st_size, source, out);
+    free(source);
+    if (err)
+        return err;
+
+    write_snapshot(*out, cache_path, &key);
+    return LaxJsonErrorNone;
+}
@@ -0,0 +1,167 @@
+#include <laxjson_bind.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+struct Limit {
+    const char *name;
+    int max;
+    double ratio;
+};
+
+struct Server {
+    const char *host;
+    int port;
+    int debug;
+    long long max_bytes;
+    struct Limit primary;
+    struct Limit limits[4];
+    int limit_count;
+    int *ports;
+    int port_count;
+};
+
+static const struct LaxJsonBindField LIMIT_FIELDS[] = {
+    LAX_JSON_BIND_STRING("name", struct Limit, name, "unnamed"),
+    LAX_JSON_BIND_NUMBER("max", LaxJsonBindInt, struct Limit, max, 10),
+    LAX_JSON_BIND_NUMBER("ratio", LaxJsonBindDouble, struct Limit, ratio, 0.5),
+};
+
+static const struct LaxJsonBindStruct LIMIT = {
+    sizeof(struct Limit), 3, LIMIT_FIELDS
+};
+
+static const struct LaxJsonBindField SERVER_FIELDS[] = {
+    LAX_JSON_BIND_STRING("host", struct Server, host, "localhost"),
+    LAX_JSON_BIND_NUMBER("port", LaxJsonBindInt, struct Server, port, 80),
+    LAX_JSON_BIND_NUMBER("debug", LaxJsonBindBool, struct Server, debug, 0),
+    LAX_JSON_BIND_NUMBER("max_bytes", LaxJsonBindInt64, struct Server, max_bytes, 0),
+    LAX_JSON_BIND_STRUCT("primary", struct Server, primary, &LIMIT),
+    LAX_JSON_BIND_ARRAY("limits", LaxJsonBindStruct, &LIMIT, struct Server, limits, limit_count, 4),
+    LAX_JSON_BIND_ARRAY("ports", LaxJsonBindInt, NULL, struct Server, ports, port_count, 0),
+};
+
+static const struct LaxJsonBindStruct SERVER = {
+    sizeof(struct Server), 7, SERVER_FIELDS
+};
+
+static void fail(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static enum LaxJsonError bind(struct LaxJsonBindSchema *schema, struct Server *server,
+        const char *input, struct LaxJsonBinder **out)
+{
+    struct LaxJsonBinder *binder = lax_json_bind_create(schema, server);
+    enum LaxJsonError err;
+
+    if (!binder)
+        fail("out of memory");
+    *out = binder;
+    err = lax_json_bind_feed(binder, strlen(input), input);
+    if (err)
+        return err;
+    return lax_json_bind_eof(binder);
+}
+
+static void test_defaults(struct LaxJsonBindSchema *schema) {
+    struct LaxJsonBinder *binder;
+    struct Server server;
+
+    if (bind(schema, &server, "{ unknown: [1, {a: 2}], port: null }", &binder))
+        fail("unexpected error");
+    if (strcmp(server.host, "localhost") != 0 || server.port != 80 || server.debug != 0)
+        fail("defaults not applied");
+    if (strcmp(server.primary.name, "unnamed") != 0 || server.primary.max != 10)
+        fail("nested defaults not applied");
+    if (server.limit_count != 0 || server.port_count != 0 || server.ports != NULL)
+        fail("arrays not emptied");
+    lax_json_bind_destroy(binder);
+}
+
+static void test_values(struct LaxJsonBindSchema *schema) {
+    struct LaxJsonBinder *binder;
+    struct Server server;
+    int i;
+
+    if (bind(schema, &server,
+            "// lax config\n"
+            "{\n"
+            "  host: 'example.com',\n"
+            "  port: 8080,\n"
+            "  debug: true,\n"
+            "  max_bytes: 10000000000,\n"
+            "  primary: { name: 'cpu', max: 4 },\n"
+            "  limits: [ { name: 'a', ratio: 0.25 }, { max: 7 }, ],\n"
+            "  ports: [1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12],\n"
+            "}\n", &binder))
+    {
+        fail("unexpected error");
+    }
+    if (strcmp(server.host, "example.com") != 0 || server.port != 8080 || server.debug != 1)
+        fail("scalar fields not bound");
+    if (server.max_bytes != 10000000000LL)
+        fail("int64 field not bound");
+    if (strcmp(server.primary.name, "cpu") != 0 || server.primary.max != 4 ||
+        server.primary.ratio != 0.5)
+    {
+        fail("nested struct not bound");
+    }
+    if (server.limit_count != 2 || strcmp(server.limits[0].name, "a") != 0 ||
+        server.limits[0].ratio != 0.25 || server.limits[0].max != 10 ||
+        strcmp(server.limits[1].name, "unnamed") != 0 || server.limits[1].max != 7)
+    {
+        fail("struct array not bound");
+    }
+    if (server.port_count != 12)
+        fail("arena array count wrong");
+    for (i = 0; i < 12; i += 1) {
+        if (server.ports[i] != i + 1)
+            fail("arena array element wrong");
+    }
+    lax_json_bind_destroy(binder);
+}
+
+static void test_errors(struct LaxJsonBindSchema *schema) {
+    struct LaxJsonBinder *binder;
+    struct Server server;
+
+    if (bind(schema, &server, "{ port: 'eighty' }", &binder) != LaxJsonErrorTypeMismatch)
+        fail("expected type mismatch");
+    lax_json_bind_destroy(binder);
+
+    if (bind(schema, &server, "{ port: 80.5 }", &binder) != LaxJsonErrorTypeMismatch)
+        fail("expected fraction mismatch");
+    lax_json_bind_destroy(binder);
+
+    if (bind(schema, &server, "{ limits: [{}, {}, {}, {}, {}] }", &binder) != LaxJsonErrorArrayTooLong)
+        fail("expected array too long");
+    lax_json_bind_destroy(binder);
+
+    if (bind(schema, &server, "[]", &binder) != LaxJsonErrorTypeMismatch)
+        fail("expected root type mismatch");
+    lax_json_bind_destroy(binder);
+}
+
+int main(int argc, char *argv[]) {
+    struct LaxJsonBindSchema *schema = lax_json_bind_schema_create(&SERVER);
+
+    if (!schema)
+        fail("out of memory");
+
+    fprintf(stderr, "testing defaults...");
+    test_defaults(schema);
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing values...");
+    test_values(schema);
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing errors...");
+    test_errors(schema);
+    fprintf(stderr, "OK\n");
+
+    lax_json_bind_schema_destroy(schema);
+    return 0;
+}
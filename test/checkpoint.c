@@ -0,0 +1,185 @@
+#include <laxjson.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+static char out_buf[16384];
+static int out_buf_index;
+
+static const char *input =
+    "// header\n"
+    "{\n"
+    "  name: 'checkpoint \\u00e9\\u4e2d',\n"
+    "  \"escaped\\n\": [1, -2.5e+3, 3.25, true, false, null, /* note */ ],\n"
+    "  nested: { a: { b: [ [], {}, 'x' ] } },\n"
+    "  last: 123456789,\n"
+    "}\n"
+    "/* trailer */\n";
+
+static void fail(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    out_buf_index += snprintf(&out_buf[out_buf_index], 64, "%d:", type);
+    memcpy(&out_buf[out_buf_index], value, length);
+    out_buf_index += length;
+    out_buf[out_buf_index++] = '\n';
+    return 0;
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    out_buf_index += snprintf(&out_buf[out_buf_index], 64, "number %g\n", x);
+    return 0;
+}
+
+static int on_type(struct LaxJsonContext *context, enum LaxJsonType type) {
+    out_buf_index += snprintf(&out_buf[out_buf_index], 64, "type %d\n", type);
+    return 0;
+}
+
+static uint64_t content_hash;
+
+static struct LaxJsonContext *create(void) {
+    struct LaxJsonContext *context = lax_json_create();
+    if (!context)
+        fail("out of memory");
+    context->string = on_string;
+    context->number = on_number;
+    context->primitive = on_type;
+    context->begin = on_type;
+    context->end = on_type;
+    context->hash_content = 1;
+    return context;
+}
+
+/* Feeds the input up to split, moves the parse to a new context through a
+ * checkpoint and feeds the rest there. */
+static void parse_split(int split, char **blob_out, int *blob_size) {
+    struct LaxJsonContext *context = create();
+    struct LaxJsonContext *resumed = create();
+    int size = strlen(input);
+    char *blob;
+    int blob_len;
+
+    if (lax_json_feed(context, split, input))
+        fail("unexpected error before checkpoint");
+    blob_len = lax_json_checkpoint(context, NULL, 0);
+    blob = malloc(blob_len);
+    if (lax_json_checkpoint(context, blob, blob_len) != blob_len)
+        fail("checkpoint size changed");
+    lax_json_destroy(context);
+
+    if (lax_json_restore(resumed, blob, blob_len))
+        fail("restore failed");
+    if (lax_json_feed(resumed, size - split, input + split) || lax_json_eof(resumed))
+        fail("unexpected error after restore");
+    if (resumed->line != 9 || resumed->column != 0 || resumed->offset != size)
+        fail("location not restored");
+    content_hash = resumed->content_hash;
+    lax_json_destroy(resumed);
+
+    *blob_out = blob;
+    *blob_size = blob_len;
+}
+
+static void test_every_split(void) {
+    char expected[16384];
+    int expected_size;
+    uint64_t expected_hash;
+    char *blob;
+    int blob_size;
+    int split;
+
+    out_buf_index = 0;
+    parse_split(0, &blob, &blob_size);
+    free(blob);
+    memcpy(expected, out_buf, out_buf_index);
+    expected_size = out_buf_index;
+    expected_hash = content_hash;
+
+    for (split = 1; split <= (int)strlen(input); split += 1) {
+        out_buf_index = 0;
+        parse_split(split, &blob, &blob_size);
+        free(blob);
+        if (out_buf_index != expected_size || memcmp(out_buf, expected, expected_size) != 0) {
+            fprintf(stderr, "split at %d: ", split);
+            fail("events differ");
+        }
+        if (content_hash != expected_hash) {
+            fprintf(stderr, "split at %d: ", split);
+            fail("content hash differs");
+        }
+    }
+}
+
+static void test_invalid(void) {
+    struct LaxJsonContext *context = create();
+    char *blob;
+    int blob_size;
+
+    out_buf_index = 0;
+    parse_split(40, &blob, &blob_size);
+
+    if (lax_json_restore(context, blob, blob_size - 1) != LaxJsonErrorInvalidCheckpoint)
+        fail("truncated checkpoint accepted");
+    blob[20] ^= 1;
+    if (lax_json_restore(context, blob, blob_size) != LaxJsonErrorInvalidCheckpoint)
+        fail("corrupted checkpoint accepted");
+    if (lax_json_restore(context, "LAXC", 4) != LaxJsonErrorInvalidCheckpoint)
+        fail("short checkpoint accepted");
+
+    /* a failed restore leaves the context untouched */
+    if (lax_json_feed(context, 7, "[1, 2] ") || lax_json_eof(context))
+        fail("context modified by failed restore");
+
+    free(blob);
+    lax_json_destroy(context);
+}
+
+static void test_too_deep(void) {
+    struct LaxJsonContext *context = create();
+    struct LaxJsonContext *small = create();
+    char deep[20];
+    char *blob;
+    int blob_size;
+
+    memset(deep, '[', sizeof(deep));
+    if (lax_json_feed(context, sizeof(deep), deep))
+        fail("deep feed failed");
+    blob_size = lax_json_checkpoint(context, NULL, 0);
+    blob = malloc(blob_size);
+    if (!blob)
+        fail("out of memory");
+    lax_json_checkpoint(context, blob, blob_size);
+
+    /* deeper than the limit, though the allocated stack would hold it */
+    small->max_state_stack_size = 8;
+    if (lax_json_restore(small, blob, blob_size) != LaxJsonErrorExceededMaxStack)
+        fail("checkpoint deeper than the limit accepted");
+    if (lax_json_feed(small, 7, "[1, 2] ") || lax_json_eof(small))
+        fail("context modified by failed restore");
+
+    free(blob);
+    lax_json_destroy(small);
+    lax_json_destroy(context);
+}
+
+int main(int argc, char *argv[]) {
+    fprintf(stderr, "testing checkpoint at every offset...");
+    test_every_split();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing invalid checkpoints...");
+    test_invalid();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing checkpoint deeper than the limit...");
+    test_too_deep();
+    fprintf(stderr, "OK\n");
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include "server_parser.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+static void fail(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static enum LaxJsonError parse(struct server *server, const char *input) {
+    return server_parse(server, strlen(input), input);
+}
+
+static void test_defaults(void) {
+    struct server server;
+
+    if (parse(&server, "{ unknown: [1, {a: 2}], port: null }"))
+        fail("unexpected error");
+    if (strcmp(server.host, "localhost") != 0 || server.port != 80 || server.debug != 0)
+        fail("defaults not applied");
+    if (strcmp(server.primary.name, "unnamed") != 0 || server.primary.max != 10)
+        fail("nested defaults not applied");
+    if (server.limits_count != 0 || server.ports != NULL)
+        fail("arrays not empty");
+    server_free(&server);
+}
+
+static void test_values(void) {
+    struct server server;
+    int i;
+
+    if (parse(&server,
+            "// lax config\n"
+            "{\n"
+            "  host: 'example.com',\n"
+            "  port: 8080,\n"
+            "  debug: true,\n"
+            "  'max-bytes': 10000000000,\n"
+            "  primary: { name: 'cpu', max: 4 },\n"
+            "  limits: [ { name: 'a', ratio: 0.25 }, { max: 7 }, null ],\n"
+            "  ports: [1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12],\n"
+            "  tags: ['x', 'y'],\n"
+            "  host: 'duplicate.com',\n"
+            "}\n"))
+    {
+        fail("unexpected error");
+    }
+    if (strcmp(server.host, "duplicate.com") != 0 || server.port != 8080 || server.debug != 1)
+        fail("scalar fields not bound");
+    if (server.max_bytes != 10000000000LL)
+        fail("renamed int64 field not bound");
+    if (strcmp(server.primary.name, "cpu") != 0 || server.primary.max != 4 ||
+        server.primary.ratio != 0.5)
+    {
+        fail("nested struct not bound");
+    }
+    if (server.limits_count != 3 || strcmp(server.limits[0].name, "a") != 0 ||
+        server.limits[0].ratio != 0.25 || server.limits[0].max != 10 ||
+        strcmp(server.limits[1].name, "unnamed") != 0 || server.limits[1].max != 7 ||
+        server.limits[2].max != 10)
+    {
+        fail("struct array not bound");
+    }
+    if (server.ports_count != 12)
+        fail("int array count wrong");
+    for (i = 0; i < 12; i += 1) {
+        if (server.ports[i] != i + 1)
+            fail("int array element wrong");
+    }
+    if (server.tags_count != 2 || strcmp(server.tags[0], "x") != 0 || strcmp(server.tags[1], "y") != 0)
+        fail("string array not bound");
+    server_free(&server);
+}
+
+static void test_split_feed(void) {
+    const char *input = "{ host: 'split.example', port: 8081, 'max-bytes': 123456789012,\n"
+        "  tags: ['first', \"sec\\u006fnd\"], primary: { ratio: 1.5e+2 } }";
+    struct server server;
+    struct server_parser *parser = server_parser_create(&server);
+    int i;
+
+    /* strings and numbers cut by feed boundaries are copied before they
+     * reach the generated callbacks */
+    if (!parser)
+        fail("out of memory");
+    for (i = 0; input[i]; i += 1) {
+        if (server_parser_feed(parser, 1, input + i))
+            fail("unexpected error");
+    }
+    if (server_parser_eof(parser))
+        fail("unexpected error");
+    server_parser_destroy(parser);
+    if (strcmp(server.host, "split.example") != 0 || server.port != 8081 ||
+        server.max_bytes != 123456789012LL || server.primary.ratio != 150)
+    {
+        fail("split scalar fields not bound");
+    }
+    if (server.tags_count != 2 || strcmp(server.tags[0], "first") != 0 ||
+        strcmp(server.tags[1], "second") != 0)
+    {
+        fail("split string array not bound");
+    }
+    server_free(&server);
+}
+
+static void test_errors(void) {
+    struct server server;
+
+    if (parse(&server, "{ port: 'eighty' }") != LaxJsonErrorTypeMismatch)
+        fail("expected type mismatch");
+    server_free(&server);
+
+    if (parse(&server, "{ port: 80.5 }") != LaxJsonErrorTypeMismatch)
+        fail("expected fraction mismatch");
+    server_free(&server);
+
+    if (parse(&server, "{ limits: {} }") != LaxJsonErrorTypeMismatch)
+        fail("expected container type mismatch");
+    server_free(&server);
+
+    if (parse(&server, "[]") != LaxJsonErrorTypeMismatch)
+        fail("expected root type mismatch");
+    server_free(&server);
+}
+
+int main(int argc, char *argv[]) {
+    fprintf(stderr, "testing generated defaults...");
+    test_defaults();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing generated values...");
+    test_values();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing generated split feed...");
+    test_split_feed();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing generated errors...");
+    test_errors();
+    fprintf(stderr, "OK\n");
+
+    return 0;
+}
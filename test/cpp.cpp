@@ -0,0 +1,165 @@
+#include <laxjson.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory>
+#include <string>
+
+static void fail(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static const char *type_to_str(LaxJsonType type) {
+    switch (type) {
+        case LaxJsonTypeString: return "string";
+        case LaxJsonTypeProperty: return "property";
+        case LaxJsonTypeNumber: return "number";
+        case LaxJsonTypeObject: return "object";
+        case LaxJsonTypeArray: return "array";
+        case LaxJsonTypeTrue: return "true";
+        case LaxJsonTypeFalse: return "false";
+        case LaxJsonTypeNull: return "null";
+    }
+    exit(1);
+}
+
+static const char *DOC =
+    "// config\n"
+    "{ name: 'front end', sizes: [1, 2.5, +3], on: true, off: null }\n";
+
+struct Builder {
+    std::string out;
+
+    void on_begin(LaxJsonType type) { out += std::string("begin ") + type_to_str(type) + "\n"; }
+    void on_end(LaxJsonType type) { out += std::string("end ") + type_to_str(type) + "\n"; }
+    void on_string(LaxJsonType type, std::string_view value) {
+        out += std::string(type_to_str(type)) + " " + std::string(value) + "\n";
+    }
+    void on_number(double x) { out += "number " + std::to_string(x) + "\n"; }
+    void on_primitive(LaxJsonType type) { out += std::string(type_to_str(type)) + "\n"; }
+};
+
+static const char *DOC_BUILD =
+    "begin object\n"
+    "property name\n"
+    "string front end\n"
+    "property sizes\n"
+    "begin array\n"
+    "number 1.000000\n"
+    "number 2.500000\n"
+    "number 3.000000\n"
+    "end array\n"
+    "property on\n"
+    "true\n"
+    "property off\n"
+    "null\n"
+    "end object\n";
+
+static void test_parse(void) {
+    Builder builder;
+    if (laxjson::parse(builder, DOC) != LaxJsonErrorNone)
+        fail("parse failed");
+    if (builder.out != DOC_BUILD)
+        fail(builder.out.c_str());
+}
+
+static void test_chunks(void) {
+    laxjson::Context context;
+    Builder builder;
+    std::string_view doc(DOC);
+    size_t i;
+
+    for (i = 0; i < doc.size(); i += 3) {
+        if (laxjson::feed(context, builder, doc.substr(i, 3)))
+            fail("feed failed");
+    }
+    if (lax_json_eof(context.get()))
+        fail("eof failed");
+    if (builder.out != DOC_BUILD)
+        fail(builder.out.c_str());
+}
+
+/* move-only, passed as a temporary, counting into storage it owns */
+struct Counter {
+    std::unique_ptr<int> count;
+    int *total;
+
+    explicit Counter(int *total) : count(new int(0)), total(total) {}
+    Counter(Counter &&) = default;
+    ~Counter() {
+        if (count)
+            *total = *count;
+    }
+
+    void on_begin(LaxJsonType) { *count += 1; }
+    void on_end(LaxJsonType) {}
+    void on_string(LaxJsonType, std::string_view) { *count += 1; }
+    void on_raw_number(std::string_view value, int flags) {
+        if (value != "1" && value != "2.5" && value != "3")
+            fail("wrong raw number");
+        if ((value == "2.5") != !(flags & LaxJsonNumberInteger))
+            fail("wrong flags");
+        *count += 1;
+    }
+    void on_primitive(LaxJsonType) { *count += 1; }
+};
+
+static void test_move_only(void) {
+    int total = 0;
+    if (laxjson::parse(Counter(&total), DOC))
+        fail("parse failed");
+    if (total != 12)
+        fail("wrong count");
+}
+
+struct Abort {
+    int strings = 0;
+
+    bool on_begin(LaxJsonType) { return false; }
+    bool on_end(LaxJsonType) { return false; }
+    bool on_string(LaxJsonType, std::string_view) { return ++strings == 2; }
+    int on_number(double) { return 0; }
+    bool on_primitive(LaxJsonType) { return false; }
+};
+
+static void test_abort_and_error(void) {
+    laxjson::Context context;
+    laxjson::Context moved;
+    Abort abort_handler;
+
+    if (laxjson::parse(context, abort_handler, DOC) != LaxJsonErrorAborted || abort_handler.strings != 2)
+        fail("expected abort");
+
+    moved = std::move(context);
+    lax_json_reset(moved.get());
+    if (laxjson::parse(moved, Builder(), "{ a: [1, !] }") != LaxJsonErrorUnexpectedChar)
+        fail("expected error");
+    if (moved->line != 1 || moved->column != 10)
+        fail("wrong error location");
+}
+
+struct Test {
+    const char *name;
+    void (*fn)(void);
+};
+
+static struct Test tests[] = {
+    {"parse", test_parse},
+    {"chunks", test_chunks},
+    {"move-only handler", test_move_only},
+    {"abort and error", test_abort_and_error},
+    {NULL, NULL},
+};
+
+int main(int argc, char *argv[]) {
+    struct Test *test = &tests[0];
+
+    while (test->name) {
+        fprintf(stderr, "testing %s...", test->name);
+        test->fn();
+        fprintf(stderr, "OK\n");
+        test += 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,320 @@
+#include <laxjson_document.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static const char *CONFIG =
+    "// lax config\n"
+    "{\n"
+    "  name: 'server',\n"
+    "  ports: [80, 443, ],\n"
+    "  tls: { enabled: true, cert: null },\n"
+    "  empty: {},\n"
+    "}\n";
+
+static void fail(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static void check_document(const struct LaxJsonDocument *doc) {
+    const struct LaxJsonNode *root = lax_json_document_root(doc);
+    const struct LaxJsonNode *node;
+
+    if (root->type != LaxJsonTypeObject || root->size != 4)
+        fail("wrong root");
+    node = lax_json_object_get(doc, root, "name");
+    if (!node || node->type != LaxJsonTypeString || strcmp(lax_json_node_string(doc, node), "server"))
+        fail("wrong name");
+    node = lax_json_object_get(doc, root, "ports");
+    if (!node || node->type != LaxJsonTypeArray || node->size != 2)
+        fail("wrong ports");
+    node = lax_json_node_child(doc, node);
+    if (node->u.number != 80 || lax_json_node_next(doc, node)->u.number != 443)
+        fail("wrong port values");
+    node = lax_json_object_get(doc, lax_json_object_get(doc, root, "tls"), "cert");
+    if (!node || node->type != LaxJsonTypeNull)
+        fail("wrong nested member");
+    node = lax_json_object_get(doc, root, "empty");
+    if (!node || node->size != 0 || lax_json_node_child(doc, node))
+        fail("wrong empty object");
+    if (lax_json_object_get(doc, root, "missing"))
+        fail("found missing member");
+}
+
+static int on_raw_number(struct LaxJsonContext *context, const char *value, int length,
+        int flags)
+{
+    fail("raw_number called");
+    return 1;
+}
+
+static int on_number_array(struct LaxJsonContext *context, const double *values, int count) {
+    fail("number_array called");
+    return 1;
+}
+
+static int on_error(struct LaxJsonContext *context, enum LaxJsonError err) {
+    fail("error called");
+    return 1;
+}
+
+static void test_parse(void) {
+    struct LaxJsonDocument *doc;
+    struct LaxJsonContext *context = lax_json_create();
+
+    if (lax_json_document_parse(NULL, strlen(CONFIG), CONFIG, &doc))
+        fail("parse failed");
+    check_document(doc);
+    lax_json_document_destroy(doc);
+
+    /* callbacks and record mode left on the context are not used */
+    context->raw_number = on_raw_number;
+    context->number_array = on_number_array;
+    context->error = on_error;
+    context->record_delimiter = '\n';
+    if (lax_json_document_parse(context, strlen(CONFIG), CONFIG, &doc))
+        fail("parse failed");
+    check_document(doc);
+    lax_json_document_destroy(doc);
+    lax_json_reset(context);
+
+    if (lax_json_document_parse(context, 5, "{ a: ", &doc) != LaxJsonErrorUnexpectedEof || doc)
+        fail("expected unexpected eof");
+    if (context->line != 1 || context->column != 5)
+        fail("wrong error location");
+    lax_json_destroy(context);
+}
+
+static void write_file(const char *path, const char *data) {
+    FILE *f = fopen(path, "wb");
+    if (!f || fwrite(data, 1, strlen(data), f) != strlen(data) || fclose(f))
+        fail("unable to write file");
+}
+
+static void patch_file(const char *path, off_t offset, const void *data, size_t size) {
+    FILE *f = fopen(path, "r+b");
+    if (!f || fseeko(f, offset, SEEK_SET) || fwrite(data, 1, size, f) != size || fclose(f))
+        fail("unable to patch file");
+}
+
+/* Corrupts each node of the snapshot in turn, expecting every load to notice
+ * and parse the source again, which also rewrites the snapshot. */
+static void check_corrupt_snapshots(const char *path, const char *cache_path) {
+    struct LaxJsonDocument *doc;
+    struct stat st;
+    uint64_t big = 0x7fffffffffffffffULL;
+    uint32_t bad_type = 99;
+    off_t nodes_start;
+    size_t node_count;
+    size_t i;
+    int field;
+
+    if (lax_json_snapshot_load(path, cache_path, &doc) || !doc->map || stat(cache_path, &st))
+        fail("snapshot not used");
+    node_count = doc->node_count;
+    nodes_start = st.st_size - node_count * sizeof(struct LaxJsonNode) - doc->strings_size;
+    lax_json_document_destroy(doc);
+
+    for (i = 0; i < node_count; i += 1) {
+        for (field = 0; field < 2; field += 1) {
+            if (lax_json_snapshot_load(path, cache_path, &doc) || !doc->map)
+                fail("snapshot not rewritten");
+            if (field == 0) {
+                patch_file(cache_path, nodes_start + i * sizeof(struct LaxJsonNode),
+                        &bad_type, sizeof(bad_type));
+            } else if (doc->nodes[i].type == LaxJsonTypeNumber ||
+                doc->nodes[i].type == LaxJsonTypeTrue || doc->nodes[i].type == LaxJsonTypeNull)
+            {
+                /* any bits are a number, and the others do not use them */
+                lax_json_document_destroy(doc);
+                continue;
+            } else {
+                patch_file(cache_path, nodes_start + i * sizeof(struct LaxJsonNode) +
+                        offsetof(struct LaxJsonNode, u), &big, sizeof(big));
+            }
+            lax_json_document_destroy(doc);
+            if (lax_json_snapshot_load(path, cache_path, &doc))
+                fail("load of corrupt snapshot failed");
+            if (doc->map)
+                fail("corrupt snapshot used");
+            check_document(doc);
+            lax_json_document_destroy(doc);
+        }
+    }
+
+    /* strings that are not terminated in the pool */
+    if (truncate(cache_path, st.st_size - 1) ||
+        lax_json_snapshot_load(path, cache_path, &doc) || doc->map)
+    {
+        fail("truncated snapshot used");
+    }
+    lax_json_document_destroy(doc);
+}
+
+static void test_snapshot(void) {
+    char dir[] = "/tmp/laxjson_test_XXXXXX";
+    char path[64];
+    char cache_path[64];
+    struct LaxJsonDocument *doc;
+    struct timeval times[2];
+
+    if (!mkdtemp(dir))
+        fail("unable to create temporary directory");
+    snprintf(path, sizeof(path), "%s/config.json", dir);
+    snprintf(cache_path, sizeof(cache_path), "%s/config.snap", dir);
+    write_file(path, CONFIG);
+
+    /* first load parses and writes the snapshot */
+    if (lax_json_snapshot_load(path, cache_path, &doc))
+        fail("cold load failed");
+    if (doc->map)
+        fail("cold load used a snapshot");
+    check_document(doc);
+    lax_json_document_destroy(doc);
+
+    /* second load maps it */
+    if (lax_json_snapshot_load(path, cache_path, &doc))
+        fail("warm load failed");
+    if (!doc->map)
+        fail("warm load did not use the snapshot");
+    check_document(doc);
+    lax_json_document_destroy(doc);
+
+    check_corrupt_snapshots(path, cache_path);
+
+    /* touching the file without changing it keeps the snapshot */
+    gettimeofday(&times[0], NULL);
+    times[0].tv_sec += 10;
+    times[1] = times[0];
+    utimes(path, times);
+    if (lax_json_snapshot_load(path, cache_path, &doc) || !doc->map)
+        fail("touched load did not use the snapshot");
+    lax_json_document_destroy(doc);
+
+    /* changing it does not */
+    write_file(path, "[1, 2, 3]");
+    if (lax_json_snapshot_load(path, cache_path, &doc) || doc->map)
+        fail("changed load used the snapshot");
+    if (lax_json_document_root(doc)->type != LaxJsonTypeArray)
+        fail("changed load has old content");
+    lax_json_document_destroy(doc);
+
+    unlink(path);
+    unlink(cache_path);
+    rmdir(dir);
+}
+
+static atomic_int init_count;
+
+static int on_load_begin(struct LaxJsonContext *context, enum LaxJsonType type) {
+    atomic_fetch_add((atomic_int *)context->userdata, 1);
+    return 0;
+}
+
+static int on_load_value(struct LaxJsonContext *context, enum LaxJsonType type) {
+    return 0;
+}
+
+static int on_load_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    return 0;
+}
+
+static int on_load_number(struct LaxJsonContext *context, double x) {
+    return 0;
+}
+
+static int init_load(struct LaxJsonContext *context, int index, void *userdata) {
+    context->userdata = userdata;
+    context->string = on_load_string;
+    context->number = on_load_number;
+    context->primitive = on_load_value;
+    context->begin = on_load_begin;
+    context->end = on_load_value;
+    atomic_fetch_add(&init_count, 1);
+    return index == 3;
+}
+
+static void test_load_many(void) {
+    char dir[] = "/tmp/laxjson_test_XXXXXX";
+    char paths[40][64];
+    const char *path_list[40];
+    struct LaxJsonLoadResult results[40];
+    atomic_int begin_count;
+    int i;
+
+    if (!mkdtemp(dir))
+        fail("unable to create temporary directory");
+    for (i = 0; i < 40; i += 1) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/%d.json", dir, i);
+        path_list[i] = paths[i];
+        if (i == 7)
+            write_file(paths[i], "{\n  a: 1,\n  b: ]\n}");
+        else if (i != 9)
+            write_file(paths[i], (i % 2) ? CONFIG : "[1, 2, 3]");
+    }
+
+    if (lax_json_load_many(path_list, 40, 4, NULL, NULL, results))
+        fail("load many failed");
+    for (i = 0; i < 40; i += 1) {
+        if (i == 7) {
+            if (results[i].error != LaxJsonErrorUnexpectedChar || results[i].document ||
+                results[i].line != 3 || results[i].column != 6)
+            {
+                fail("wrong parse error result");
+            }
+        } else if (i == 9) {
+            if (results[i].error != LaxJsonErrorIo || results[i].document)
+                fail("wrong missing file result");
+        } else {
+            if (results[i].error)
+                fail("unexpected load error");
+            if (i % 2)
+                check_document(results[i].document);
+            else if (lax_json_document_root(results[i].document)->size != 3)
+                fail("results out of order");
+            lax_json_document_destroy(results[i].document);
+        }
+    }
+
+    /* with callbacks instead of documents */
+    atomic_init(&begin_count, 0);
+    if (lax_json_load_many(path_list, 40, 0, init_load, &begin_count, results))
+        fail("load many with callbacks failed");
+    if (init_count != 39 || results[3].error != LaxJsonErrorAborted ||
+        results[7].error != LaxJsonErrorUnexpectedChar || results[9].error != LaxJsonErrorIo ||
+        results[0].error || results[0].document)
+    {
+        fail("wrong callback results");
+    }
+    /* 17 configs with 4 containers each, 20 arrays and the broken object */
+    if (atomic_load(&begin_count) != 17 * 4 + 20 + 1)
+        fail("wrong callback count");
+
+    for (i = 0; i < 40; i += 1)
+        unlink(paths[i]);
+    rmdir(dir);
+}
+
+int main(int argc, char *argv[]) {
+    fprintf(stderr, "testing document parse...");
+    test_parse();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing snapshot...");
+    test_snapshot();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing load many...");
+    test_load_many();
+    fprintf(stderr, "OK\n");
+
+    return 0;
+}
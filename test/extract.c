@@ -0,0 +1,216 @@
+#include <laxjson_extract.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+static char out_buf[16384];
+static int out_buf_index;
+
+static void fail(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static int on_match(struct LaxJsonExtractor *extractor, int pattern) {
+    out_buf_index += sprintf(out_buf + out_buf_index, "match %d\n", pattern);
+    return 0;
+}
+
+static int on_string(struct LaxJsonExtractor *extractor,
+    enum LaxJsonType type, const char *value, int length)
+{
+    out_buf_index += sprintf(out_buf + out_buf_index, "%s %s\n",
+            type == LaxJsonTypeProperty ? "property" : "string", value);
+    return 0;
+}
+
+static int on_number(struct LaxJsonExtractor *extractor, double x) {
+    out_buf_index += sprintf(out_buf + out_buf_index, "number %g\n", x);
+    return 0;
+}
+
+static int on_primitive(struct LaxJsonExtractor *extractor, enum LaxJsonType type) {
+    out_buf_index += sprintf(out_buf + out_buf_index, "primitive\n");
+    return 0;
+}
+
+static int on_begin(struct LaxJsonExtractor *extractor, enum LaxJsonType type) {
+    out_buf_index += sprintf(out_buf + out_buf_index, "begin\n");
+    return 0;
+}
+
+static int on_end(struct LaxJsonExtractor *extractor, enum LaxJsonType type) {
+    out_buf_index += sprintf(out_buf + out_buf_index, "end\n");
+    return 0;
+}
+
+static struct LaxJsonExtractor *create(const char *const *patterns, int count) {
+    struct LaxJsonExtractor *extractor = lax_json_extract_create(patterns, count);
+    if (!extractor)
+        fail("create failed");
+    extractor->match = on_match;
+    extractor->string = on_string;
+    extractor->number = on_number;
+    extractor->primitive = on_primitive;
+    extractor->begin = on_begin;
+    extractor->end = on_end;
+    out_buf_index = 0;
+    return extractor;
+}
+
+/* Extracts from input fed whole and then one byte at a time. */
+static void check_extract(const char *const *patterns, int count, const char *input,
+        const char *output, int done)
+{
+    struct LaxJsonExtractor *extractor;
+    enum LaxJsonError err;
+    int size = strlen(input);
+    int step;
+    int i;
+
+    for (step = size; step > 0; step = step == 1 ? 0 : 1) {
+        extractor = create(patterns, count);
+        for (i = 0; i < size; i += step) {
+            err = lax_json_extract_feed(extractor, i + step < size ? step : size - i, input + i);
+            if (err) {
+                fprintf(stderr, "line %d column %d: %s\n", extractor->context->line,
+                        extractor->context->column, lax_json_str_err(err));
+                exit(1);
+            }
+        }
+        if (lax_json_extract_eof(extractor))
+            fail("eof failed");
+        out_buf[out_buf_index] = 0;
+        if (strcmp(out_buf, output) != 0) {
+            fprintf(stderr, "EXPECTED:\n%s\nRECEIVED:\n%s\n", output, out_buf);
+            exit(1);
+        }
+        if (extractor->done != done)
+            fail("wrong done");
+        lax_json_extract_destroy(extractor);
+    }
+}
+
+static void test_early_stop(void) {
+    const char *patterns[] = {"server.port", "limits.*.max"};
+
+    /* everything after the limits object is left unparsed, even garbage */
+    check_extract(patterns, 2,
+            "{ server: { host: 'example.com', port: 8080, tags: ['a', 'b'] },\n"
+            "  limits: { cpu: { max: 4, min: 1 }, mem: { min: 64, max: 512 } },\n"
+            "  rest: [1, 2, 3] } !!! not json",
+            "match 0\n"
+            "number 8080\n"
+            "match 1\n"
+            "number 4\n"
+            "match 1\n"
+            "number 512\n",
+            1);
+}
+
+static void test_containers_and_indexes(void) {
+    const char *patterns[] = {"items.1", "*.id", "missing.path"};
+
+    check_extract(patterns, 3,
+            "{ a: { id: 'first' }, items: [ { id: 1 }, { id: 2, ok: true }, null ],\n"
+            "  b: { id: [3] } }",
+            "match 1\n"
+            "string first\n"
+            "match 0\n"
+            "begin\n"
+            "property id\n"
+            "number 2\n"
+            "property ok\n"
+            "primitive\n"
+            "end\n"
+            "match 1\n"
+            "begin\n"
+            "number 3\n"
+            "end\n",
+            1);
+}
+
+static void test_skipped_not_buffered(void) {
+    const char *patterns[] = {"keep"};
+    const char *found = "keep: 'x' }";
+    struct LaxJsonExtractor *extractor;
+    char *input;
+    int size = 100000;
+
+    /* a string far larger than the value buffer may grow, in a subtree that
+     * cannot match */
+    input = malloc(size + 64);
+    if (!input)
+        fail("out of memory");
+    strcpy(input, "{ skip: ['");
+    memset(input + 10, 'x', size);
+    strcpy(input + 10 + size, "'], ");
+    strcat(input, found);
+
+    extractor = create(patterns, 1);
+    extractor->context->max_value_buffer_size = 16384;
+    if (lax_json_extract_feed(extractor, strlen(input), input))
+        fail("skipped string was buffered");
+    if (!extractor->done || strcmp(out_buf, "match 0\nstring x\n") != 0)
+        fail("wrong extraction");
+    lax_json_extract_destroy(extractor);
+
+    /* and the same string is too long where it matches */
+    memcpy(input + 2, "keep", 4);
+    extractor = create(patterns, 1);
+    extractor->context->max_value_buffer_size = 16384;
+    if (lax_json_extract_feed(extractor, strlen(input), input) != LaxJsonErrorExceededMaxValueSize)
+        fail("expected error");
+    lax_json_extract_destroy(extractor);
+    free(input);
+}
+
+static void test_invalid_patterns(void) {
+    const char *empty_segment[] = {"a..b"};
+    const char *many[65];
+    const char *nested[] = {"a.b", "a", "*.1.c", "x.01", "items.3.x", "items.*", "a.b", "a.c.d", "*.b"};
+    struct LaxJsonExtractor *extractor;
+    int i;
+
+    if (lax_json_extract_create(empty_segment, 1))
+        fail("accepted empty segment");
+    for (i = 0; i < 65; i += 1)
+        many[i] = "a";
+    if (lax_json_extract_create(many, 65))
+        fail("accepted too many patterns");
+
+    /* a pattern that could only match inside what another matches */
+    if (lax_json_extract_create(nested, 2) || lax_json_extract_create(nested + 2, 2) ||
+        lax_json_extract_create(nested + 4, 2))
+    {
+        fail("accepted nested patterns");
+    }
+    extractor = create(nested + 6, 3);
+    lax_json_extract_destroy(extractor);
+}
+
+struct Test {
+    const char *name;
+    void (*fn)(void);
+};
+
+static struct Test tests[] = {
+    {"early stop", test_early_stop},
+    {"containers and indexes", test_containers_and_indexes},
+    {"skipped subtrees are not buffered", test_skipped_not_buffered},
+    {"invalid patterns", test_invalid_patterns},
+    {NULL, NULL},
+};
+
+int main(int argc, char *argv[]) {
+    struct Test *test = &tests[0];
+
+    while (test->name) {
+        fprintf(stderr, "testing %s...", test->name);
+        test->fn();
+        fprintf(stderr, "OK\n");
+        test += 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include <laxjson_incremental.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+static char doc[4096];
+static int doc_size;
+
+static int diff_calls;
+static int diff_index;
+static int diff_removed;
+static int diff_added;
+static const char *diff_added_string;
+static int event_calls;
+
+static void fail(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static int on_event(struct LaxJsonIncremental *inc, const struct LaxJsonEvent *event) {
+    event_calls += 1;
+    return 0;
+}
+
+static int on_diff(struct LaxJsonIncremental *inc, int index,
+        const struct LaxJsonEvent *removed, int removed_count,
+        const struct LaxJsonEvent *added, int added_count)
+{
+    diff_calls += 1;
+    diff_index = index;
+    diff_removed = removed_count;
+    diff_added = added_count;
+    diff_added_string = (added_count > 0) ? added[0].string : NULL;
+    return 0;
+}
+
+/* Replaces the bytes [start, end) of doc with text and applies the edit. */
+static enum LaxJsonError edit(struct LaxJsonIncremental *inc, int start, int end, const char *text) {
+    int length = strlen(text);
+    memmove(doc + start + length, doc + end, doc_size - end + 1);
+    memcpy(doc + start, text, length);
+    doc_size += length - (end - start);
+    diff_calls = 0;
+    event_calls = 0;
+    return lax_json_incremental_edit(inc, doc_size, doc, start, end, start + length);
+}
+
+static int find(const char *needle) {
+    const char *p = strstr(doc, needle);
+    if (!p)
+        fail("test text not found");
+    return p - doc;
+}
+
+/* Compares the events of inc, offsets included, with a full parse of doc. */
+static void check_full(struct LaxJsonIncremental *inc) {
+    struct LaxJsonIncremental *full = lax_json_incremental_create();
+    const struct LaxJsonEvent *a, *b;
+    int i;
+
+    if (lax_json_incremental_parse(full, doc_size, doc))
+        fail("full parse failed");
+    if (full->event_count != inc->event_count)
+        fail("event count differs from full parse");
+    for (i = 0; i < full->event_count; i += 1) {
+        a = &full->events[i];
+        b = &inc->events[i];
+        if (a->kind != b->kind || a->type != b->type || a->offset != b->offset ||
+            a->number != b->number || a->length != b->length ||
+            (a->string && strcmp(a->string, b->string) != 0))
+        {
+            fail("event differs from full parse");
+        }
+    }
+    lax_json_incremental_destroy(full);
+}
+
+static void test_edits(void) {
+    struct LaxJsonIncremental *inc = lax_json_incremental_create();
+    int offset;
+
+    strcpy(doc,
+        "// service config\n"
+        "{\n"
+        "  name: 'api',\n"
+        "  limits: { cpu: 5, memory: 'low' },\n"
+        "  routes: [\n"
+        "    { path: '/a', timeout: 10 },\n"
+        "    { path: '/b', timeout: 20 },\n"
+        "  ],\n"
+        "}\n");
+    doc_size = strlen(doc);
+    inc->event = on_event;
+    inc->diff = on_diff;
+
+    if (lax_json_incremental_parse(inc, doc_size, doc))
+        fail("initial parse failed");
+    if (inc->event_count != 26 || event_calls != 26 || diff_calls != 1 || diff_added != 26)
+        fail("initial events not reported");
+    check_full(inc);
+
+    /* a value in a nested object only reparses that object */
+    offset = find("5,");
+    if (edit(inc, offset, offset + 1, "500"))
+        fail("edit failed");
+    if (inc->parsed_size != (int)strlen("{ cpu: 500, memory: 'low' }"))
+        fail("reparsed more than the enclosing object");
+    if (event_calls != 6 || diff_calls != 1 || diff_removed != 1 || diff_added != 1 ||
+        inc->events[diff_index].number != 500)
+    {
+        fail("wrong diff for changed number");
+    }
+    check_full(inc);
+
+    /* inserting lines shifts later containers, whose checkpoints still hold
+     * old locations */
+    offset = find(" },\n  routes");
+    if (edit(inc, offset, offset, ",\n    storage: 'ssd'\n"))
+        fail("edit failed");
+    if (diff_removed != 0 || diff_added != 2 || strcmp(diff_added_string, "storage") != 0)
+        fail("wrong diff for inserted member");
+    check_full(inc);
+
+    offset = find("'/b'");
+    if (edit(inc, offset + 2, offset + 3, "c"))
+        fail("edit failed");
+    if (inc->parsed_size != (int)strlen("{ path: '/c', timeout: 20 }"))
+        fail("did not reparse the shifted element");
+    if (diff_removed != 1 || strcmp(diff_added_string, "/c") != 0)
+        fail("wrong diff for shifted element");
+    check_full(inc);
+
+    /* an edit that changes nothing reports no diff */
+    offset = find("20");
+    if (edit(inc, offset, offset + 2, "20"))
+        fail("edit failed");
+    if (diff_calls != 0)
+        fail("diff reported for identical value");
+
+    /* closing a container early changes where it ends */
+    offset = find("memory");
+    if (edit(inc, offset, offset, "} ") != LaxJsonErrorExpectedEof)
+        fail("expected error");
+    if (inc->event_count != 0 || inc->parsed_size != doc_size)
+        fail("error did not fall back to a full parse");
+    if (edit(inc, offset, offset + 2, ""))
+        fail("edit failed");
+    check_full(inc);
+
+    /* top level edits reparse the whole document */
+    if (edit(inc, 0, 2, "/*") != LaxJsonErrorUnexpectedEof)
+        fail("expected unterminated comment");
+    if (edit(inc, 0, 2, "//"))
+        fail("edit failed");
+    if (inc->parsed_size != doc_size)
+        fail("top level edit not fully parsed");
+    check_full(inc);
+
+    lax_json_incremental_destroy(inc);
+}
+
+static void test_nested_sibling(void) {
+    struct LaxJsonIncremental *inc = lax_json_incremental_create();
+    int offset;
+
+    strcpy(doc, "{\"pad\": 0, \"list\": [1, 3, {\"k\": 1}], \"tail\": [2]}");
+    doc_size = strlen(doc);
+    if (lax_json_incremental_parse(inc, doc_size, doc))
+        fail("initial parse failed");
+
+    /* containers after the edit in the same parent do not widen the reparse */
+    offset = find("3,");
+    if (edit(inc, offset, offset + 1, "4"))
+        fail("edit failed");
+    if (inc->parsed_size != (int)strlen("[1, 4, {\"k\": 1}]"))
+        fail("reparsed more than the enclosing array");
+    check_full(inc);
+
+    lax_json_incremental_destroy(inc);
+}
+
+int main(int argc, char *argv[]) {
+    fprintf(stderr, "testing incremental edits...");
+    test_edits();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing incremental edit before a nested container...");
+    test_nested_sibling();
+    fprintf(stderr, "OK\n");
+
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include <laxjson_index.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define ITEM_COUNT 1000
+
+static char dir[] = "/tmp/laxjson_test_XXXXXX";
+static char path[64];
+static char index_path[64];
+
+static void fail(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static void write_file(const char *file_path, const char *data) {
+    FILE *f = fopen(file_path, "wb");
+    if (!f || fwrite(data, 1, strlen(data), f) != strlen(data) || fclose(f))
+        fail("unable to write file");
+}
+
+/* A document with a large array of small objects between two objects. */
+static char *make_document(void) {
+    char *doc = malloc(ITEM_COUNT * 64 + 256);
+    int size;
+    int i;
+
+    if (!doc)
+        fail("out of memory");
+    size = sprintf(doc, "// export\n{\n  config: { server: { host: 'a.example', port: 8080 } },\n"
+            "  items: [\n");
+    for (i = 0; i < ITEM_COUNT; i += 1)
+        size += sprintf(doc + size, "    { id: %d, name: 'n%d', tags: [%d] },\n", i, i, i % 7);
+    sprintf(doc + size, "  ],\n  \"trailer\": [true, null],\n}\n");
+    return doc;
+}
+
+static void check_find(const struct LaxJsonIndex *index, const char *query, const char *expected) {
+    enum LaxJsonError err;
+    int64_t start;
+    int64_t end;
+
+    err = lax_json_index_find(index, query, &start, &end);
+    if (!expected) {
+        if (err != LaxJsonErrorNotFound) {
+            fprintf(stderr, "%s: expected not found\n", query);
+            exit(1);
+        }
+        return;
+    }
+    if (err) {
+        fprintf(stderr, "%s: %s\n", query, lax_json_str_err(err));
+        exit(1);
+    }
+    if ((size_t)(end - start) != strlen(expected) ||
+        memcmp(index->source + start, expected, end - start) != 0)
+    {
+        fprintf(stderr, "%s: EXPECTED %s RECEIVED %.*s\n", query, expected,
+                (int)(end - start), index->source + start);
+        exit(1);
+    }
+}
+
+static void check_queries(int64_t min_size, int element_stride) {
+    struct LaxJsonIndex *index;
+    int64_t start;
+    int64_t end;
+
+    if (lax_json_index_build(NULL, path, index_path, min_size, element_stride))
+        fail("build failed");
+    if (lax_json_index_open(path, index_path, &index))
+        fail("open failed");
+
+    check_find(index, "config.server.port", "8080");
+    check_find(index, "config.server.host", "'a.example'");
+    check_find(index, "items.0", "{ id: 0, name: 'n0', tags: [0] }");
+    check_find(index, "items.500.name", "'n500'");
+    check_find(index, "items.517.tags", "[6]");
+    check_find(index, "items.999.tags.0", "5");
+    check_find(index, "items.*.id", "0");
+    check_find(index, "trailer.1", "null");
+    check_find(index, "items.1000", NULL);
+    check_find(index, "items.12.missing", NULL);
+    check_find(index, "missing", NULL);
+    check_find(index, "items..1", NULL);
+    if (lax_json_index_find(index, "", &start, &end) ||
+        index->source[start] != '{' || index->source[end - 1] != '}' || index->source[end] != '\n')
+    {
+        fail("wrong root range");
+    }
+
+    lax_json_index_close(index);
+}
+
+static void test_queries(void) {
+    /* the root only, then most containers with sampled elements */
+    check_queries(0, 0);
+    check_queries(32, 16);
+    check_queries(1, 1);
+}
+
+static int event_count;
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    const struct LaxJsonIndex *index = context->userdata;
+    /* event offsets are offsets into the whole document */
+    if (type == LaxJsonTypeString && memcmp(index->source + context->event_start, "'n7'", 4) != 0)
+        fail("wrong event offset");
+    event_count += 1;
+    return 0;
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    event_count += 1;
+    return 0;
+}
+
+static int on_type(struct LaxJsonContext *context, enum LaxJsonType type) {
+    event_count += 1;
+    return 0;
+}
+
+static void test_parse(void) {
+    struct LaxJsonContext *context;
+    struct LaxJsonIndex *index;
+
+    if (lax_json_index_build(NULL, path, index_path, 32, 4))
+        fail("build failed");
+    if (lax_json_index_open(path, index_path, &index))
+        fail("open failed");
+    context = lax_json_create();
+    if (!context)
+        fail("out of memory");
+    context->userdata = index;
+    context->string = on_string;
+    context->number = on_number;
+    context->primitive = on_type;
+    context->begin = on_type;
+    context->end = on_type;
+    event_count = 0;
+    if (lax_json_index_parse(index, "items.7", context))
+        fail("parse failed");
+    /* begin, id, 7, name, 'n7', tags, begin, 0, end, end */
+    if (event_count != 10)
+        fail("wrong event count");
+    lax_json_destroy(context);
+    lax_json_index_close(index);
+}
+
+static void test_invalid(void) {
+    struct LaxJsonContext *context;
+    struct LaxJsonIndex *index;
+    int64_t start;
+    int64_t end;
+
+    /* a changed document makes the index useless */
+    if (lax_json_index_build(NULL, path, index_path, 32, 4))
+        fail("build failed");
+    write_file(path, "  42 ");
+    if (lax_json_index_open(path, index_path, &index) != LaxJsonErrorInvalidIndex)
+        fail("expected invalid index");
+
+    /* and so does a damaged one */
+    if (lax_json_index_build(NULL, path, index_path, 0, 0))
+        fail("build failed");
+    if (truncate(index_path, 40))
+        fail("unable to truncate");
+    if (lax_json_index_open(path, index_path, &index) != LaxJsonErrorInvalidIndex)
+        fail("expected invalid index");
+
+    /* a scalar document has no containers to index */
+    if (lax_json_index_build(NULL, path, index_path, 0, 0) ||
+        lax_json_index_open(path, index_path, &index))
+    {
+        fail("scalar document failed");
+    }
+    if (lax_json_index_find(index, "", &start, &end) || start != 2 || end != 4)
+        fail("wrong scalar range");
+    if (lax_json_index_find(index, "0", &start, &end) != LaxJsonErrorNotFound)
+        fail("expected not found");
+    lax_json_index_close(index);
+
+    /* parse errors are located */
+    write_file(path, "{\n  a: [1, !]\n}");
+    context = lax_json_create();
+    if (!context)
+        fail("out of memory");
+    if (lax_json_index_build(context, path, index_path, 0, 0) != LaxJsonErrorUnexpectedChar ||
+        context->line != 2 || context->column != 10)
+    {
+        fail("expected error");
+    }
+    lax_json_destroy(context);
+}
+
+static int on_number_array(struct LaxJsonContext *context, const double *values, int count) {
+    fail("number_array called");
+    return 1;
+}
+
+static void test_caller_context(void) {
+    struct LaxJsonContext *context = lax_json_create();
+    struct LaxJsonIndex *index;
+
+    if (!context)
+        fail("out of memory");
+    /* callbacks and record mode left on the context are not used */
+    context->number_array = on_number_array;
+    context->record_delimiter = '\n';
+    if (lax_json_index_build(context, path, index_path, 32, 16))
+        fail("build failed");
+    if (lax_json_index_open(path, index_path, &index))
+        fail("open failed");
+    check_find(index, "items.517.tags", "[6]");
+    lax_json_index_close(index);
+    lax_json_destroy(context);
+}
+
+struct Test {
+    const char *name;
+    void (*fn)(void);
+};
+
+static struct Test tests[] = {
+    {"queries", test_queries},
+    {"parse", test_parse},
+    {"caller context", test_caller_context},
+    {"invalid", test_invalid},
+    {NULL, NULL},
+};
+
+int main(int argc, char *argv[]) {
+    struct Test *test = &tests[0];
+    char *doc;
+
+    if (!mkdtemp(dir))
+        fail("unable to create temporary directory");
+    snprintf(path, sizeof(path), "%s/export.json", dir);
+    snprintf(index_path, sizeof(index_path), "%s/export.json.idx", dir);
+    doc = make_document();
+
+    while (test->name) {
+        fprintf(stderr, "testing %s...", test->name);
+        write_file(path, doc);
+        test->fn();
+        fprintf(stderr, "OK\n");
+        test += 1;
+    }
+
+    free(doc);
+    unlink(path);
+    unlink(index_path);
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,344 @@
+#include <laxjson_parallel.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdatomic.h>
+
+#define MAX_SLICES 8
+#define MAX_RECORDS 100000
+
+struct SliceRecords {
+    int64_t local[MAX_RECORDS];
+    int id[MAX_RECORDS];
+    int count;
+    int after_id;
+    int begin_count;
+    int end_count;
+};
+
+static struct SliceRecords records[MAX_SLICES];
+static atomic_int init_calls;
+
+static void fail(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    struct LaxJsonParallelSlice *slice = context->userdata;
+    struct SliceRecords *r = slice->userdata;
+    r->after_id = type == LaxJsonTypeProperty && strcmp(value, "id") == 0;
+    return 0;
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    struct LaxJsonParallelSlice *slice = context->userdata;
+    struct SliceRecords *r = slice->userdata;
+    if (r->after_id) {
+        r->local[r->count] = slice->element_count - 1;
+        r->id[r->count] = x;
+        r->count += 1;
+        r->after_id = 0;
+    }
+    return 0;
+}
+
+static int on_primitive(struct LaxJsonContext *context, enum LaxJsonType type) {
+    return 0;
+}
+
+static int on_begin(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonParallelSlice *slice = context->userdata;
+    struct SliceRecords *r = slice->userdata;
+    r->begin_count += 1;
+    return 0;
+}
+
+static int on_end(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct LaxJsonParallelSlice *slice = context->userdata;
+    struct SliceRecords *r = slice->userdata;
+    r->end_count += 1;
+    return 0;
+}
+
+static int init(struct LaxJsonContext *context, struct LaxJsonParallelSlice *slice, void *userdata) {
+    struct SliceRecords *r = &records[slice->index];
+    atomic_fetch_add(&init_calls, 1);
+    r->count = 0;
+    r->after_id = 0;
+    r->begin_count = 0;
+    r->end_count = 0;
+    slice->userdata = r;
+    context->string = on_string;
+    context->number = on_number;
+    context->primitive = on_primitive;
+    context->begin = on_begin;
+    context->end = on_end;
+    return 0;
+}
+
+/* Records whose text contains things that look like element boundaries
+ * inside strings and comments. */
+static char *make_array(int count, int *size_out) {
+    char *data = malloc(count * 160 + 64);
+    int size = 0;
+    int i;
+
+    size += sprintf(data + size, "// records\n[\n");
+    for (i = 0; i < count; i += 1) {
+        size += sprintf(data + size,
+                "  { id: %d, name: 'a, {b', // , {fake}\n"
+                "    note: \"x\\\", [y\" },\n", i);
+    }
+    size += sprintf(data + size, "]\n");
+    *size_out = size;
+    return data;
+}
+
+/* Checks that every record was seen once, with its index in the array. */
+static void check_records(struct LaxJsonParallelSlice *slices, int slice_count, int count) {
+    int seen = 0;
+    int begins = 0;
+    int ends = 0;
+    int i, j;
+
+    for (i = 0; i < slice_count; i += 1) {
+        struct SliceRecords *r = slices[i].userdata;
+        for (j = 0; j < r->count; j += 1) {
+            if (slices[i].first_element + r->local[j] != r->id[j])
+                fail("element index not fixed up");
+            if (r->id[j] != seen)
+                fail("records out of order");
+            seen += 1;
+        }
+        begins += r->begin_count;
+        ends += r->end_count;
+    }
+    if (seen != count)
+        fail("wrong record count");
+    /* each record and the array itself, reported once */
+    if (begins != count + 1 || ends != count + 1)
+        fail("wrong container events");
+}
+
+static void test_split(void) {
+    struct LaxJsonParallelSlice slices[MAX_SLICES];
+    int slice_count;
+    int size;
+    char *data = make_array(20000, &size);
+
+    init_calls = 0;
+    if (lax_json_parse_parallel(size, data, MAX_SLICES, init, NULL, slices, &slice_count))
+        fail("parallel parse failed");
+    if (slice_count != MAX_SLICES || init_calls != MAX_SLICES)
+        fail("document was not split");
+    check_records(slices, slice_count, 20000);
+    free(data);
+}
+
+static void test_fallback(void) {
+    struct LaxJsonParallelSlice slices[MAX_SLICES];
+    int slice_count;
+    char *data = malloc(20000 * 32 + 8);
+    int size = 0;
+    int i;
+
+    /* strings spanning lines hide fake boundaries from the heuristic, and
+     * here they are the only candidates */
+    size += sprintf(data + size, "[");
+    for (i = 0; i < 20000; i += 1)
+        size += sprintf(data + size, "'multi\n  , { x: %d }',\n", i);
+    size += sprintf(data + size, "]");
+
+    init_calls = 0;
+    if (lax_json_parse_parallel(size, data, MAX_SLICES, init, NULL, slices, &slice_count))
+        fail("parallel parse failed");
+    if (slice_count != 1 || init_calls < 3)
+        fail("wrong guesses not rejected");
+    if (slices[0].element_count != 20000)
+        fail("wrong element count");
+    free(data);
+}
+
+static void test_not_top_level(void) {
+    struct LaxJsonParallelSlice slices[MAX_SLICES];
+    int slice_count;
+    int size;
+    char *data = make_array(20000, &size);
+    char *wrapped = malloc(size + 16);
+
+    /* elements of a nested array must not be mistaken for top level ones */
+    sprintf(wrapped, "[%s]", data);
+    if (lax_json_parse_parallel(size + 2, wrapped, MAX_SLICES, init, NULL, slices, &slice_count))
+        fail("parallel parse failed");
+    if (slice_count != 1)
+        fail("nested array split");
+    free(wrapped);
+    free(data);
+}
+
+static int on_raw_number(struct LaxJsonContext *context, const char *value, int length, int flags) {
+    double x;
+    if (lax_json_number_to_double(value, length, &x))
+        return 1;
+    return on_number(context, x);
+}
+
+static int on_number_array(struct LaxJsonContext *context, const double *values, int count) {
+    return 0;
+}
+
+static int init_number_callbacks(struct LaxJsonContext *context, struct LaxJsonParallelSlice *slice,
+        void *userdata)
+{
+    init(context, slice, userdata);
+    context->raw_number = on_raw_number;
+    context->raw_string = context->string;
+    if (userdata)
+        context->number_array = on_number_array;
+    return 0;
+}
+
+static void test_number_callbacks(void) {
+    struct LaxJsonParallelSlice slices[MAX_SLICES];
+    struct SliceRecords *r;
+    int64_t elements;
+    int slice_count;
+    int count = 20000;
+    char *data = malloc(count * 48 + 8);
+    int size = 0;
+    int with_array;
+    int i, j;
+
+    /* each object is told apart from the values around it by its index */
+    size += sprintf(data + size, "[");
+    for (i = 0; i < count; i += 1)
+        size += sprintf(data + size, "1, 2.5, 'x', 3,\n  { id: %d }, 4,\n", i * 6 + 4);
+    size += sprintf(data + size, "]");
+
+    /* with raw_number alone, then with number_array taking the runs */
+    for (with_array = 0; with_array < 2; with_array += 1) {
+        if (lax_json_parse_parallel(size, data, MAX_SLICES, init_number_callbacks,
+                    with_array ? &with_array : NULL, slices, &slice_count))
+        {
+            fail("parallel parse failed");
+        }
+        if (slice_count != MAX_SLICES)
+            fail("document was not split");
+        elements = 0;
+        for (i = 0; i < slice_count; i += 1) {
+            r = slices[i].userdata;
+            for (j = 0; j < r->count; j += 1) {
+                if (slices[i].first_element + r->local[j] != r->id[j])
+                    fail("wrong element index");
+            }
+            elements += slices[i].element_count;
+        }
+        if (elements != count * 6)
+            fail("wrong element count");
+    }
+    free(data);
+}
+
+static int on_scalar_number(struct LaxJsonContext *context, double x) {
+    struct LaxJsonParallelSlice *slice = context->userdata;
+    struct SliceRecords *r = slice->userdata;
+    r->local[r->count] = slice->element_count - 1;
+    r->id[r->count] = x;
+    r->count += 1;
+    return 0;
+}
+
+static int init_scalars(struct LaxJsonContext *context, struct LaxJsonParallelSlice *slice,
+        void *userdata)
+{
+    init(context, slice, userdata);
+    context->number = on_scalar_number;
+    return 0;
+}
+
+static void test_scalars(void) {
+    struct LaxJsonParallelSlice slices[MAX_SLICES];
+    struct SliceRecords *r;
+    int slice_count;
+    int count = 100000;
+    char *data = malloc(count * 16 + 8);
+    int size = 0;
+    int seen = 0;
+    int i, j;
+
+    /* no containers to split at */
+    size += sprintf(data + size, "[");
+    for (i = 0; i < count; i += 2)
+        size += sprintf(data + size, "%d, 'a, %d',\n", i, i + 1);
+    size += sprintf(data + size, "]");
+
+    if (lax_json_parse_parallel(size, data, MAX_SLICES, init_scalars, NULL, slices, &slice_count))
+        fail("parallel parse failed");
+    if (slice_count != MAX_SLICES)
+        fail("array of scalars was not split");
+    for (i = 0; i < slice_count; i += 1) {
+        r = slices[i].userdata;
+        for (j = 0; j < r->count; j += 1) {
+            if (slices[i].first_element + r->local[j] != r->id[j])
+                fail("wrong element index");
+            seen += 1;
+        }
+    }
+    if (seen != count / 2)
+        fail("wrong number count");
+    free(data);
+}
+
+static void test_error(void) {
+    struct LaxJsonParallelSlice slices[MAX_SLICES];
+    int slice_count;
+    int size;
+    char *data = make_array(20000, &size);
+
+    char *bad = strstr(data + size / 2, "id:");
+    int line = 1;
+    char *p;
+
+    *bad = '!';
+    for (p = data; p < bad; p += 1)
+        line += *p == '\n';
+    if (lax_json_parse_parallel(size, data, MAX_SLICES, init, NULL, slices, &slice_count) !=
+            LaxJsonErrorUnexpectedChar)
+    {
+        fail("expected error");
+    }
+    if (slices[0].line != line || slices[0].column != 5)
+        fail("wrong error location");
+    free(data);
+}
+
+int main(int argc, char *argv[]) {
+    fprintf(stderr, "testing parallel split...");
+    test_split();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing parallel fallback...");
+    test_fallback();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing nested array is not split...");
+    test_not_top_level();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing number callbacks...");
+    test_number_callbacks();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing parallel scalars...");
+    test_scalars();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing parallel error...");
+    test_error();
+    fprintf(stderr, "OK\n");
+
+    return 0;
+}
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/uio.h>
 
 static char out_buf[16384];
 static int out_buf_index;
@@ -82,6 +83,13 @@ static int on_end_build(struct LaxJsonContext *context, enum LaxJsonType type)
     return 0;
 }
 
+static int on_raw_number_build(struct LaxJsonContext *context, const char *value, int length,
+        int flags)
+{
+    out_buf_index += snprintf(&out_buf[out_buf_index], 80, "number %.*s %d\n", length, value, flags);
+    return 0;
+}
+
 static void check_build(struct LaxJsonContext *context, const char *output) {
     int expected_len = strlen(output);
     enum LaxJsonError err = lax_json_eof(context);
@@ -129,12 +137,16 @@ static struct LaxJsonContext *init_for_build(void) {
     return context;
 }
 
-static void check_error(const char *input, enum LaxJsonError error, int line, int col) {
+static void check_error_mode(const char *input, enum LaxJsonError error, int line, int col,
+        int validate_utf8)
+{
     struct LaxJsonContext *context = init_for_build();
 
     int size = strlen(input);
-    enum LaxJsonError err = lax_json_feed(context, size, input);
+    enum LaxJsonError err;
 
+    context->validate_utf8 = validate_utf8;
+    err = lax_json_feed(context, size, input);
     if (err == LaxJsonErrorNone)
         err = lax_json_eof(context);
 
@@ -156,6 +168,13 @@ static void check_error(const char *input, enum LaxJsonError error, int line, in
     lax_json_destroy(context);
 }
 
+static void check_error(const char *input, enum LaxJsonError error, int line, int col) {
+    check_error_mode(input, error, line, col, 0);
+}
+
+static void check_utf8_error(const char *input, enum LaxJsonError error, int line, int col) {
+    check_error_mode(input, error, line, col, 1);
+}
 
 static void test_false(void) {
     struct LaxJsonContext *context = init_for_build();
@@ -389,6 +408,92 @@ static void test_unicode_text(void) {
             );
 }
 
+static void test_surrogate_pair(void) {
+    struct LaxJsonContext *context = init_for_build();
+
+    context->validate_utf8 = 1;
+    feed(context, "[\"\\ud83d\\ude00 \\uD834\\uDD1E\"]");
+
+    check_build(context,
+            "begin array\n"
+            "string\n"
+            "\xf0\x9f\x98\x80 \xf0\x9d\x84\x9e\n"
+            "end array\n"
+            );
+}
+
+static void test_lone_surrogate(void) {
+    struct LaxJsonContext *context = init_for_build();
+
+    /* without validation these are encoded as if they were code points */
+    feed(context, "['\\ud800x', '\\udc00', '\\ud800\\n', '\\ud800\\u0041']");
+
+    check_build(context,
+            "begin array\n"
+            "string\n"
+            "\xed\xa0\x80x\n"
+            "string\n"
+            "\xed\xb0\x80\n"
+            "string\n"
+            "\xed\xa0\x80\n\n"
+            "string\n"
+            "\xed\xa0\x80" "A\n"
+            "end array\n"
+            );
+
+    check_utf8_error("['\\ud800x']", LaxJsonErrorInvalidUnicodePoint, 1, 9);
+    check_utf8_error("['\\udc00']", LaxJsonErrorInvalidUnicodePoint, 1, 8);
+    check_utf8_error("['\\ud800\\u0041']", LaxJsonErrorInvalidUnicodePoint, 1, 14);
+}
+
+static void test_utf8_split(void) {
+    const char *input =
+        "{ 'caf\xc3\xa9 long enough for a whole vector': "
+        "\"\xe4\xb8\xad\xe6\x96\x87 and \xf0\x9f\x98\x80, plenty of ASCII around it\\n\" }";
+    struct LaxJsonContext *context = init_for_build();
+    int i;
+
+    /* one byte at a time, so every sequence is split across feeds */
+    context->validate_utf8 = 1;
+    for (i = 0; input[i]; i += 1) {
+        if (lax_json_feed(context, 1, input + i)) {
+            fprintf(stderr, "unexpected error\n");
+            exit(1);
+        }
+    }
+
+    check_build(context,
+            "begin object\n"
+            "property\n"
+            "caf\xc3\xa9 long enough for a whole vector\n"
+            "string\n"
+            "\xe4\xb8\xad\xe6\x96\x87 and \xf0\x9f\x98\x80, plenty of ASCII around it\n\n"
+            "end object\n"
+            );
+}
+
+static void test_invalid_utf8(void) {
+    /* overlong */
+    check_utf8_error("['\xc0\x80']", LaxJsonErrorInvalidUtf8, 1, 3);
+    check_utf8_error("['\xe0\x80\x80']", LaxJsonErrorInvalidUtf8, 1, 4);
+    /* surrogate */
+    check_utf8_error("['\xed\xa0\x80']", LaxJsonErrorInvalidUtf8, 1, 4);
+    /* past U+10FFFF */
+    check_utf8_error("['\xf4\x90\x80\x80']", LaxJsonErrorInvalidUtf8, 1, 4);
+    check_utf8_error("['\xf5']", LaxJsonErrorInvalidUtf8, 1, 3);
+    /* truncated by the end of the string or an escape */
+    check_utf8_error("['abc\xe4\xb8']", LaxJsonErrorInvalidUtf8, 1, 8);
+    check_utf8_error("['\xe4\\n']", LaxJsonErrorInvalidUtf8, 1, 4);
+    /* in a property, after a long run of ASCII */
+    check_utf8_error("{ 'a long property name here \xff': 1 }", LaxJsonErrorInvalidUtf8, 1, 30);
+    /* not checked unless asked for */
+    check_error("['\xff']", LaxJsonErrorNone, 1, 5);
+}
+
+static void test_string_location(void) {
+    check_error("{ a: 'multi\nline \xc3\xa9 string', b: !}", LaxJsonErrorUnexpectedChar, 2, 21);
+}
+
 static void test_escapes(void) {
     struct LaxJsonContext *context = init_for_build();
 
@@ -406,6 +511,428 @@ static void test_escapes(void) {
             );
 }
 
+static void test_raw_number(void) {
+    const char *input = "[1, -2.5, +3, 1.5e+3, -0.25E-2,12345678901234567890.125 ]";
+    const char *output =
+        "begin array\n"
+        "number 1 1\n"
+        "number -2.5 10\n"
+        "number 3 1\n"
+        "number 1.5e+3 6\n"
+        "number -0.25E-2 14\n"
+        "number 12345678901234567890.125 2\n"
+        "end array\n";
+    struct LaxJsonContext *context;
+    int i;
+
+    /* in place */
+    context = init_for_build();
+    context->raw_number = on_raw_number_build;
+    feed(context, input);
+    check_build(context, output);
+
+    /* copied, with every number split across feeds */
+    context = init_for_build();
+    context->raw_number = on_raw_number_build;
+    for (i = 0; input[i]; i += 1) {
+        if (lax_json_feed(context, 1, input + i)) {
+            fprintf(stderr, "unexpected error\n");
+            exit(1);
+        }
+    }
+    check_build(context, output);
+}
+
+static void check_int64(const char *value, enum LaxJsonError error, int64_t expected) {
+    enum LaxJsonError err;
+    int64_t x = 0;
+
+    err = lax_json_number_to_int64(value, strlen(value), &x);
+    if (err != error || (!err && x != expected)) {
+        fprintf(stderr, "%s: expected %s, received %s\n", value,
+                lax_json_str_err(error), lax_json_str_err(err));
+        exit(1);
+    }
+}
+
+static void test_number_conversion(void) {
+    double x;
+
+    check_int64("0", LaxJsonErrorNone, 0);
+    check_int64("-42", LaxJsonErrorNone, -42);
+    check_int64("9223372036854775807", LaxJsonErrorNone, INT64_MAX);
+    check_int64("-9223372036854775808", LaxJsonErrorNone, INT64_MIN);
+    check_int64("9223372036854775808", LaxJsonErrorTypeMismatch, 0);
+    check_int64("-9223372036854775809", LaxJsonErrorTypeMismatch, 0);
+    check_int64("1.5", LaxJsonErrorTypeMismatch, 0);
+
+    /* not NUL terminated */
+    if (lax_json_number_to_double("-2.5e+1]", 7, &x) || x != -25.0) {
+        fprintf(stderr, "wrong double\n");
+        exit(1);
+    }
+    if (lax_json_number_to_double("0.0000000000000000000000000000000000000000000000000000000000000001e+64",
+                70, &x) || x != 1.0)
+    {
+        fprintf(stderr, "wrong long double\n");
+        exit(1);
+    }
+}
+
+static int on_begin_skip(struct LaxJsonContext *context, enum LaxJsonType type) {
+    on_begin_build(context, type);
+    if (type == LaxJsonTypeArray)
+        lax_json_skip(context);
+    return 0;
+}
+
+static int on_string_skip(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    on_string_build(context, type, value, length);
+    if (type == LaxJsonTypeProperty && strcmp(value, "rest") == 0)
+        lax_json_skip(context);
+    return 0;
+}
+
+static int on_number_skip(struct LaxJsonContext *context, double x) {
+    on_number_build(context, x);
+    if (x == 2)
+        lax_json_skip(context);
+    return 0;
+}
+
+static int on_begin_abort_array(struct LaxJsonContext *context, enum LaxJsonType type) {
+    on_begin_build(context, type);
+    return type == LaxJsonTypeArray;
+}
+
+static void test_skip(void) {
+    const char *input =
+        "{ a: [1, 'two', [3], { b: 4 }, /* ] */ ']'], c: { rest: { d: [5] }, 'e': 6 },\n"
+        "  'rest': 7, f: 8 }";
+    struct LaxJsonContext *context;
+    char checkpoint[256];
+    int checkpoint_size;
+    int events_size;
+    char *big;
+    char *p;
+    int i;
+
+    for (i = 0; i < 2; i += 1) {
+        context = init_for_build();
+        context->begin = on_begin_skip;
+        context->string = on_string_skip;
+        if (i == 0) {
+            feed(context, input);
+        } else {
+            for (; *input; input += 1) {
+                if (lax_json_feed(context, 1, input))
+                    exit(1);
+            }
+        }
+        check_build(context,
+                "begin object\n"
+                "property\n"
+                "a\n"
+                "begin array\n"
+                "end array\n"
+                "property\n"
+                "c\n"
+                "begin object\n"
+                "property\n"
+                "rest\n"
+                "end object\n"
+                "property\n"
+                "rest\n"
+                "end object\n"
+                );
+    }
+
+    /* a begin callback that aborted does not leave skip thinking it is
+     * still inside it, when the parse is rolled back and goes on */
+    context = init_for_build();
+    context->number = on_number_skip;
+    feed(context, "{ c: { ");
+    checkpoint_size = lax_json_checkpoint(context, checkpoint, sizeof(checkpoint));
+    events_size = out_buf_index;
+    context->begin = on_begin_abort_array;
+    if (lax_json_feed(context, 4, "x: [") != LaxJsonErrorAborted)
+        exit(1);
+    context->begin = on_begin_build;
+    if (lax_json_restore(context, checkpoint, checkpoint_size))
+        exit(1);
+    out_buf_index = events_size;
+    feed(context, "b: 2, d: 3 }, e: 4 }");
+    check_build(context,
+            "begin object\n"
+            "property\n"
+            "c\n"
+            "begin object\n"
+            "property\n"
+            "b\n"
+            "number 2\n"
+            "end object\n"
+            "property\n"
+            "e\n"
+            "number 4\n"
+            "end object\n"
+            );
+
+    /* values in a skipped container are not buffered, even in pieces */
+    big = malloc(8200);
+    if (!big)
+        exit(1);
+    p = big + sprintf(big, "{ a: ['");
+    for (i = 0; i < 2000; i += 1)
+        p += sprintf(p, "\\n");
+    p += sprintf(p, "\\u00e9', {");
+    memset(p, 'k', 2000);
+    p += 2000;
+    sprintf(p, ": 123456789.5 }], b: 'x' }");
+    for (i = 0; i < 2; i += 1) {
+        context = init_for_build();
+        context->begin = on_begin_skip;
+        context->max_value_buffer_size = 1024;
+        if (i == 0) {
+            feed(context, big);
+        } else {
+            for (p = big; *p; p += 1) {
+                if (lax_json_feed(context, 1, p))
+                    exit(1);
+            }
+        }
+        check_build(context,
+                "begin object\n"
+                "property\n"
+                "a\n"
+                "begin array\n"
+                "end array\n"
+                "property\n"
+                "b\n"
+                "string\n"
+                "x\n"
+                "end object\n"
+                );
+    }
+    free(big);
+}
+
+static int depth_count;
+static int max_depth;
+
+static int on_begin_depth(struct LaxJsonContext *context, enum LaxJsonType type) {
+    depth_count += 1;
+    if (depth_count > max_depth)
+        max_depth = depth_count;
+    return 0;
+}
+
+static int on_end_depth(struct LaxJsonContext *context, enum LaxJsonType type) {
+    depth_count -= 1;
+    return 0;
+}
+
+static int on_string_ignore(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    return 0;
+}
+
+static void test_deep_nesting(void) {
+    struct LaxJsonContext *context;
+    const int depth = 200000;
+    char *input = malloc(depth * 12 + 64);
+    char *p = input;
+    int i;
+
+    if (!input)
+        exit(1);
+    /* alternate objects and arrays, with comments where colon and value
+     * states are pushed */
+    for (i = 0; i < depth; i += 2)
+        p += sprintf(p, "{'a'/**/:[//\n");
+    p += sprintf(p, "/**/ 1");
+    for (i = 0; i < depth; i += 2)
+        p += sprintf(p, "]}");
+
+    context = init_for_build();
+    context->string = on_string_ignore;
+    context->begin = on_begin_depth;
+    context->end = on_end_depth;
+    depth_count = 0;
+    max_depth = 0;
+    if (lax_json_feed(context, p - input, input) || lax_json_eof(context))
+        exit(1);
+    if (max_depth != depth || depth_count != 0)
+        exit(1);
+
+    /* the limit still applies */
+    lax_json_reset(context);
+    context->max_state_stack_size = 1000;
+    if (lax_json_feed(context, p - input, input) != LaxJsonErrorExceededMaxStack)
+        exit(1);
+    lax_json_destroy(context);
+    free(input);
+}
+
+static const char *offsets_input;
+
+static void add_event_slice(struct LaxJsonContext *context) {
+    add_buf(offsets_input + context->event_start, context->event_end - context->event_start);
+    add_buf("\n", 0);
+}
+
+static int on_string_slice(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    add_event_slice(context);
+    return 0;
+}
+
+static int on_number_slice(struct LaxJsonContext *context, double x) {
+    add_event_slice(context);
+    return 0;
+}
+
+static int on_type_slice(struct LaxJsonContext *context, enum LaxJsonType type) {
+    add_event_slice(context);
+    return 0;
+}
+
+static void test_event_offsets(void) {
+    const char *output =
+        "{\n"
+        "a\n"
+        "'x\\n'\n"
+        "\"b\"\n"
+        "[\n"
+        "1\n"
+        "-2.5e+3\n"
+        "+4\n"
+        "true\n"
+        "null\n"
+        "]\n"
+        "c\n"
+        "false\n"
+        "}\n";
+    struct LaxJsonContext *context;
+    struct LaxJsonToken token;
+    int i;
+
+    offsets_input = "// offsets\n{ a: 'x\\n', \"b\" : [1, -2.5e+3,+4,\ntrue, null], c:false }";
+    for (i = 0; i < 3; i += 1) {
+        context = init_for_build();
+        context->string = on_string_slice;
+        context->number = on_number_slice;
+        context->primitive = on_type_slice;
+        context->begin = on_type_slice;
+        context->end = on_type_slice;
+        if (i == 0) {
+            feed(context, offsets_input);
+        } else if (i == 1) {
+            const char *p;
+            for (p = offsets_input; *p; p += 1) {
+                if (lax_json_feed(context, 1, p))
+                    exit(1);
+            }
+        } else {
+            lax_json_input(context, strlen(offsets_input), offsets_input);
+            while (!lax_json_next(context, &token) && token.kind != LaxJsonTokenNeedInput) {
+                context->event_start = token.start;
+                context->event_end = token.end;
+                add_event_slice(context);
+            }
+        }
+        check_build(context, output);
+    }
+}
+
+/* Rebuilds the output of the callbacks from tokens, giving the input to the
+ * context chunk_size bytes at a time. */
+static struct LaxJsonContext *pull_build(const char *input, int chunk_size) {
+    struct LaxJsonContext *context = lax_json_create();
+    struct LaxJsonToken token;
+    enum LaxJsonError err;
+    int size = strlen(input);
+    int i;
+
+    if (!context)
+        exit(1);
+    out_buf_index = 0;
+    for (i = 0; i < size; i += chunk_size) {
+        lax_json_input(context, i + chunk_size < size ? chunk_size : size - i, input + i);
+        for (;;) {
+            if ((err = lax_json_next(context, &token))) {
+                fprintf(stderr, "line %d column %d parse error: %s\n", context->line,
+                        context->column, lax_json_str_err(err));
+                exit(1);
+            }
+            if (token.kind == LaxJsonTokenNeedInput)
+                break;
+            switch (token.kind) {
+                case LaxJsonTokenBegin:
+                    on_begin_build(context, token.type);
+                    break;
+                case LaxJsonTokenEnd:
+                    on_end_build(context, token.type);
+                    break;
+                case LaxJsonTokenString:
+                    if (token.value[token.length] != 0) {
+                        fprintf(stderr, "string not terminated\n");
+                        exit(1);
+                    }
+                    on_string_build(context, token.type, token.value, token.length);
+                    break;
+                case LaxJsonTokenNumber:
+                    on_raw_number_build(context, token.value, token.length, token.flags);
+                    break;
+                case LaxJsonTokenPrimitive:
+                    on_primitive_build(context, token.type);
+                    break;
+                default:
+                    exit(1);
+            }
+        }
+    }
+    return context;
+}
+
+static void test_pull(void) {
+    const char *input =
+        "// tokens instead of callbacks\n"
+        "{ name: 'pull', 'list': [1, -2.5e+1, true, null, { a: \"\\u00e9\" }], f: false }\n";
+    const char *output =
+        "begin object\n"
+        "property\n"
+        "name\n"
+        "string\n"
+        "pull\n"
+        "property\n"
+        "list\n"
+        "begin array\n"
+        "number 1 1\n"
+        "number -2.5e+1 14\n"
+        "true\n"
+        "null\n"
+        "begin object\n"
+        "property\n"
+        "a\n"
+        "string\n"
+        "\xc3\xa9\n"
+        "end object\n"
+        "end array\n"
+        "property\n"
+        "f\n"
+        "false\n"
+        "end object\n";
+    int chunk_sizes[] = {1, 2, 7, 1000};
+    int i;
+
+    for (i = 0; i < 4; i += 1)
+        check_build(pull_build(input, chunk_sizes[i]), output);
+}
+
 static void test_decimals(void) {
     struct LaxJsonContext *context = init_for_build();
 
@@ -420,6 +947,746 @@ static void test_decimals(void) {
             );
 }
 
+static int on_number_array_build(struct LaxJsonContext *context, const double *values, int count) {
+    int i;
+
+    out_buf_index += snprintf(&out_buf[out_buf_index], 30, "numbers %d:", count);
+    for (i = 0; i < count; i += 1)
+        out_buf_index += snprintf(&out_buf[out_buf_index], 30, " %g", values[i]);
+    add_buf("\n", 0);
+    return 0;
+}
+
+static int on_number_array_each(struct LaxJsonContext *context, const double *values, int count) {
+    int i;
+
+    for (i = 0; i < count; i += 1)
+        on_number_build(context, values[i]);
+    return 0;
+}
+
+static double *array_values;
+static int array_value_count;
+static int array_block_count;
+
+static int on_number_array_check(struct LaxJsonContext *context, const double *values, int count) {
+    char *end;
+    double x;
+    int i;
+
+    /* the block spans the text of its numbers */
+    for (i = 0; i < count; i += 1) {
+        x = strtod(offsets_input + context->event_start, &end);
+        if (x != values[i] || end - offsets_input > context->event_end)
+            exit(1);
+        if (end - offsets_input == context->event_end) {
+            if (i != count - 1)
+                exit(1);
+        } else {
+            context->event_start = strchr(end, ',') + 1 - offsets_input;
+        }
+        array_values[array_value_count++] = values[i];
+    }
+    array_block_count += 1;
+    return array_block_count == 3 && count == LAX_JSON_NUMBER_BLOCK && context->userdata;
+}
+
+static void test_number_array(void) {
+    const char *input =
+        "{ a: [1, 2.5, -3, +4,\n 5.0e+2 ], b: 7, c: [[1,2],[3], 'x', 4, 5, true, 6],\n"
+        "  d: [/* none */], e: [8 // eight\n, 9] }";
+    const char *output =
+        "begin object\n"
+        "property\n"
+        "a\n"
+        "begin array\n"
+        "numbers 5: 1 2.5 -3 4 500\n"
+        "end array\n"
+        "property\n"
+        "b\n"
+        "number 7\n"
+        "property\n"
+        "c\n"
+        "begin array\n"
+        "begin array\n"
+        "numbers 2: 1 2\n"
+        "end array\n"
+        "begin array\n"
+        "numbers 1: 3\n"
+        "end array\n"
+        "string\n"
+        "x\n"
+        "numbers 2: 4 5\n"
+        "true\n"
+        "numbers 1: 6\n"
+        "end array\n"
+        "property\n"
+        "d\n"
+        "begin array\n"
+        "end array\n"
+        "property\n"
+        "e\n"
+        "begin array\n"
+        "numbers 2: 8 9\n"
+        "end array\n"
+        "end object\n";
+    const int count = 1000;
+    struct LaxJsonContext *context;
+    char *big = malloc(count * 32 + 8);
+    char *expected;
+    char *p;
+    const char *q;
+    int i;
+
+    context = init_for_build();
+    context->number_array = on_number_array_build;
+    feed(context, input);
+    check_build(context, output);
+
+    /* a feed ends every block, so fed a byte at a time the numbers arrive
+     * one by one, the same as with the number callback */
+    context = init_for_build();
+    feed(context, input);
+    if (lax_json_eof(context))
+        exit(1);
+    expected = malloc(out_buf_index + 1);
+    if (!expected)
+        exit(1);
+    memcpy(expected, out_buf, out_buf_index);
+    expected[out_buf_index] = 0;
+    lax_json_destroy(context);
+    context = init_for_build();
+    context->number_array = on_number_array_each;
+    for (q = input; *q; q += 1) {
+        if (lax_json_feed(context, 1, q))
+            exit(1);
+    }
+    check_build(context, expected);
+    free(expected);
+
+    /* long runs are split into full blocks, with exactly the values strtod
+     * gives */
+    if (!big)
+        exit(1);
+    array_values = malloc(count * sizeof(double));
+    if (!array_values)
+        exit(1);
+    p = big;
+    p += sprintf(p, "[");
+    for (i = 0; i < count; i += 1) {
+        if (i % 3 == 0)
+            p += sprintf(p, "%.17g, ", i / 7.0);
+        else if (i % 3 == 1)
+            p += sprintf(p, "-%d.%03d,", i, i % 1000);
+        else
+            p += sprintf(p, "%d,\n", i * 1000003);
+    }
+    sprintf(p, "]");
+    offsets_input = big;
+    context = init_for_build();
+    context->number_array = on_number_array_check;
+    array_value_count = 0;
+    array_block_count = 0;
+    feed(context, big);
+    if (lax_json_eof(context) || array_value_count != count ||
+        array_block_count != (count + LAX_JSON_NUMBER_BLOCK - 1) / LAX_JSON_NUMBER_BLOCK)
+    {
+        exit(1);
+    }
+    for (i = 0, q = big + 1; i < count; i += 1) {
+        if (array_values[i] != strtod(q, (char **)&q))
+            exit(1);
+        q = strchr(q, ',') + 1;
+    }
+
+    /* and number_array can abort */
+    lax_json_reset(context);
+    context->userdata = context;
+    array_value_count = 0;
+    array_block_count = 0;
+    if (lax_json_feed(context, strlen(big), big) != LaxJsonErrorAborted ||
+        array_value_count != 3 * LAX_JSON_NUMBER_BLOCK)
+    {
+        exit(1);
+    }
+    lax_json_destroy(context);
+    free(array_values);
+    free(big);
+
+    /* numbers before an error are passed, as number would see them */
+    context = init_for_build();
+    context->number_array = on_number_array_build;
+    if (lax_json_feed(context, 14, "[0.1, -0, 7 !]") != LaxJsonErrorUnexpectedChar)
+        exit(1);
+    q = "begin array\nnumbers 3: 0.1 -0 7\n";
+    if (out_buf_index != (int)strlen(q) || memcmp(out_buf, q, out_buf_index))
+        exit(1);
+    lax_json_destroy(context);
+}
+
+static int on_number_array_ignore(struct LaxJsonContext *context, const double *values, int count) {
+    return 0;
+}
+
+/* Parses input chunk_size bytes at a time with content hashing on. */
+static uint64_t content_hash_of(const char *input, int chunk_size, int use_number_array) {
+    struct LaxJsonContext *context = init_for_build();
+    int size = strlen(input);
+    uint64_t hash;
+    int i;
+
+    context->hash_content = 1;
+    context->string = on_string_ignore;
+    if (use_number_array)
+        context->number_array = on_number_array_ignore;
+    for (i = 0; i < size; i += chunk_size) {
+        if (lax_json_feed(context, i + chunk_size < size ? chunk_size : size - i, input + i))
+            exit(1);
+        out_buf_index = 0;
+    }
+    if (lax_json_eof(context))
+        exit(1);
+    hash = context->content_hash;
+    lax_json_destroy(context);
+    return hash;
+}
+
+static void test_content_hash(void) {
+    const char *input =
+        "// settings\n"
+        "{ name: 'x\\u0041', 'n': +1.50, list: [1, 2.0e+0, -0 /* zero */],\n"
+        "  t: true, e: {} }\n";
+    const char *same = "{\"name\":\"xA\",\"n\":1.5,\"list\":[1.0,2,0],\"t\":true,\"e\":{}}";
+    const char *different[] = {
+        "{\"name\":\"xA\",\"n\":1.51,\"list\":[1.0,2,0],\"t\":true,\"e\":{}}",
+        "{\"name\":\"xA\",\"n\":\"1.5\",\"list\":[1.0,2,0],\"t\":true,\"e\":{}}",
+        "{\"name\":\"xA\",\"n\":1.5,\"list\":[1.0,2],\"t\":true,\"e\":{}}",
+        "{\"name\":\"xA\",\"n\":1.5,\"list\":[1.0,2,0],\"t\":false,\"e\":{}}",
+        "{\"name\":\"xA\",\"n\":1.5,\"list\":[1.0,2,0],\"t\":true,\"e\":[]}",
+        "{\"name\":\"x\",\"A\":1.5,\"list\":[1.0,2,0],\"t\":true,\"e\":{}}",
+        "{\"nam\":\"exA\",\"n\":1.5,\"list\":[1.0,2,0],\"t\":true,\"e\":{}}",
+        NULL,
+    };
+    struct LaxJsonContext *context;
+    struct LaxJsonToken token;
+    uint64_t hash = content_hash_of(input, 1000, 0);
+    int i;
+
+    if (hash == 0 || content_hash_of(same, 1000, 0) != hash)
+        exit(1);
+    for (i = 0; different[i]; i += 1) {
+        if (content_hash_of(different[i], 1000, 0) == hash)
+            exit(1);
+    }
+
+    /* however the input is fed and the events are delivered */
+    if (content_hash_of(input, 1, 0) != hash || content_hash_of(input, 7, 1) != hash ||
+        content_hash_of(input, 1000, 1) != hash)
+    {
+        exit(1);
+    }
+    context = lax_json_create();
+    if (!context)
+        exit(1);
+    context->hash_content = 1;
+    lax_json_input(context, strlen(input), input);
+    while (!lax_json_next(context, &token) && token.kind != LaxJsonTokenNeedInput) {}
+    if (lax_json_eof(context) || context->content_hash != hash)
+        exit(1);
+
+    /* off by default, and reset with the context */
+    lax_json_reset(context);
+    if (context->content_hash != 0)
+        exit(1);
+    context->hash_content = 0;
+    lax_json_input(context, strlen(input), input);
+    while (!lax_json_next(context, &token) && token.kind != LaxJsonTokenNeedInput) {}
+    if (lax_json_eof(context) || context->content_hash != 0)
+        exit(1);
+    lax_json_destroy(context);
+}
+
+static int on_error_build(struct LaxJsonContext *context, enum LaxJsonError err) {
+    out_buf_index += snprintf(&out_buf[out_buf_index], 100, "error %s at %d:%d record %d-%d\n",
+            lax_json_str_err(err), context->line, context->column,
+            (int)context->event_start, (int)context->event_end);
+    return context->userdata != NULL;
+}
+
+static void test_records(void) {
+    const char *input =
+        "{\"a\": 1}\n"
+        "\n"
+        "// note\n"
+        "{\"a\": 2, oops}\n"
+        "[1, 2\n"
+        "  \"x\" // c\n"
+        "{\"a\": 3} {\"b\": 4}\n"
+        "{\"a\": 5}";
+    const char *output =
+        "begin object\n"
+        "property\n"
+        "a\n"
+        "number 1\n"
+        "end object\n"
+        "begin object\n"
+        "property\n"
+        "a\n"
+        "number 2\n"
+        "error unexpected character at 4:14 record 18-32\n"
+        "begin array\n"
+        "number 1\n"
+        "number 2\n"
+        "error unexpected end of file at 5:5 record 33-38\n"
+        "string\n"
+        "x\n"
+        "begin object\n"
+        "property\n"
+        "a\n"
+        "number 3\n"
+        "end object\n"
+        "error expected end of file at 7:10 record 50-60\n"
+        "begin object\n"
+        "property\n"
+        "a\n"
+        "number 5\n"
+        "end object\n";
+    struct LaxJsonContext *context;
+    const char *p;
+
+    context = init_for_build();
+    context->record_delimiter = '\n';
+    context->error = on_error_build;
+    feed(context, input);
+    if (lax_json_eof(context) || context->good_records != 3 || context->bad_records != 3)
+        exit(1);
+    check_build(context, output);
+
+    /* split anywhere, even in the middle of a record being skipped */
+    context = init_for_build();
+    context->record_delimiter = '\n';
+    context->error = on_error_build;
+    for (p = input; *p; p += 1) {
+        if (lax_json_feed(context, 1, p))
+            exit(1);
+    }
+    if (lax_json_eof(context) || context->good_records != 3 || context->bad_records != 3)
+        exit(1);
+    check_build(context, output);
+
+    /* without an error callback the first bad record fails the feed */
+    context = init_for_build();
+    context->record_delimiter = '\n';
+    if (lax_json_feed(context, strlen(input), input) != LaxJsonErrorUnexpectedChar ||
+        context->good_records != 1 || context->bad_records != 1 ||
+        context->line != 4 || context->column != 14)
+    {
+        exit(1);
+    }
+    lax_json_destroy(context);
+
+    /* the error callback can abort */
+    context = init_for_build();
+    context->record_delimiter = '\n';
+    context->error = on_error_build;
+    context->userdata = context;
+    if (lax_json_feed(context, strlen(input), input) != LaxJsonErrorAborted)
+        exit(1);
+    lax_json_destroy(context);
+
+    /* any byte can separate records */
+    context = init_for_build();
+    context->record_delimiter = ';';
+    context->error = on_error_build;
+    feed(context, "1;[2,\n3];;'x;true");
+    if (lax_json_eof(context) || context->good_records != 3 || context->bad_records != 1)
+        exit(1);
+    check_build(context,
+            "number 1\n"
+            "begin array\n"
+            "number 2\n"
+            "number 3\n"
+            "end array\n"
+            "error unexpected end of file at 2:6 record 10-12\n"
+            "true\n");
+
+    /* a literal cut off by the end of the record. Literals are reported
+     * at their first letter. */
+    context = init_for_build();
+    context->record_delimiter = '\n';
+    context->error = on_error_build;
+    feed(context, "tru\n[fals\nnull");
+    if (lax_json_eof(context) || context->good_records != 1 || context->bad_records != 2)
+        exit(1);
+    check_build(context,
+            "true\n"
+            "error unexpected end of file at 1:3 record 0-3\n"
+            "begin array\n"
+            "false\n"
+            "error unexpected end of file at 2:5 record 4-9\n"
+            "null\n");
+}
+
+static enum LaxJsonError parse_for_error(const char *input, int *line, int *column) {
+    struct LaxJsonContext *context = init_for_build();
+    enum LaxJsonError err;
+
+    context->string = on_string_ignore;
+    err = lax_json_feed(context, strlen(input), input);
+    if (!err)
+        err = lax_json_eof(context);
+    *line = context->line;
+    *column = context->column;
+    lax_json_destroy(context);
+    return err;
+}
+
+static void test_validate(void) {
+    const char *inputs[] = {
+        "// comment\n{ a: 'x\\n', \"b\" : [1, -2.5e+3,+4,\ntrue, null], c:false }",
+        "[ \"\\u00e9\\ud83d\\ude00\", {}, [[]], /* c */ 0.5 ]",
+        "  {\n      \"indented\": [\n          1,\n          2\n      ]\n  }\n  ",
+        "{a: 1",
+        "{a: 1}}",
+        "[1, 2.5e3]",
+        "[tru]",
+        "{'a' 1}",
+        "\"\\ud800\"",
+        "[1 /* unterminated",
+        "",
+        "['a\\'b', \"q\\\"\\\\\", 'x\\u0041y\\n', '\\q', {'k\\t': 1}]",
+        "{ 'a\nb\\n\nc': 1,\n 'x\\/' 2 }",
+        "['ok\\\\' 'bad']",
+        "['\\u00zz']",
+        NULL,
+    };
+    struct LaxJsonContext *context;
+    enum LaxJsonError expected;
+    int line;
+    int column;
+    char *deep;
+    char *big;
+    int i;
+
+    for (i = 0; inputs[i]; i += 1) {
+        expected = parse_for_error(inputs[i], &line, &column);
+        context = lax_json_create();
+        if (!context)
+            exit(1);
+        if (lax_json_validate(context, strlen(inputs[i]), inputs[i]) != expected ||
+            context->line != line || context->column != column)
+        {
+            fprintf(stderr, "%s: expected %s at %d:%d\n", inputs[i], lax_json_str_err(expected),
+                    line, column);
+            exit(1);
+        }
+        lax_json_destroy(context);
+        if (lax_json_validate(NULL, strlen(inputs[i]), inputs[i]) != expected)
+            exit(1);
+    }
+
+    /* limits and options of the context apply */
+    deep = malloc(2001);
+    if (!deep)
+        exit(1);
+    memset(deep, '[', 1000);
+    memset(deep + 1000, ']', 1000);
+    deep[2000] = 0;
+    context = lax_json_create();
+    if (!context)
+        exit(1);
+    if (lax_json_validate(context, 2000, deep))
+        exit(1);
+    lax_json_reset(context);
+    context->max_state_stack_size = 100;
+    if (lax_json_validate(context, 2000, deep) != LaxJsonErrorExceededMaxStack)
+        exit(1);
+    lax_json_reset(context);
+    context->validate_utf8 = 1;
+    if (lax_json_validate(context, 4, "'\xff'") != LaxJsonErrorInvalidUtf8)
+        exit(1);
+    lax_json_destroy(context);
+    free(deep);
+
+    /* escapes and bare names longer than max_value_buffer_size are fine */
+    big = malloc(8 * 1048576 + 8);
+    if (!big)
+        exit(1);
+    strcpy(big, "[\"");
+    for (i = 0; i < 1048576; i += 1)
+        memcpy(big + 2 + 8 * i, i % 2 ? "\\n\\n\\n\\n" : "\\u00e9\\t", 8);
+    strcpy(big + 2 + 8 * 1048576, "\"]");
+    if (lax_json_validate(NULL, strlen(big), big))
+        exit(1);
+    big[0] = '{';
+    memset(big + 1, 'k', 2 * 1048576);
+    strcpy(big + 1 + 2 * 1048576, ":1}");
+    if (lax_json_validate(NULL, strlen(big), big))
+        exit(1);
+    free(big);
+}
+
+static int on_number_ignore(struct LaxJsonContext *context, double x) {
+    return 0;
+}
+
+static int on_type_ignore(struct LaxJsonContext *context, enum LaxJsonType type) {
+    return 0;
+}
+
+static const char *key_values[16];
+static int key_ids[16];
+static int key_count;
+
+static int on_string_key(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    if (type == LaxJsonTypeProperty) {
+        key_values[key_count] = value;
+        key_ids[key_count] = context->key_id;
+        key_count += 1;
+    }
+    return 0;
+}
+
+static int on_key_evicted(struct LaxJsonContext *context, int id, const char *value, int length) {
+    out_buf_index += snprintf(&out_buf[out_buf_index], 64, "evicted %d %.*s\n", id, length, value);
+    return 0;
+}
+
+static void test_interned_keys(void) {
+    struct LaxJsonContext *context = init_for_build();
+    struct LaxJsonToken token;
+    char long_key[LAX_JSON_MAX_INTERNED_LENGTH + 8];
+    const char *a;
+
+    context->string = on_string_key;
+    context->number = on_number_ignore;
+    context->begin = on_type_ignore;
+    context->end = on_type_ignore;
+    context->key_evicted = on_key_evicted;
+    context->max_interned_keys = 4;
+    context->record_delimiter = '\n';
+
+    /* the same name, however it is quoted, is the same pointer and id */
+    key_count = 0;
+    feed(context, "{a: 1, \"b\": 2}\n{'b': 3, a: 4}\n");
+    if (key_count != 4 || key_values[0] != key_values[3] || key_values[1] != key_values[2] ||
+        key_values[0] == key_values[1] || strcmp(key_values[0], "a") != 0 ||
+        key_ids[0] != 0 || key_ids[1] != 1 || key_ids[2] != 1 || key_ids[3] != 0)
+    {
+        exit(1);
+    }
+    a = key_values[0];
+
+    /* once full, names seen again since they were added outlive c, which
+     * was not */
+    key_count = 0;
+    feed(context, "{c: 1, d: 2, a: 3, e: 4, a: 5}\n");
+    if (key_ids[0] != 2 || key_ids[1] != 3 || key_ids[2] != 0 || key_ids[3] != 2 ||
+        key_values[4] != a || strcmp(key_values[3], "e") != 0)
+    {
+        exit(1);
+    }
+    if (out_buf_index != (int)strlen("evicted 2 c\n") || memcmp(out_buf, "evicted 2 c\n", out_buf_index))
+        exit(1);
+
+    /* long names are passed as they are */
+    memset(long_key, 'k', LAX_JSON_MAX_INTERNED_LENGTH);
+    strcpy(long_key + LAX_JSON_MAX_INTERNED_LENGTH, ": 1}\n");
+    key_count = 0;
+    feed(context, "{");
+    feed(context, long_key);
+    if (key_count != 1 || key_ids[0] != -1 || key_values[0] == long_key)
+        exit(1);
+
+    /* interned names outlive reset, and are in tokens too */
+    lax_json_reset(context);
+    context->record_delimiter = 0;
+    lax_json_input(context, 7, "{a: 1}\n");
+    while (!lax_json_next(context, &token) && token.kind != LaxJsonTokenNeedInput) {
+        if (token.kind == LaxJsonTokenString && (token.value != a || context->key_id != 0))
+            exit(1);
+    }
+    if (lax_json_eof(context))
+        exit(1);
+    lax_json_destroy(context);
+}
+
+
+static const char *segments_start;
+static const char *segments_end;
+static int numbers_in_place;
+
+static int on_raw_number_segments(struct LaxJsonContext *context, const char *value, int length,
+        int flags)
+{
+    if (value >= segments_start && value < segments_end)
+        numbers_in_place += 1;
+    return on_raw_number_build(context, value, length, flags);
+}
+
+static int strings_in_place;
+
+static int on_raw_string_segments(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    if (value >= segments_start && value < segments_end)
+        strings_in_place += 1;
+    /* not NUL terminated, even when empty */
+    add_buf(type_to_str(type), 0);
+    add_buf("\n", 0);
+    if (length)
+        add_buf(value, length);
+    add_buf("\n", 0);
+    return 0;
+}
+
+/* Whether the token from start to end is split by a cut at i or j */
+static int is_cut(int start, int end, int i, int j) {
+    return (i > start && i <= end) || (j > start && j <= end);
+}
+
+static void test_feedv(void) {
+    const char input[] = "{a: [1, -2.5, 'x y'], \"bb\": 12.75, c: [3, 4, 5, 'e\\'s'], d: true}";
+    const int size = sizeof(input) - 1;
+    const int number_count = 6;
+    /* 'x y' and "bb"; the escaped one is always copied */
+    const int string_starts[] = {14, 22};
+    const int string_ends[] = {18, 25};
+    struct LaxJsonContext *context;
+    struct iovec iov[3];
+    char expected[1024];
+    char data[sizeof(input)];
+    const char *number_chars = "-.0123456789";
+    int copied;
+    int strings_copied;
+    int i, j, k, end;
+
+    context = init_for_build();
+    context->raw_number = on_raw_number_build;
+    feed(context, input);
+    if (lax_json_eof(context))
+        exit(1);
+    memcpy(expected, out_buf, out_buf_index);
+    expected[out_buf_index] = 0;
+    lax_json_destroy(context);
+
+    /* cut in three at every pair of offsets; only a number or string a cut
+     * falls inside or just after is copied */
+    memcpy(data, input, size);
+    segments_start = data;
+    segments_end = data + size;
+    for (i = 0; i <= size; i += 1) {
+        for (j = i; j <= size; j += 1) {
+            iov[0].iov_base = data;
+            iov[0].iov_len = i;
+            iov[1].iov_base = data + i;
+            iov[1].iov_len = j - i;
+            iov[2].iov_base = data + j;
+            iov[2].iov_len = size - j;
+            copied = 0;
+            for (k = 0; k < size; k = end) {
+                end = k + 1;
+                if (!strchr(number_chars, input[k]))
+                    continue;
+                end = k + strspn(input + k, number_chars);
+                if (is_cut(k, end, i, j))
+                    copied += 1;
+            }
+            strings_copied = 0;
+            for (k = 0; k < 2; k += 1) {
+                if (is_cut(string_starts[k], string_ends[k], i, j))
+                    strings_copied += 1;
+            }
+            numbers_in_place = 0;
+            strings_in_place = 0;
+            context = init_for_build();
+            context->raw_number = on_raw_number_segments;
+            context->raw_string = on_raw_string_segments;
+            if (lax_json_feedv(context, iov, 3))
+                exit(1);
+            check_build(context, expected);
+            if (numbers_in_place != number_count - copied ||
+                strings_in_place != 2 - strings_copied)
+            {
+                exit(1);
+            }
+        }
+    }
+
+    /* runs of numbers are passed whole, not at each segment */
+    context = init_for_build();
+    context->number_array = on_number_array_build;
+    iov[0].iov_base = (char *)"[1, 2";
+    iov[0].iov_len = 5;
+    iov[1].iov_base = (char *)"5, 3,";
+    iov[1].iov_len = 5;
+    iov[2].iov_base = (char *)" 4]";
+    iov[2].iov_len = 3;
+    if (lax_json_feedv(context, iov, 3))
+        exit(1);
+    check_build(context, "begin array\nnumbers 4: 1 25 3 4\nend array\n");
+}
+
+static void test_raw_string(void) {
+    const char *input = "{'a b': \"c\", d: ['e\\n', '', \"f\"], 'a b': 1}";
+    const char *invalid = "['ok', 'x\xff']";
+    struct LaxJsonContext *context;
+    char expected[1024];
+    int column;
+
+    context = init_for_build();
+    feed(context, input);
+    if (lax_json_eof(context))
+        exit(1);
+    memcpy(expected, out_buf, out_buf_index);
+    expected[out_buf_index] = 0;
+    lax_json_destroy(context);
+
+    /* all but the escaped string point into the input */
+    segments_start = input;
+    segments_end = input + strlen(input);
+    strings_in_place = 0;
+    context = init_for_build();
+    context->raw_string = on_raw_string_segments;
+    feed(context, input);
+    check_build(context, expected);
+    if (strings_in_place != 5)
+        exit(1);
+
+    /* interned names are copied with a terminator */
+    strings_in_place = 0;
+    key_count = 0;
+    context = init_for_build();
+    context->raw_string = on_string_key;
+    context->number = on_number_ignore;
+    context->max_interned_keys = 4;
+    feed(context, input);
+    if (lax_json_eof(context) || key_count != 3 || key_values[0] != key_values[2] ||
+        strcmp(key_values[0], "a b") != 0)
+    {
+        exit(1);
+    }
+    lax_json_destroy(context);
+
+    /* invalid UTF-8 is found where it would be without raw_string */
+    context = init_for_build();
+    context->validate_utf8 = 1;
+    if (lax_json_feed(context, strlen(invalid), invalid) != LaxJsonErrorInvalidUtf8)
+        exit(1);
+    column = context->column;
+    lax_json_destroy(context);
+    context = init_for_build();
+    context->raw_string = on_raw_string_segments;
+    context->validate_utf8 = 1;
+    if (lax_json_feed(context, strlen(invalid), invalid) != LaxJsonErrorInvalidUtf8 ||
+        context->column != column)
+    {
+        exit(1);
+    }
+    lax_json_destroy(context);
+}
 
 struct Test {
     const char *name;
@@ -439,8 +1706,26 @@ static struct Test tests[] = {
     {"array of empty object", test_array_of_empty_object},
     {"unclosed value", test_unclosed_value},
     {"unicode text", test_unicode_text},
+    {"surrogate pair", test_surrogate_pair},
+    {"lone surrogate", test_lone_surrogate},
+    {"utf-8 split across feeds", test_utf8_split},
+    {"invalid utf-8", test_invalid_utf8},
+    {"location after string", test_string_location},
     {"escapes", test_escapes},
     {"decimal", test_decimals},
+    {"raw number", test_raw_number},
+    {"number conversion", test_number_conversion},
+    {"pull tokens", test_pull},
+    {"skip", test_skip},
+    {"event offsets", test_event_offsets},
+    {"deep nesting", test_deep_nesting},
+    {"number array", test_number_array},
+    {"content hash", test_content_hash},
+    {"records", test_records},
+    {"validate", test_validate},
+    {"interned keys", test_interned_keys},
+    {"feedv", test_feedv},
+    {"raw string", test_raw_string},
     {NULL, NULL},
 };
 
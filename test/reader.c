@@ -0,0 +1,277 @@
+#include <laxjson.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#ifdef LAXJSON_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static int value_count;
+static double number_sum;
+static long string_bytes;
+
+static void fail(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    value_count += 1;
+    string_bytes += length;
+    return 0;
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    value_count += 1;
+    number_sum += x;
+    return 0;
+}
+
+static int on_type(struct LaxJsonContext *context, enum LaxJsonType type) {
+    value_count += 1;
+    return 0;
+}
+
+static struct LaxJsonContext *create(void) {
+    struct LaxJsonContext *context = lax_json_create();
+    if (!context)
+        fail("out of memory");
+    context->string = on_string;
+    context->number = on_number;
+    context->primitive = on_type;
+    context->begin = on_type;
+    context->end = on_type;
+    value_count = 0;
+    number_sum = 0;
+    string_bytes = 0;
+    return context;
+}
+
+static char *make_document(int records, int *size_out) {
+    char *data = malloc(records * 64 + 16);
+    int size = 0;
+    int i;
+
+    size += sprintf(data + size, "[\n");
+    for (i = 0; i < records; i += 1)
+        size += sprintf(data + size, "  { id: %d, name: 'item %d', ok: true },\n", i, i);
+    size += sprintf(data + size, "]\n");
+    *size_out = size;
+    return data;
+}
+
+static int write_temp(const char *data, int size) {
+    char path[] = "/tmp/laxjson_reader_XXXXXX";
+    int fd = mkstemp(path);
+
+    if (fd < 0)
+        fail("unable to create temporary file");
+    unlink(path);
+    if (write(fd, data, size) != size)
+        fail("unable to write temporary file");
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+static void test_matches_feed(void) {
+    struct LaxJsonContext *context;
+    int expected_count;
+    double expected_sum;
+    long expected_bytes;
+    int size;
+    char *data = make_document(20000, &size);
+    int block_sizes[] = {7, 4096, 0};
+    int depths[] = {1, 2, 0};
+    int i;
+    int fd;
+
+    context = create();
+    if (lax_json_feed(context, size, data) || lax_json_eof(context))
+        fail("direct feed failed");
+    expected_count = value_count;
+    expected_sum = number_sum;
+    expected_bytes = string_bytes;
+    lax_json_destroy(context);
+
+    fd = write_temp(data, size);
+    for (i = 0; i < 3; i += 1) {
+        lseek(fd, 0, SEEK_SET);
+        context = create();
+        if (lax_json_feed_fd(context, fd, block_sizes[i], depths[i]) || lax_json_eof(context))
+            fail("pipelined feed failed");
+        if (value_count != expected_count || number_sum != expected_sum ||
+            string_bytes != expected_bytes)
+        {
+            fail("pipelined events differ");
+        }
+        if (context->offset != size)
+            fail("not all bytes fed");
+        lax_json_destroy(context);
+    }
+    close(fd);
+    free(data);
+}
+
+static void test_pipe(void) {
+    struct LaxJsonContext *context = create();
+    const char *text = "{ a: [1, 2, 3], b: 'pipe' }";
+    int fds[2];
+
+    if (pipe(fds))
+        fail("unable to create pipe");
+    if (write(fds[1], text, strlen(text)) != (int)strlen(text))
+        fail("unable to write pipe");
+    close(fds[1]);
+    if (lax_json_feed_fd(context, fds[0], 4, 2) || lax_json_eof(context))
+        fail("pipe feed failed");
+    if (value_count != 10 || number_sum != 6)
+        fail("pipe events wrong");
+    close(fds[0]);
+    lax_json_destroy(context);
+}
+
+static void test_errors(void) {
+    struct LaxJsonContext *context = create();
+    int size;
+    char *data = make_document(20000, &size);
+    int fds[2];
+    int fd;
+
+    /* the reader thread must stop while the ring is still full */
+    data[size / 2] = '!';
+    fd = write_temp(data, size);
+    if (lax_json_feed_fd(context, fd, 512, 2) != LaxJsonErrorUnexpectedChar)
+        fail("expected parse error");
+    close(fd);
+    lax_json_destroy(context);
+    free(data);
+
+    /* nor may it keep waiting on a writer that sends nothing more */
+    context = create();
+    if (pipe(fds))
+        fail("unable to create pipe");
+    if (write(fds[1], "[1, !", 5) != 5)
+        fail("unable to write pipe");
+    if (lax_json_feed_fd(context, fds[0], 0, 0) != LaxJsonErrorUnexpectedChar)
+        fail("expected parse error from pipe");
+    close(fds[0]);
+    close(fds[1]);
+    lax_json_destroy(context);
+
+    context = create();
+    if (lax_json_feed_fd(context, -1, 0, 0) != LaxJsonErrorIo)
+        fail("expected read error");
+    lax_json_destroy(context);
+}
+
+static void check_parse_file(const char *path, int expected_count, double expected_sum,
+        int size)
+{
+    struct LaxJsonContext *context = create();
+    enum LaxJsonError err = lax_json_parse_file(context, path);
+
+    if (err) {
+        fprintf(stderr, "%s: %s\n", path, lax_json_str_err(err));
+        exit(1);
+    }
+    if (value_count != expected_count || number_sum != expected_sum || context->offset != size)
+        fail("parse_file events differ");
+    lax_json_destroy(context);
+}
+
+static void check_parse_file_error(const char *path, enum LaxJsonError expected) {
+    struct LaxJsonContext *context = create();
+    if (lax_json_parse_file(context, path) != expected)
+        fail("expected parse_file error");
+    lax_json_destroy(context);
+}
+
+#ifdef LAXJSON_HAVE_ZLIB
+static void write_gzip(const char *path, const char *mode, const char *data, int size) {
+    gzFile f = gzopen(path, mode);
+    if (!f || gzwrite(f, data, size) != size || gzclose(f) != Z_OK)
+        fail("unable to write gzip file");
+}
+#endif
+
+static void test_parse_file(void) {
+    char dir[] = "/tmp/laxjson_reader_XXXXXX";
+    char path[64];
+    char gz_path[64];
+    char zst_path[64];
+    struct LaxJsonContext *context;
+    int expected_count;
+    double expected_sum;
+    int size;
+    char *data = make_document(50000, &size);
+    FILE *f;
+
+    context = create();
+    if (lax_json_feed(context, size, data) || lax_json_eof(context))
+        fail("direct feed failed");
+    expected_count = value_count;
+    expected_sum = number_sum;
+    lax_json_destroy(context);
+
+    if (!mkdtemp(dir))
+        fail("unable to create temporary directory");
+    snprintf(path, sizeof(path), "%s/data.json", dir);
+    snprintf(gz_path, sizeof(gz_path), "%s/data.json.gz", dir);
+    snprintf(zst_path, sizeof(zst_path), "%s/data.json.zst", dir);
+
+    f = fopen(path, "wb");
+    if (!f || fwrite(data, 1, size, f) != (size_t)size || fclose(f))
+        fail("unable to write file");
+    check_parse_file(path, expected_count, expected_sum, size);
+
+    /* two gzip members, as left by appending to a log */
+#ifdef LAXJSON_HAVE_ZLIB
+    write_gzip(gz_path, "wb", data, size / 3);
+    write_gzip(gz_path, "ab", data + size / 3, size - size / 3);
+    check_parse_file(gz_path, expected_count, expected_sum, size);
+    if (truncate(gz_path, 20000))
+        fail("unable to truncate");
+#else
+    f = fopen(gz_path, "wb");
+    if (!f || fwrite("\x1f\x8b\x08\x00", 1, 4, f) != 4 || fclose(f))
+        fail("unable to write file");
+#endif
+    check_parse_file_error(gz_path, LaxJsonErrorCompression);
+
+    /* a zstd frame header followed by garbage */
+    f = fopen(zst_path, "wb");
+    if (!f || fwrite("\x28\xb5\x2f\xfd garbage", 1, 12, f) != 12 || fclose(f))
+        fail("unable to write file");
+    check_parse_file_error(zst_path, LaxJsonErrorCompression);
+
+    unlink(zst_path);
+    unlink(gz_path);
+    unlink(path);
+    check_parse_file_error(path, LaxJsonErrorIo);
+    rmdir(dir);
+    free(data);
+}
+
+int main(int argc, char *argv[]) {
+    fprintf(stderr, "testing pipelined feed...");
+    test_matches_feed();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing pipelined feed from a pipe...");
+    test_pipe();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing pipelined feed errors...");
+    test_errors();
+    fprintf(stderr, "OK\n");
+
+    fprintf(stderr, "testing parse_file...");
+    test_parse_file();
+    fprintf(stderr, "OK\n");
+
+    return 0;
+}
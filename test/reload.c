@@ -0,0 +1,244 @@
+#include <laxjson_reload.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#define READER_COUNT 4
+#define REWRITE_COUNT 50
+
+static char dir[] = "/tmp/laxjson_test_XXXXXX";
+static char path[64];
+static char tmp_path[64];
+
+static atomic_int reload_count;
+static atomic_int error_count;
+static int error_line;
+static int error_column;
+
+static void fail(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static void write_file(const char *file_path, const char *data) {
+    FILE *f = fopen(file_path, "wb");
+    if (!f || fwrite(data, 1, strlen(data), f) != strlen(data) || fclose(f))
+        fail("unable to write file");
+}
+
+/* replaces the file the way editors and deploy tools do */
+static void replace_file(const char *data) {
+    write_file(tmp_path, data);
+    if (rename(tmp_path, path))
+        fail("unable to rename");
+}
+
+static void on_reload(struct LaxJsonReloader *reloader, enum LaxJsonError err,
+        int line, int column, void *userdata)
+{
+    if (err) {
+        error_line = line;
+        error_column = column;
+        atomic_fetch_add(&error_count, 1);
+    }
+    atomic_fetch_add(&reload_count, 1);
+}
+
+/* waits for the background thread to try count reloads in all */
+static void wait_for_reloads(int count) {
+    struct timespec ts = {0, 1000000};
+    int i;
+
+    for (i = 0; i < 10000 && atomic_load(&reload_count) < count; i += 1)
+        nanosleep(&ts, NULL);
+    if (atomic_load(&reload_count) < count)
+        fail("timed out waiting for reload");
+}
+
+static double get_number(const struct LaxJsonDocument *doc, const char *key) {
+    const struct LaxJsonNode *node = lax_json_object_get(doc, lax_json_document_root(doc), key);
+    if (!node || node->type != LaxJsonTypeNumber)
+        fail("missing number");
+    return node->u.number;
+}
+
+static void test_reload(void) {
+    struct LaxJsonReloader *reloader;
+    const struct LaxJsonDocument *held;
+    const struct LaxJsonDocument *doc;
+    int slot;
+
+    write_file(path, "{ version: 1 }");
+    atomic_store(&reload_count, 0);
+    atomic_store(&error_count, 0);
+    if (lax_json_reloader_create(NULL, path, 2, on_reload, NULL, &reloader))
+        fail("create failed");
+    slot = lax_json_reloader_register(reloader);
+    if (slot < 0 || lax_json_reloader_generation(reloader) != 1)
+        fail("register failed");
+
+    /* a document held across a reload stays valid */
+    held = lax_json_reloader_acquire(reloader, slot);
+    if (get_number(held, "version") != 1)
+        fail("wrong first version");
+    replace_file("{ version: 2 }");
+    wait_for_reloads(1);
+    if (get_number(held, "version") != 1)
+        fail("held document changed");
+    lax_json_reloader_release(reloader, slot);
+    doc = lax_json_reloader_acquire(reloader, slot);
+    if (get_number(doc, "version") != 2 || lax_json_reloader_generation(reloader) != 2)
+        fail("wrong second version");
+    lax_json_reloader_release(reloader, slot);
+
+    /* rewritten in place */
+    write_file(path, "{ version: 3 }");
+    wait_for_reloads(2);
+    doc = lax_json_reloader_acquire(reloader, slot);
+    if (get_number(doc, "version") != 3)
+        fail("wrong third version");
+    lax_json_reloader_release(reloader, slot);
+
+    /* a broken file keeps the last good document */
+    replace_file("{ version: 4,\n  oops }");
+    wait_for_reloads(3);
+    if (atomic_load(&error_count) != 1 || error_line != 2 || error_column != 8)
+        fail("expected parse error");
+    doc = lax_json_reloader_acquire(reloader, slot);
+    if (get_number(doc, "version") != 3 || lax_json_reloader_generation(reloader) != 3)
+        fail("broken file replaced document");
+    lax_json_reloader_release(reloader, slot);
+
+    /* other files in the directory are ignored */
+    write_file(tmp_path, "{ version: 5 }");
+    replace_file("{ version: 6 }");
+    wait_for_reloads(4);
+    if (atomic_load(&reload_count) != 4)
+        fail("reloaded for another file");
+
+    lax_json_reloader_unregister(reloader, slot);
+    lax_json_reloader_destroy(reloader);
+}
+
+static void test_slots(void) {
+    struct LaxJsonContext *context;
+    struct LaxJsonReloader *reloader;
+
+    write_file(path, "[]");
+    if (lax_json_reloader_create(NULL, path, 2, NULL, NULL, &reloader))
+        fail("create failed");
+    if (lax_json_reloader_register(reloader) != 0 || lax_json_reloader_register(reloader) != 1 ||
+        lax_json_reloader_register(reloader) != -1)
+    {
+        fail("wrong slots");
+    }
+    lax_json_reloader_unregister(reloader, 0);
+    if (lax_json_reloader_register(reloader) != 0)
+        fail("slot not reused");
+    lax_json_reloader_destroy(reloader);
+
+    /* the first parse must succeed */
+    write_file(path, "[1,\n!]");
+    context = lax_json_create();
+    if (!context)
+        fail("out of memory");
+    if (lax_json_reloader_create(context, path, 2, NULL, NULL, &reloader) !=
+            LaxJsonErrorUnexpectedChar || context->line != 2 || context->column != 1)
+    {
+        fail("expected error");
+    }
+    lax_json_destroy(context);
+    unlink(path);
+    if (lax_json_reloader_create(NULL, path, 2, NULL, NULL, &reloader) != LaxJsonErrorIo)
+        fail("expected io error");
+}
+
+static atomic_int stop_readers;
+
+/* Every version of the document has a and b equal, so a torn or freed
+ * document shows up as a mismatch, or as an error under a sanitizer. */
+static void *reader_main(void *arg) {
+    struct LaxJsonReloader *reloader = arg;
+    const struct LaxJsonDocument *doc;
+    double last = 0;
+    double a;
+    int slot = lax_json_reloader_register(reloader);
+
+    if (slot < 0)
+        fail("no slot");
+    while (!atomic_load(&stop_readers)) {
+        doc = lax_json_reloader_acquire(reloader, slot);
+        a = get_number(doc, "a");
+        if (a != get_number(doc, "b") || a < last)
+            fail("inconsistent document");
+        last = a;
+        lax_json_reloader_release(reloader, slot);
+    }
+    lax_json_reloader_unregister(reloader, slot);
+    return NULL;
+}
+
+static void test_concurrent_readers(void) {
+    struct LaxJsonReloader *reloader;
+    pthread_t threads[READER_COUNT];
+    char data[64];
+    int i;
+
+    write_file(path, "{ a: 0, b: 0 }");
+    atomic_store(&reload_count, 0);
+    atomic_store(&stop_readers, 0);
+    if (lax_json_reloader_create(NULL, path, READER_COUNT, on_reload, NULL, &reloader))
+        fail("create failed");
+    for (i = 0; i < READER_COUNT; i += 1) {
+        if (pthread_create(&threads[i], NULL, reader_main, reloader))
+            fail("unable to create thread");
+    }
+    for (i = 1; i <= REWRITE_COUNT; i += 1) {
+        sprintf(data, "{ a: %d, b: %d }", i, i);
+        replace_file(data);
+        wait_for_reloads(i);
+    }
+    atomic_store(&stop_readers, 1);
+    for (i = 0; i < READER_COUNT; i += 1)
+        pthread_join(threads[i], NULL);
+    if (lax_json_reloader_generation(reloader) != REWRITE_COUNT + 1)
+        fail("wrong generation");
+    lax_json_reloader_destroy(reloader);
+}
+
+struct Test {
+    const char *name;
+    void (*fn)(void);
+};
+
+static struct Test tests[] = {
+    {"reload", test_reload},
+    {"slots", test_slots},
+    {"concurrent readers", test_concurrent_readers},
+    {NULL, NULL},
+};
+
+int main(int argc, char *argv[]) {
+    struct Test *test = &tests[0];
+
+    if (!mkdtemp(dir))
+        fail("unable to create temporary directory");
+    snprintf(path, sizeof(path), "%s/config.json", dir);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/config.json.tmp", dir);
+
+    while (test->name) {
+        fprintf(stderr, "testing %s...", test->name);
+        test->fn();
+        fprintf(stderr, "OK\n");
+        test += 1;
+    }
+
+    unlink(path);
+    unlink(tmp_path);
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,1243 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+/* Reads a schema describing config types and writes a C parser specialized
+ * to them. The schema is itself lax JSON:
+ *
+ *   {
+ *     root: "server",
+ *     types: {
+ *       limit: { name: "string", max: { type: "int", default: 10 } },
+ *       server: {
+ *         host: { type: "string", default: "localhost" },
+ *         port: "int",
+ *         limits: "limit[]",
+ *         "max-bytes": { type: "int64", member: "max_bytes" },
+ *       },
+ *     },
+ *   }
+ *
+ * Field types are int, int64, double, bool, string, or the name of another
+ * type, optionally followed by [] for a dynamically sized array.
+ * See cmake/LaxJsonCodegen.cmake for using it from a build.
+ *
+ * The generated parser saves writing and keeping callbacks in step with the
+ * structs more than it saves time: most of its time is spent in the
+ * tokenizer that every other way of filling the structs shares too. */
+
+#include <laxjson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+enum Kind {
+    KindInt,
+    KindInt64,
+    KindDouble,
+    KindBool,
+    KindString,
+    KindStruct
+};
+
+static const char *KIND_NAMES[] = {"int", "int64", "double", "bool", "string"};
+static const char *KIND_C_TYPES[] = {"int", "long long", "double", "int", "char *"};
+
+struct Field {
+    char *key;
+    char *member;
+    char *type_spec;
+    enum Kind kind;
+    int type_index;
+    int is_array;
+    int has_default;
+    double default_number;
+    char *default_string;
+};
+
+struct Type {
+    char *name;
+    struct Field *fields;
+    int field_count;
+    int field_size;
+    int reachable;
+    int emitted;
+    int visiting;
+};
+
+struct Schema {
+    char *root;
+    int root_index;
+    struct Type *types;
+    int type_count;
+    int type_size;
+};
+
+struct Loader {
+    struct Schema *schema;
+    int depth;
+    char *keys[5];
+    char message[256];
+};
+
+static FILE *out;
+
+static void emit(const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(out, format, ap);
+    va_end(ap);
+}
+
+static void *xalloc(size_t size) {
+    void *ptr = calloc(1, size);
+    if (!ptr) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+static char *xstrdup(const char *str) {
+    char *copy = xalloc(strlen(str) + 1);
+    strcpy(copy, str);
+    return copy;
+}
+
+static int fail(struct Loader *loader, const char *message, const char *detail) {
+    snprintf(loader->message, sizeof(loader->message), "%s%s%s", message,
+            detail ? ": " : "", detail ? detail : "");
+    return 1;
+}
+
+static struct Type *add_type(struct Schema *schema, const char *name) {
+    struct Type *type;
+    if (schema->type_count >= schema->type_size) {
+        schema->type_size = schema->type_size ? schema->type_size * 2 : 8;
+        schema->types = realloc(schema->types, schema->type_size * sizeof(struct Type));
+        if (!schema->types) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    type = &schema->types[schema->type_count];
+    schema->type_count += 1;
+    memset(type, 0, sizeof(struct Type));
+    type->name = xstrdup(name);
+    return type;
+}
+
+static struct Field *add_field(struct Type *type, const char *key) {
+    struct Field *field;
+    if (type->field_count >= type->field_size) {
+        type->field_size = type->field_size ? type->field_size * 2 : 8;
+        type->fields = realloc(type->fields, type->field_size * sizeof(struct Field));
+        if (!type->fields) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    field = &type->fields[type->field_count];
+    type->field_count += 1;
+    memset(field, 0, sizeof(struct Field));
+    field->key = xstrdup(key);
+    return field;
+}
+
+static struct Type *current_type(struct Loader *loader) {
+    return &loader->schema->types[loader->schema->type_count - 1];
+}
+
+static struct Field *current_field(struct Loader *loader) {
+    struct Type *type = current_type(loader);
+    return &type->fields[type->field_count - 1];
+}
+
+static int on_string(struct LaxJsonContext *context,
+    enum LaxJsonType type, const char *value, int length)
+{
+    struct Loader *loader = context->userdata;
+    struct Field *field;
+
+    if (type == LaxJsonTypeProperty) {
+        if (loader->depth >= 5)
+            return fail(loader, "schema nested too deeply", NULL);
+        free(loader->keys[loader->depth]);
+        loader->keys[loader->depth] = xstrdup(value);
+        return 0;
+    }
+
+    if (loader->depth == 1 && strcmp(loader->keys[1], "root") == 0) {
+        free(loader->schema->root);
+        loader->schema->root = xstrdup(value);
+    } else if (loader->depth == 3) {
+        field = add_field(current_type(loader), loader->keys[3]);
+        field->type_spec = xstrdup(value);
+    } else if (loader->depth == 4) {
+        field = current_field(loader);
+        if (strcmp(loader->keys[4], "type") == 0) {
+            free(field->type_spec);
+            field->type_spec = xstrdup(value);
+        } else if (strcmp(loader->keys[4], "member") == 0) {
+            free(field->member);
+            field->member = xstrdup(value);
+        } else if (strcmp(loader->keys[4], "default") == 0) {
+            free(field->default_string);
+            field->default_string = xstrdup(value);
+            field->has_default = 1;
+        } else {
+            return fail(loader, "unknown field attribute", loader->keys[4]);
+        }
+    } else {
+        return fail(loader, "unexpected string", value);
+    }
+    return 0;
+}
+
+static int on_default(struct Loader *loader, double x) {
+    struct Field *field;
+    if (loader->depth != 4 || strcmp(loader->keys[4], "default") != 0)
+        return fail(loader, "unexpected value", NULL);
+    field = current_field(loader);
+    field->has_default = 1;
+    field->default_number = x;
+    return 0;
+}
+
+static int on_number(struct LaxJsonContext *context, double x) {
+    return on_default(context->userdata, x);
+}
+
+static int on_primitive(struct LaxJsonContext *context, enum LaxJsonType type) {
+    if (type == LaxJsonTypeNull)
+        return fail(context->userdata, "unexpected null", NULL);
+    return on_default(context->userdata, type == LaxJsonTypeTrue);
+}
+
+static int on_begin(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct Loader *loader = context->userdata;
+
+    if (type == LaxJsonTypeArray)
+        return fail(loader, "unexpected array", NULL);
+
+    loader->depth += 1;
+    if (loader->depth == 1)
+        return 0;
+    if (loader->depth == 2 && strcmp(loader->keys[1], "types") == 0)
+        return 0;
+    if (loader->depth == 3) {
+        add_type(loader->schema, loader->keys[2]);
+        return 0;
+    }
+    if (loader->depth == 4) {
+        add_field(current_type(loader), loader->keys[3]);
+        return 0;
+    }
+    return fail(loader, "unexpected object", loader->keys[loader->depth - 1]);
+}
+
+static int on_end(struct LaxJsonContext *context, enum LaxJsonType type) {
+    struct Loader *loader = context->userdata;
+    loader->depth -= 1;
+    return 0;
+}
+
+static int is_identifier(const char *str) {
+    const char *c;
+    if (!*str || (*str >= '0' && *str <= '9'))
+        return 0;
+    for (c = str; *c; c += 1) {
+        if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+              (*c >= '0' && *c <= '9') || *c == '_'))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int find_type(struct Schema *schema, const char *name) {
+    int i;
+    for (i = 0; i < schema->type_count; i += 1) {
+        if (strcmp(schema->types[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int resolve_field(struct Loader *loader, struct Type *type, struct Field *field) {
+    struct Schema *schema = loader->schema;
+    size_t len;
+    int i;
+
+    if (!field->type_spec)
+        return fail(loader, "missing type for field", field->key);
+    if (!field->member)
+        field->member = xstrdup(field->key);
+    if (!is_identifier(field->member))
+        return fail(loader, "field needs a member name that is a C identifier", field->key);
+
+    len = strlen(field->type_spec);
+    if (len > 2 && strcmp(field->type_spec + len - 2, "[]") == 0) {
+        field->is_array = 1;
+        field->type_spec[len - 2] = 0;
+    }
+
+    for (i = 0; i <= KindString; i += 1) {
+        if (strcmp(field->type_spec, KIND_NAMES[i]) == 0) {
+            field->kind = (enum Kind)i;
+            break;
+        }
+    }
+    if (i > KindString) {
+        field->kind = KindStruct;
+        field->type_index = find_type(schema, field->type_spec);
+        if (field->type_index < 0)
+            return fail(loader, "unknown type", field->type_spec);
+    }
+
+    if (field->has_default) {
+        if (field->is_array || field->kind == KindStruct)
+            return fail(loader, "only scalar fields can have defaults", field->key);
+        if ((field->kind == KindString) != (field->default_string != NULL))
+            return fail(loader, "default has the wrong type", field->key);
+    }
+
+    for (i = 0; i < type->field_count; i += 1) {
+        struct Field *other = &type->fields[i];
+        if (other == field || !other->member)
+            continue;
+        if (strcmp(other->member, field->member) == 0)
+            return fail(loader, "duplicate member", field->member);
+    }
+    return 0;
+}
+
+static void mark_reachable(struct Schema *schema, int index) {
+    struct Type *type = &schema->types[index];
+    int i;
+    if (type->reachable)
+        return;
+    type->reachable = 1;
+    for (i = 0; i < type->field_count; i += 1) {
+        if (type->fields[i].kind == KindStruct)
+            mark_reachable(schema, type->fields[i].type_index);
+    }
+}
+
+static int resolve(struct Loader *loader) {
+    struct Schema *schema = loader->schema;
+    struct Type *type;
+    int i, j;
+
+    if (!schema->root)
+        return fail(loader, "schema has no root type", NULL);
+    schema->root_index = find_type(schema, schema->root);
+    if (schema->root_index < 0)
+        return fail(loader, "unknown root type", schema->root);
+
+    for (i = 0; i < schema->type_count; i += 1) {
+        type = &schema->types[i];
+        if (!is_identifier(type->name))
+            return fail(loader, "type name is not a C identifier", type->name);
+        for (j = 0; j <= KindString; j += 1) {
+            if (strcmp(type->name, KIND_NAMES[j]) == 0)
+                return fail(loader, "type name is reserved", type->name);
+        }
+        for (j = 0; j < type->field_count; j += 1) {
+            if (resolve_field(loader, type, &type->fields[j]))
+                return 1;
+        }
+    }
+
+    mark_reachable(schema, schema->root_index);
+    return 0;
+}
+
+static void load_schema(const char *path, struct Schema *schema) {
+    struct LaxJsonContext *context;
+    struct Loader loader;
+    enum LaxJsonError err;
+    char buf[4096];
+    FILE *f;
+    size_t amt_read;
+    int i;
+
+    memset(&loader, 0, sizeof(loader));
+    loader.schema = schema;
+    for (i = 0; i < 5; i += 1)
+        loader.keys[i] = xstrdup("");
+
+    context = lax_json_create();
+    if (!context) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    context->userdata = &loader;
+    context->string = on_string;
+    context->number = on_number;
+    context->primitive = on_primitive;
+    context->begin = on_begin;
+    context->end = on_end;
+
+    f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    err = LaxJsonErrorNone;
+    while (!err && (amt_read = fread(buf, 1, sizeof(buf), f)))
+        err = lax_json_feed(context, amt_read, buf);
+    fclose(f);
+    if (!err)
+        err = lax_json_eof(context);
+    if (err) {
+        fprintf(stderr, "%s:%d:%d: %s\n", path, context->line, context->column,
+                (err == LaxJsonErrorAborted) ? loader.message : lax_json_str_err(err));
+        exit(1);
+    }
+    if (resolve(&loader)) {
+        fprintf(stderr, "%s: %s\n", path, loader.message);
+        exit(1);
+    }
+
+    lax_json_destroy(context);
+    for (i = 0; i < 5; i += 1)
+        free(loader.keys[i]);
+}
+
+/* name used in generated identifiers for an element kind */
+static const char *kind_name(struct Schema *schema, struct Field *field) {
+    if (field->kind == KindStruct)
+        return schema->types[field->type_index].name;
+    return KIND_NAMES[field->kind];
+}
+
+static void emit_c_type(struct Schema *schema, struct Field *field) {
+    if (field->kind == KindStruct)
+        emit("struct %s ", schema->types[field->type_index].name);
+    else if (field->kind == KindString)
+        emit("char *");
+    else
+        emit("%s ", KIND_C_TYPES[field->kind]);
+}
+
+static void emit_c_string(const char *str, int length) {
+    int i;
+    unsigned char c;
+    emit("\"");
+    for (i = 0; i < length; i += 1) {
+        c = (unsigned char)str[i];
+        if (c == '"' || c == '\\')
+            emit("\\%c", c);
+        else if (c < 0x20 || c >= 0x7f)
+            emit("\\%03o", c);
+        else
+            emit("%c", c);
+    }
+    emit("\"");
+}
+
+static int emit_struct(struct Schema *schema, int index) {
+    struct Type *type = &schema->types[index];
+    struct Field *field;
+    int i;
+
+    if (type->emitted)
+        return 0;
+    if (type->visiting) {
+        fprintf(stderr, "type %s contains itself\n", type->name);
+        return 1;
+    }
+    type->visiting = 1;
+    /* members held by value must be complete first */
+    for (i = 0; i < type->field_count; i += 1) {
+        field = &type->fields[i];
+        if (field->kind == KindStruct && !field->is_array && emit_struct(schema, field->type_index))
+            return 1;
+    }
+    type->visiting = 0;
+    type->emitted = 1;
+
+    emit("struct %s {\n", type->name);
+    for (i = 0; i < type->field_count; i += 1) {
+        field = &type->fields[i];
+        emit("    ");
+        emit_c_type(schema, field);
+        if (field->is_array) {
+            emit("*%s;\n", field->member);
+            emit("    int %s_count;\n", field->member);
+        } else {
+            emit("%s;\n", field->member);
+        }
+    }
+    emit("};\n\n");
+    return 0;
+}
+
+static int uses_array_of(struct Schema *schema, enum Kind kind, int type_index) {
+    struct Type *type;
+    int i, j;
+    for (i = 0; i < schema->type_count; i += 1) {
+        type = &schema->types[i];
+        if (!type->reachable)
+            continue;
+        for (j = 0; j < type->field_count; j += 1) {
+            if (type->fields[j].is_array && type->fields[j].kind == kind &&
+                (kind != KindStruct || type->fields[j].type_index == type_index))
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* whether any reachable field has the kind, or is an array if kind is -1 */
+static int uses_kind(struct Schema *schema, int kind) {
+    struct Type *type;
+    int i, j;
+    for (i = 0; i < schema->type_count; i += 1) {
+        type = &schema->types[i];
+        if (!type->reachable)
+            continue;
+        for (j = 0; j < type->field_count; j += 1) {
+            if ((kind < 0) ? type->fields[j].is_array : (int)type->fields[j].kind == kind)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+static const char *linkage(struct Schema *schema, int index) {
+    return (index == schema->root_index) ? "" : "static ";
+}
+
+static void emit_header(struct Schema *schema, const char *guard, const char *schema_path) {
+    const char *root = schema->root;
+    int i;
+
+    emit("/* Generated by laxjson_codegen from %s. Do not edit. */\n\n", schema_path);
+    emit("#ifndef %s\n#define %s\n\n", guard, guard);
+    emit("#include <laxjson.h>\n\n");
+    emit("#ifdef __cplusplus\nextern \"C\"\n{\n#endif /* __cplusplus */\n\n");
+
+    for (i = 0; i < schema->type_count; i += 1) {
+        if (schema->types[i].reachable && emit_struct(schema, i))
+            exit(1);
+    }
+
+    emit("struct %s_parser;\n\n", root);
+    emit("/* Sets every member of value to its default. */\n");
+    emit("void %s_init(struct %s *value);\n", root, root);
+    emit("/* Frees everything allocated for value, which must have been initialized. */\n");
+    emit("void %s_free(struct %s *value);\n\n", root, root);
+    emit("/* Initializes out and prepares to fill it from a stream. Whether or not\n"
+         " * parsing succeeds, out must later be freed with %s_free(). */\n", root);
+    emit("struct %s_parser *%s_parser_create(struct %s *out);\n", root, root, root);
+    emit("void %s_parser_destroy(struct %s_parser *parser);\n", root, root);
+    emit("enum LaxJsonError %s_parser_feed(struct %s_parser *parser, int size, const char *data);\n",
+            root, root);
+    emit("enum LaxJsonError %s_parser_eof(struct %s_parser *parser);\n", root, root);
+    emit("/* line and column of the context describe the location of an error */\n");
+    emit("struct LaxJsonContext *%s_parser_context(struct %s_parser *parser);\n\n", root, root);
+    emit("/* Parses a complete document. out must later be freed with %s_free(). */\n", root);
+    emit("enum LaxJsonError %s_parse(struct %s *out, int size, const char *data);\n\n", root, root);
+
+    emit("#ifdef __cplusplus\n}\n#endif /* __cplusplus */\n\n");
+    emit("#endif /* %s */\n", guard);
+}
+
+static void emit_key_function(struct Schema *schema, struct Type *type) {
+    struct Field *field;
+    int *lengths = xalloc((type->field_count + 1) * sizeof(int));
+    int length;
+    int i, j;
+    int done;
+
+    for (i = 0; i < type->field_count; i += 1)
+        lengths[i] = strlen(type->fields[i].key);
+
+    emit("static int %s_key(const char *key, int length) {\n", type->name);
+    emit("    switch (length) {\n");
+    for (i = 0; i < type->field_count; i += 1) {
+        length = lengths[i];
+        done = 0;
+        for (j = 0; j < i; j += 1)
+            done = done || (lengths[j] == length);
+        if (done)
+            continue;
+        emit("        case %d:\n", length);
+        for (j = i; j < type->field_count; j += 1) {
+            field = &type->fields[j];
+            if (lengths[j] != length)
+                continue;
+            emit("            if (memcmp(key, ");
+            emit_c_string(field->key, length);
+            emit(", %d) == 0)\n", length);
+            emit("                return %d;\n", j);
+        }
+        emit("            break;\n");
+    }
+    emit("    }\n");
+    emit("    return -1;\n");
+    emit("}\n\n");
+    free(lengths);
+}
+
+static void emit_init_free(struct Schema *schema, int index) {
+    struct Type *type = &schema->types[index];
+    struct Field *field;
+    int i;
+
+    emit("%svoid %s_init(struct %s *value) {\n", linkage(schema, index), type->name, type->name);
+    emit("    memset(value, 0, sizeof(struct %s));\n", type->name);
+    for (i = 0; i < type->field_count; i += 1) {
+        field = &type->fields[i];
+        if (field->is_array)
+            continue;
+        if (field->kind == KindStruct) {
+            emit("    %s_init(&value->%s);\n", schema->types[field->type_index].name, field->member);
+        } else if (field->has_default && field->kind == KindString) {
+            emit("    value->%s = dup_string(", field->member);
+            emit_c_string(field->default_string, strlen(field->default_string));
+            emit(", %d);\n", (int)strlen(field->default_string));
+        } else if (field->has_default && field->kind == KindBool) {
+            emit("    value->%s = %d;\n", field->member, field->default_number != 0);
+        } else if (field->has_default && field->kind == KindDouble) {
+            emit("    value->%s = %.17g;\n", field->member, field->default_number);
+        } else if (field->has_default) {
+            emit("    value->%s = %.0f;\n", field->member, field->default_number);
+        }
+    }
+    emit("}\n\n");
+
+    emit("%svoid %s_free(struct %s *value) {\n", linkage(schema, index), type->name, type->name);
+    for (i = 0; i < type->field_count; i += 1) {
+        field = &type->fields[i];
+        if (field->is_array)
+            emit("    free_%s_items(value->%s, value->%s_count);\n",
+                    kind_name(schema, field), field->member, field->member);
+        else if (field->kind == KindStruct)
+            emit("    %s_free(&value->%s);\n", schema->types[field->type_index].name, field->member);
+        else if (field->kind == KindString)
+            emit("    free(value->%s);\n", field->member);
+    }
+    emit("}\n\n");
+}
+
+static void emit_items_free(struct Schema *schema, enum Kind kind, int type_index) {
+    const char *name = (kind == KindStruct) ? schema->types[type_index].name : KIND_NAMES[kind];
+
+    emit("static void free_%s_items(", name);
+    if (kind == KindStruct)
+        emit("struct %s *items", name);
+    else if (kind == KindString)
+        emit("char **items");
+    else
+        emit("%s *items", KIND_C_TYPES[kind]);
+    emit(", int count) {\n");
+    if (kind == KindStruct || kind == KindString) {
+        emit("    int i;\n");
+        emit("    for (i = 0; i < count; i += 1)\n");
+        if (kind == KindStruct)
+            emit("        %s_free(&items[i]);\n", name);
+        else
+            emit("        free(items[i]);\n");
+    } else {
+        emit("    (void)count;\n");
+    }
+    emit("    free(items);\n");
+    emit("}\n\n");
+}
+
+/* calls fn for every element kind that some reachable array field uses */
+static void for_each_array_kind(struct Schema *schema,
+        void (*fn)(struct Schema *, enum Kind, int))
+{
+    int i;
+    for (i = 0; i <= KindString; i += 1) {
+        if (uses_array_of(schema, (enum Kind)i, 0))
+            fn(schema, (enum Kind)i, 0);
+    }
+    for (i = 0; i < schema->type_count; i += 1) {
+        if (uses_array_of(schema, KindStruct, i))
+            fn(schema, KindStruct, i);
+    }
+}
+
+static void emit_frame_kind(struct Schema *schema, enum Kind kind, int type_index) {
+    emit("    FrameArray_%s,\n", (kind == KindStruct) ? schema->types[type_index].name : KIND_NAMES[kind]);
+}
+
+static void emit_items_prototype(struct Schema *schema, enum Kind kind, int type_index) {
+    const char *name = (kind == KindStruct) ? schema->types[type_index].name : KIND_NAMES[kind];
+    if (kind == KindStruct)
+        emit("static void free_%s_items(struct %s *items, int count);\n", name, name);
+    else if (kind == KindString)
+        emit("static void free_string_items(char **items, int count);\n");
+    else
+        emit("static void free_%s_items(%s *items, int count);\n", name, KIND_C_TYPES[kind]);
+}
+
+/* the checks and store for a number, with `dest` as the target lvalue */
+static void emit_number_store(enum Kind kind, const char *indent, const char *dest) {
+    if (kind == KindInt) {
+        emit("%sif (!(x >= INT_MIN && x <= INT_MAX) || x != (int)x)\n", indent);
+        emit("%s    return mismatch(parser);\n", indent);
+        emit("%s%s = (int)x;\n", indent, dest);
+    } else if (kind == KindInt64) {
+        emit("%sif (!(x >= -9223372036854775808.0 && x < 9223372036854775808.0) ||\n", indent);
+        emit("%s    x != (long long)x)\n", indent);
+        emit("%s    return mismatch(parser);\n", indent);
+        emit("%s%s = (long long)x;\n", indent, dest);
+    } else {
+        emit("%s%s = x;\n", indent, dest);
+    }
+}
+
+enum ValueKind {
+    ValueString,
+    ValueNumber,
+    ValueBool,
+    ValueNull
+};
+
+static int accepts(enum ValueKind value, enum Kind kind) {
+    switch (value) {
+        case ValueString: return kind == KindString;
+        case ValueNumber: return kind == KindInt || kind == KindInt64 || kind == KindDouble;
+        case ValueBool: return kind == KindBool;
+        case ValueNull: return 1;
+    }
+    return 0;
+}
+
+static void emit_scalar_cases(struct Schema *schema, enum ValueKind value) {
+    struct Type *type;
+    struct Field *field;
+    char dest[256];
+    int i, j;
+
+    for (i = 0; i < schema->type_count; i += 1) {
+        type = &schema->types[i];
+        if (!type->reachable)
+            continue;
+        emit("        case Frame_%s:\n", type->name);
+        emit("            switch (field) {\n");
+        emit("                case -1:\n");
+        emit("                    return 0;\n");
+        for (j = 0; j < type->field_count; j += 1) {
+            field = &type->fields[j];
+            if (field->is_array || field->kind == KindStruct || !accepts(value, field->kind))
+                continue;
+            emit("                case %d:\n", j);
+            snprintf(dest, sizeof(dest), "((struct %s *)frame->ptr)->%s", type->name, field->member);
+            if (value == ValueString) {
+                emit("                    if (!(copy = dup_string(value, length)))\n");
+                emit("                        return oom(parser);\n");
+                emit("                    free(%s);\n", dest);
+                emit("                    %s = copy;\n", dest);
+            } else if (value == ValueNumber) {
+                emit_number_store(field->kind, "                    ", dest);
+            } else if (value == ValueBool) {
+                emit("                    %s = (type == LaxJsonTypeTrue);\n", dest);
+            }
+            emit("                    return 0;\n");
+        }
+        if (value == ValueNull) {
+            /* null keeps the default of any member */
+            emit("                default:\n");
+            emit("                    return 0;\n");
+        }
+        emit("            }\n");
+        emit("            return mismatch(parser);\n");
+    }
+
+    for (i = 0; i <= KindString; i += 1) {
+        const char *c_type = KIND_C_TYPES[i];
+        if (!uses_array_of(schema, (enum Kind)i, 0) || !accepts(value, (enum Kind)i))
+            continue;
+        emit("        case FrameArray_%s:\n", KIND_NAMES[i]);
+        if (value == ValueString) {
+            emit("            if (!(copy = dup_string(value, length)))\n");
+            emit("                return oom(parser);\n");
+            emit("            if (!(item = grow(parser, frame, sizeof(char *)))) {\n");
+            emit("                free(copy);\n");
+            emit("                return 1;\n");
+            emit("            }\n");
+            emit("            *(char **)item = copy;\n");
+        } else if (value == ValueNumber) {
+            emit("            if (!(item = grow(parser, frame, sizeof(%s))))\n", c_type);
+            emit("                return 1;\n");
+            snprintf(dest, sizeof(dest), "*(%s *)item", c_type);
+            emit_number_store((enum Kind)i, "            ", dest);
+        } else if (value == ValueBool) {
+            emit("            if (!(item = grow(parser, frame, sizeof(int))))\n");
+            emit("                return 1;\n");
+            emit("            *(int *)item = (type == LaxJsonTypeTrue);\n");
+        } else {
+            /* a null element is zero */
+            emit("            if (!(item = grow(parser, frame, sizeof(%s))))\n", c_type);
+            emit("                return 1;\n");
+            emit("            memset(item, 0, sizeof(%s));\n", c_type);
+        }
+        emit("            return 0;\n");
+    }
+
+    if (value != ValueNull)
+        return;
+    for (i = 0; i < schema->type_count; i += 1) {
+        if (!uses_array_of(schema, KindStruct, i))
+            continue;
+        /* a null element of a struct array gets the defaults */
+        emit("        case FrameArray_%s:\n", schema->types[i].name);
+        emit("            if (!(item = grow(parser, frame, sizeof(struct %s))))\n", schema->types[i].name);
+        emit("                return 1;\n");
+        emit("            %s_init(item);\n", schema->types[i].name);
+        emit("            return 0;\n");
+    }
+}
+
+static void emit_callbacks(struct Schema *schema) {
+    const char *root = schema->root;
+    struct Type *type;
+    struct Field *field;
+    int i, j;
+
+    emit("static int on_string(struct LaxJsonContext *context,\n"
+         "    enum LaxJsonType type, const char *value, int length)\n{\n");
+    emit("    struct %s_parser *parser = context->userdata;\n", root);
+    emit("    struct frame *frame;\n");
+    emit("    void *item;\n");
+    emit("    char *copy;\n");
+    emit("    int field;\n\n");
+    emit("    if (parser->skip_depth)\n        return 0;\n");
+    emit("    if (parser->frame_index == 0)\n        return mismatch(parser);\n");
+    emit("    frame = &parser->frames[parser->frame_index - 1];\n");
+    emit("    if (type == LaxJsonTypeProperty) {\n");
+    emit("        switch (frame->kind) {\n");
+    for (i = 0; i < schema->type_count; i += 1) {
+        type = &schema->types[i];
+        if (!type->reachable)
+            continue;
+        emit("            case Frame_%s:\n", type->name);
+        emit("                parser->field = %s_key(value, length);\n", type->name);
+        emit("                break;\n");
+    }
+    emit("        }\n");
+    emit("        return 0;\n");
+    emit("    }\n");
+    emit("    if (parser->frame_index == 0)\n        return mismatch(parser);\n");
+    emit("    field = parser->field;\n");
+    emit("    parser->field = -1;\n");
+    emit("    switch (frame->kind) {\n");
+    emit_scalar_cases(schema, ValueString);
+    emit("    }\n");
+    emit("    (void)item;\n");
+    emit("    (void)copy;\n");
+    emit("    return mismatch(parser);\n");
+    emit("}\n\n");
+
+    emit("static int on_number(struct LaxJsonContext *context, double x) {\n");
+    emit("    struct %s_parser *parser = context->userdata;\n", root);
+    emit("    struct frame *frame;\n");
+    emit("    void *item;\n");
+    emit("    int field;\n\n");
+    emit("    if (parser->skip_depth)\n        return 0;\n");
+    emit("    if (parser->frame_index == 0)\n        return mismatch(parser);\n");
+    emit("    frame = &parser->frames[parser->frame_index - 1];\n");
+    emit("    field = parser->field;\n");
+    emit("    parser->field = -1;\n");
+    emit("    switch (frame->kind) {\n");
+    emit_scalar_cases(schema, ValueNumber);
+    emit("    }\n");
+    emit("    (void)item;\n");
+    emit("    return mismatch(parser);\n");
+    emit("}\n\n");
+
+    /* strings and numbers are taken where they lie in the fed data: the
+     * callbacks above only look at length bytes, and dup_string copies the
+     * ones that are kept */
+    emit("static int on_raw_number(struct LaxJsonContext *context, const char *value, int length, int flags) {\n");
+    emit("    double x;\n\n");
+    emit("    if (lax_json_number_to_double(value, length, &x))\n");
+    emit("        return oom(context->userdata);\n");
+    emit("    return on_number(context, x);\n");
+    emit("}\n\n");
+
+    emit("static int on_primitive(struct LaxJsonContext *context, enum LaxJsonType type) {\n");
+    emit("    struct %s_parser *parser = context->userdata;\n", root);
+    emit("    struct frame *frame;\n");
+    emit("    void *item;\n");
+    emit("    int field;\n\n");
+    emit("    if (parser->skip_depth)\n        return 0;\n");
+    emit("    if (parser->frame_index == 0)\n        return mismatch(parser);\n");
+    emit("    frame = &parser->frames[parser->frame_index - 1];\n");
+    emit("    field = parser->field;\n");
+    emit("    parser->field = -1;\n");
+    emit("    if (type == LaxJsonTypeNull) {\n");
+    emit("        switch (frame->kind) {\n");
+    emit_scalar_cases(schema, ValueNull);
+    emit("        }\n");
+    emit("        return mismatch(parser);\n");
+    emit("    }\n");
+    emit("    switch (frame->kind) {\n");
+    emit_scalar_cases(schema, ValueBool);
+    emit("    }\n");
+    emit("    (void)item;\n");
+    emit("    return mismatch(parser);\n");
+    emit("}\n\n");
+
+    emit("static int on_begin(struct LaxJsonContext *context, enum LaxJsonType type) {\n");
+    emit("    struct %s_parser *parser = context->userdata;\n", root);
+    emit("    struct frame *frame;\n");
+    emit("    void *item;\n");
+    emit("    int field;\n\n");
+    emit("    if (parser->skip_depth) {\n");
+    emit("        parser->skip_depth += 1;\n");
+    emit("        return 0;\n");
+    emit("    }\n");
+    emit("    if (parser->frame_index == 0) {\n");
+    emit("        if (parser->started || type != LaxJsonTypeObject)\n");
+    emit("            return mismatch(parser);\n");
+    emit("        parser->started = 1;\n");
+    emit("        return push_frame(parser, Frame_%s, parser->out, NULL);\n", root);
+    emit("    }\n");
+    emit("    frame = &parser->frames[parser->frame_index - 1];\n");
+    emit("    field = parser->field;\n");
+    emit("    parser->field = -1;\n");
+    emit("    switch (frame->kind) {\n");
+    for (i = 0; i < schema->type_count; i += 1) {
+        type = &schema->types[i];
+        if (!type->reachable)
+            continue;
+        emit("        case Frame_%s:\n", type->name);
+        emit("            switch (field) {\n");
+        emit("                case -1:\n");
+        emit("                    parser->skip_depth = 1;\n");
+        emit("                    return 0;\n");
+        for (j = 0; j < type->field_count; j += 1) {
+            field = &type->fields[j];
+            if (field->is_array) {
+                emit("                case %d:\n", j);
+                emit("                    if (type != LaxJsonTypeArray)\n");
+                emit("                        return mismatch(parser);\n");
+                emit("                    free_%s_items(((struct %s *)frame->ptr)->%s, "
+                     "((struct %s *)frame->ptr)->%s_count);\n",
+                     kind_name(schema, field), type->name, field->member, type->name, field->member);
+                emit("                    ((struct %s *)frame->ptr)->%s = NULL;\n", type->name, field->member);
+                emit("                    ((struct %s *)frame->ptr)->%s_count = 0;\n", type->name, field->member);
+                emit("                    return push_frame(parser, FrameArray_%s,\n", kind_name(schema, field));
+                emit("                            &((struct %s *)frame->ptr)->%s,\n", type->name, field->member);
+                emit("                            &((struct %s *)frame->ptr)->%s_count);\n", type->name, field->member);
+            } else if (field->kind == KindStruct) {
+                emit("                case %d:\n", j);
+                emit("                    if (type != LaxJsonTypeObject)\n");
+                emit("                        return mismatch(parser);\n");
+                emit("                    return push_frame(parser, Frame_%s, &((struct %s *)frame->ptr)->%s, NULL);\n",
+                        schema->types[field->type_index].name, type->name, field->member);
+            }
+        }
+        emit("            }\n");
+        emit("            return mismatch(parser);\n");
+    }
+    for (i = 0; i < schema->type_count; i += 1) {
+        if (!uses_array_of(schema, KindStruct, i))
+            continue;
+        emit("        case FrameArray_%s:\n", schema->types[i].name);
+        emit("            if (type != LaxJsonTypeObject)\n");
+        emit("                return mismatch(parser);\n");
+        emit("            if (!(item = grow(parser, frame, sizeof(struct %s))))\n", schema->types[i].name);
+        emit("                return 1;\n");
+        emit("            %s_init(item);\n", schema->types[i].name);
+        emit("            return push_frame(parser, Frame_%s, item, NULL);\n", schema->types[i].name);
+    }
+    emit("    }\n");
+    emit("    (void)item;\n");
+    emit("    return mismatch(parser);\n");
+    emit("}\n\n");
+
+    emit("static int on_end(struct LaxJsonContext *context, enum LaxJsonType type) {\n");
+    emit("    struct %s_parser *parser = context->userdata;\n\n", root);
+    emit("    if (parser->skip_depth)\n");
+    emit("        parser->skip_depth -= 1;\n");
+    emit("    else\n");
+    emit("        parser->frame_index -= 1;\n");
+    emit("    return 0;\n");
+    emit("}\n\n");
+}
+
+static void emit_dup_string(void) {
+    emit("static char *dup_string(const char *value, int length) {\n");
+    emit("    char *copy = malloc(length + 1);\n");
+    emit("    if (copy) {\n");
+    emit("        memcpy(copy, value, length);\n");
+    emit("        copy[length] = 0;\n");
+    emit("    }\n");
+    emit("    return copy;\n");
+    emit("}\n\n");
+}
+
+static void emit_grow(const char *root) {
+    emit("static void *grow(struct %s_parser *parser, struct frame *frame, size_t size) {\n", root);
+    emit("    void **items = frame->ptr;\n");
+    emit("    void *new_ptr;\n");
+    emit("    int new_capacity;\n\n");
+    emit("    if (*frame->count >= frame->capacity) {\n");
+    emit("        new_capacity = frame->capacity ? frame->capacity * 2 : 8;\n");
+    emit("        new_ptr = realloc(*items, size * new_capacity);\n");
+    emit("        if (!new_ptr) {\n");
+    emit("            oom(parser);\n");
+    emit("            return NULL;\n");
+    emit("        }\n");
+    emit("        *items = new_ptr;\n");
+    emit("        frame->capacity = new_capacity;\n");
+    emit("    }\n");
+    emit("    *frame->count += 1;\n");
+    emit("    return (char *)*items + size * (*frame->count - 1);\n");
+    emit("}\n\n");
+}
+
+static void emit_source(struct Schema *schema, const char *header_name, const char *schema_path) {
+    const char *root = schema->root;
+    struct Type *type;
+    int i;
+
+    emit("/* Generated by laxjson_codegen from %s. Do not edit. */\n\n", schema_path);
+    emit("#include \"%s\"\n\n", header_name);
+    emit("#include <stdlib.h>\n#include <string.h>\n#include <limits.h>\n\n");
+
+    emit("enum FrameKind {\n");
+    for (i = 0; i < schema->type_count; i += 1) {
+        if (schema->types[i].reachable)
+            emit("    Frame_%s,\n", schema->types[i].name);
+    }
+    for_each_array_kind(schema, emit_frame_kind);
+    emit("    FrameCount\n");
+    emit("};\n\n");
+
+    emit("struct frame {\n");
+    emit("    int kind;\n");
+    emit("    /* struct frames: the struct. array frames: the items pointer. */\n");
+    emit("    void *ptr;\n");
+    emit("    int *count;\n");
+    emit("    int capacity;\n");
+    emit("};\n\n");
+
+    emit("struct %s_parser {\n", root);
+    emit("    struct LaxJsonContext *context;\n");
+    emit("    struct %s *out;\n", root);
+    emit("    struct frame *frames;\n");
+    emit("    int frame_index;\n");
+    emit("    int frame_size;\n");
+    emit("    int field;\n");
+    emit("    int started;\n");
+    emit("    int skip_depth;\n");
+    emit("    enum LaxJsonError error;\n");
+    emit("};\n\n");
+
+    for (i = 0; i < schema->type_count; i += 1) {
+        type = &schema->types[i];
+        if (type->reachable && i != schema->root_index) {
+            emit("static void %s_init(struct %s *value);\n", type->name, type->name);
+            emit("static void %s_free(struct %s *value);\n", type->name, type->name);
+        }
+    }
+    for_each_array_kind(schema, emit_items_prototype);
+    emit("\n");
+
+    if (uses_kind(schema, KindString))
+        emit_dup_string();
+
+    emit("static int mismatch(struct %s_parser *parser) {\n", root);
+    emit("    parser->error = LaxJsonErrorTypeMismatch;\n");
+    emit("    return 1;\n");
+    emit("}\n\n");
+
+    emit("static int oom(struct %s_parser *parser) {\n", root);
+    emit("    parser->error = LaxJsonErrorNoMem;\n");
+    emit("    return 1;\n");
+    emit("}\n\n");
+
+    emit("static int push_frame(struct %s_parser *parser, int kind, void *ptr, int *count) {\n", root);
+    emit("    struct frame *new_ptr;\n");
+    emit("    struct frame *frame;\n\n");
+    emit("    if (parser->frame_index >= parser->frame_size) {\n");
+    emit("        parser->frame_size += 32;\n");
+    emit("        new_ptr = realloc(parser->frames, parser->frame_size * sizeof(struct frame));\n");
+    emit("        if (!new_ptr)\n");
+    emit("            return oom(parser);\n");
+    emit("        parser->frames = new_ptr;\n");
+    emit("    }\n");
+    emit("    frame = &parser->frames[parser->frame_index];\n");
+    emit("    frame->kind = kind;\n");
+    emit("    frame->ptr = ptr;\n");
+    emit("    frame->count = count;\n");
+    emit("    frame->capacity = 0;\n");
+    emit("    parser->frame_index += 1;\n");
+    emit("    return 0;\n");
+    emit("}\n\n");
+
+    if (uses_kind(schema, -1))
+        emit_grow(root);
+
+    for (i = 0; i < schema->type_count; i += 1) {
+        type = &schema->types[i];
+        if (!type->reachable)
+            continue;
+        emit_key_function(schema, type);
+        emit_init_free(schema, i);
+    }
+    for_each_array_kind(schema, emit_items_free);
+
+    emit_callbacks(schema);
+
+    emit("struct %s_parser *%s_parser_create(struct %s *out) {\n", root, root, root);
+    emit("    struct %s_parser *parser = calloc(1, sizeof(struct %s_parser));\n\n", root, root);
+    emit("    %s_init(out);\n", root);
+    emit("    if (!parser)\n        return NULL;\n");
+    emit("    parser->context = lax_json_create();\n");
+    emit("    if (!parser->context) {\n");
+    emit("        free(parser);\n");
+    emit("        return NULL;\n");
+    emit("    }\n");
+    emit("    parser->out = out;\n");
+    emit("    parser->field = -1;\n");
+    emit("    parser->context->userdata = parser;\n");
+    emit("    parser->context->string = on_string;\n");
+    emit("    parser->context->number = on_number;\n");
+    emit("    parser->context->primitive = on_primitive;\n");
+    emit("    parser->context->begin = on_begin;\n");
+    emit("    parser->context->end = on_end;\n");
+    emit("    parser->context->raw_string = on_string;\n");
+    emit("    parser->context->raw_number = on_raw_number;\n");
+    emit("    return parser;\n");
+    emit("}\n\n");
+
+    emit("void %s_parser_destroy(struct %s_parser *parser) {\n", root, root);
+    emit("    lax_json_destroy(parser->context);\n");
+    emit("    free(parser->frames);\n");
+    emit("    free(parser);\n");
+    emit("}\n\n");
+
+    emit("enum LaxJsonError %s_parser_feed(struct %s_parser *parser, int size, const char *data) {\n",
+            root, root);
+    emit("    enum LaxJsonError err = lax_json_feed(parser->context, size, data);\n");
+    emit("    if (err == LaxJsonErrorAborted && parser->error)\n");
+    emit("        return parser->error;\n");
+    emit("    return err;\n");
+    emit("}\n\n");
+
+    emit("enum LaxJsonError %s_parser_eof(struct %s_parser *parser) {\n", root, root);
+    emit("    enum LaxJsonError err = lax_json_eof(parser->context);\n");
+    emit("    if (err == LaxJsonErrorNone && !parser->started)\n");
+    emit("        return LaxJsonErrorUnexpectedEof;\n");
+    emit("    return err;\n");
+    emit("}\n\n");
+
+    emit("struct LaxJsonContext *%s_parser_context(struct %s_parser *parser) {\n", root, root);
+    emit("    return parser->context;\n");
+    emit("}\n\n");
+
+    emit("enum LaxJsonError %s_parse(struct %s *out, int size, const char *data) {\n", root, root);
+    emit("    struct %s_parser *parser = %s_parser_create(out);\n", root, root);
+    emit("    enum LaxJsonError err;\n\n");
+    emit("    if (!parser)\n        return LaxJsonErrorNoMem;\n");
+    emit("    err = %s_parser_feed(parser, size, data);\n", root);
+    emit("    if (!err)\n        err = %s_parser_eof(parser);\n", root);
+    emit("    %s_parser_destroy(parser);\n", root);
+    emit("    return err;\n");
+    emit("}\n");
+}
+
+static void free_schema(struct Schema *schema) {
+    struct Type *type;
+    struct Field *field;
+    int i, j;
+
+    for (i = 0; i < schema->type_count; i += 1) {
+        type = &schema->types[i];
+        for (j = 0; j < type->field_count; j += 1) {
+            field = &type->fields[j];
+            free(field->key);
+            free(field->member);
+            free(field->type_spec);
+            free(field->default_string);
+        }
+        free(type->fields);
+        free(type->name);
+    }
+    free(schema->types);
+    free(schema->root);
+}
+
+static FILE *open_output(const char *base, const char *ext) {
+    char *path = xalloc(strlen(base) + strlen(ext) + 1);
+    FILE *f;
+    strcpy(path, base);
+    strcat(path, ext);
+    f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    free(path);
+    return f;
+}
+
+int main(int argc, char *argv[]) {
+    struct Schema schema;
+    const char *base;
+    const char *header_name;
+    char *guard;
+    char *c;
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s schema.json output_base\n"
+                "Writes output_base.h and output_base.c.\n", argv[0]);
+        return 1;
+    }
+
+    memset(&schema, 0, sizeof(schema));
+    load_schema(argv[1], &schema);
+
+    base = argv[2];
+    header_name = strrchr(base, '/');
+    header_name = header_name ? header_name + 1 : base;
+
+    guard = xalloc(strlen(header_name) + sizeof("_H_INCLUDED"));
+    strcpy(guard, header_name);
+    strcat(guard, "_H_INCLUDED");
+    for (c = guard; *c; c += 1) {
+        if (*c >= 'a' && *c <= 'z')
+            *c = *c - 'a' + 'A';
+        else if (!((*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9')))
+            *c = '_';
+    }
+
+    out = open_output(base, ".h");
+    emit_header(&schema, guard, argv[1]);
+    fclose(out);
+
+    out = open_output(base, ".c");
+    {
+        char *header_file = xalloc(strlen(header_name) + 3);
+        strcpy(header_file, header_name);
+        strcat(header_file, ".h");
+        emit_source(&schema, header_file, argv[1]);
+        free(header_file);
+    }
+    if (fclose(out) != 0) {
+        perror(base);
+        return 1;
+    }
+
+    free(guard);
+    free_schema(&schema);
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2013 Andrew Kelley
+ *
+ * This file is part of liblaxjson, which is MIT licensed.
+ * See http://opensource.org/licenses/MIT
+ */
+
+/* Builds the sidecar index of a large lax JSON file, or uses it to print the
+ * text of the values at some paths:
+ *
+ *   laxjson_index big.json big.json.idx
+ *   laxjson_index big.json big.json.idx servers.12.limits 'users.*.name'
+ */
+
+#include <laxjson_index.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char *argv[]) {
+    struct LaxJsonContext *context;
+    struct LaxJsonIndex *index;
+    enum LaxJsonError err;
+    int64_t start;
+    int64_t end;
+    int status = 0;
+    int i;
+
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s file.json index [path...]\n"
+                "Without paths, writes the index of file.json. With paths, prints\n"
+                "the text of the value at each one using the index.\n", argv[0]);
+        return 1;
+    }
+
+    if (argc == 3) {
+        context = lax_json_create();
+        if (!context) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+        err = lax_json_index_build(context, argv[1], argv[2], 0, 0);
+        if (err) {
+            fprintf(stderr, "%s:%d:%d: %s\n", argv[1], context->line, context->column,
+                    lax_json_str_err(err));
+            status = 1;
+        }
+        lax_json_destroy(context);
+        return status;
+    }
+
+    err = lax_json_index_open(argv[1], argv[2], &index);
+    if (err) {
+        fprintf(stderr, "%s: %s\n", argv[2], lax_json_str_err(err));
+        return 1;
+    }
+    for (i = 3; i < argc; i += 1) {
+        err = lax_json_index_find(index, argv[i], &start, &end);
+        if (err) {
+            fprintf(stderr, "%s: %s\n", argv[i], lax_json_str_err(err));
+            status = 1;
+            continue;
+        }
+        fwrite(index->source + start, 1, end - start, stdout);
+        fputc('\n', stdout);
+    }
+    lax_json_index_close(index);
+    return status;
+}